@@ -0,0 +1,178 @@
+/****************************************************************************
+**
+** Фоновая запись фрагментов и гипотез на диск
+**
+****************************************************************************/
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include "archivewriter.h"
+#include "metrics.h"
+
+ArchiveWriter::ArchiveWriter(const QString &path, const QAudioFormat &format,
+                             qint64 maxQueueBytes, int syncIntervalMs,
+                             qint64 maxSegmentBytes, int maxSegmentSec)
+  : _maxQueueBytes(maxQueueBytes)
+  , _syncIntervalMs(syncIntervalMs)
+  , _enabled(1)
+  , _dropped(0)
+  , _queueBytes(0)
+  , _flushRequested(false)
+  , _busy(false)
+  , _stop(false)
+  , _segments(path, format, maxSegmentBytes, maxSegmentSec)
+  , _thread(this)
+{
+  _thread.start(QThread::LowPriority);
+}
+
+ArchiveWriter::~ArchiveWriter()
+{
+  {
+    QMutexLocker locker(&_mutex);
+    _stop = true;
+    _condition.wakeAll();
+  }
+  _thread.wait();
+}
+
+void ArchiveWriter::setEnabled(bool enabled)
+{
+  _enabled.storeRelease(enabled ? 1 : 0);
+}
+
+bool ArchiveWriter::isEnabled() const
+{
+  return _enabled.loadAcquire() != 0;
+}
+
+bool ArchiveWriter::writeFragment(quint64 id, qint64 position, const QByteArray &pcm)
+{
+  Job job;
+  job.type = SegmentWriter::FragmentRecord;
+  job.id = id;
+  job.position = position;
+  job.timeMs = QDateTime::currentMSecsSinceEpoch();
+  job.score = 0;
+  job.data = pcm;
+  return enqueue(job);
+}
+
+bool ArchiveWriter::writeHypothesis(quint64 id, const QString &hypothesis, int score)
+{
+  Job job;
+  job.type = SegmentWriter::HypothesisRecord;
+  job.id = id;
+  job.position = 0;
+  job.timeMs = QDateTime::currentMSecsSinceEpoch();
+  job.score = score;
+  job.data = hypothesis.toUtf8();
+  return enqueue(job);
+}
+
+int ArchiveWriter::dropped() const
+{
+  return _dropped.loadAcquire();
+}
+
+void ArchiveWriter::flush()
+{
+  requestFlush();
+  QMutexLocker locker(&_mutex);
+  while ((_flushRequested || _busy || !_queue.isEmpty()) && _thread.isRunning())
+    _idle.wait(&_mutex, 100);
+}
+
+void ArchiveWriter::requestFlush()
+{
+  QMutexLocker locker(&_mutex);
+  _flushRequested = true;
+  _condition.wakeAll();
+}
+
+bool ArchiveWriter::enqueue(const Job &job)
+{
+  if (!isEnabled())
+    return false;
+  QMutexLocker locker(&_mutex);
+  if (_queueBytes + job.data.size() > _maxQueueBytes) {
+    _dropped.fetchAndAddRelaxed(1);
+    return false;
+  }
+  _queue.append(job);
+  _queueBytes += job.data.size();
+  _condition.wakeAll();
+  return true;
+}
+
+void ArchiveWriter::process()
+{
+  QElapsedTimer sinceSync;
+  sinceSync.start();
+  bool dirty = false;
+  forever {
+    QList<Job> batch;
+    bool stop;
+    bool flush;
+    {
+      QMutexLocker locker(&_mutex);
+      if (_queue.isEmpty() && !_stop && !_flushRequested) {
+        // несохранённые данные ждут fsync не дольше _syncIntervalMs
+        if (dirty)
+          _condition.wait(&_mutex, qMax(qint64(0), _syncIntervalMs - sinceSync.elapsed()));
+        else
+          _condition.wait(&_mutex);
+      }
+      batch.swap(_queue);
+      _queueBytes = 0;
+      _busy = !batch.isEmpty();
+      stop = _stop;
+      flush = _flushRequested;
+    }
+
+    foreach (const Job &job, batch)
+      write(job);
+    dirty = dirty || !batch.isEmpty();
+
+    if (dirty && (stop || flush || sinceSync.elapsed() >= _syncIntervalMs)) {
+      sync();
+      dirty = false;
+      sinceSync.start();
+    }
+
+    {
+      QMutexLocker locker(&_mutex);
+      _busy = false;
+      if (flush && _queue.isEmpty())
+        _flushRequested = false;
+      _idle.wakeAll();
+    }
+    if (stop) {
+      _segments.close();
+      return;
+    }
+  }
+}
+
+void ArchiveWriter::write(const Job &job)
+{
+  static LatencyHistogram *const writeLatency = Metrics::instance().histogram("archive.write");
+  LatencyTimer timer(writeLatency);
+
+  if (job.type == SegmentWriter::FragmentRecord)
+    _segments.appendFragment(job.id, job.position, job.timeMs, job.data);
+  else
+    _segments.appendHypothesis(job.id, job.timeMs, job.score, job.data);
+}
+
+void ArchiveWriter::sync()
+{
+  static LatencyHistogram *const syncLatency = Metrics::instance().histogram("archive.sync");
+  LatencyTimer timer(syncLatency);
+  _segments.sync();
+}
+
+void ArchiveWriter::WriterThread::run()
+{
+  _self->process();
+}
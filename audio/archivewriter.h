@@ -0,0 +1,129 @@
+/****************************************************************************
+**
+** Фоновая запись фрагментов и гипотез на диск
+**
+** Поток GUI только ставит фрагмент или гипотезу в очередь; файлы
+** создаются и пишутся в отдельном потоке. Очередь ограничена по объёму:
+** если диск не успевает, новые записи отбрасываются (с подсчётом), а
+** запись звука и распознавание не ждут. Данные сбрасываются на диск
+** (fsync) группами - не чаще одного раза в syncIntervalMs, - поэтому
+** серия коротких команд стоит одного fsync.
+**
+** Фрагменты и гипотезы дописываются в сегменты архива (segmentarchive.h).
+**
+****************************************************************************/
+
+#ifndef ARCHIVEWRITER_H
+#define ARCHIVEWRITER_H
+
+#include <QAudioFormat>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+#include "segmentarchive.h"
+
+class ArchiveWriter
+{
+public:
+  /**
+   * @param path            [вх] каталог архива (создаётся при необходимости)
+   * @param format          [вх] формат фрагментов
+   * @param maxQueueBytes   [вх] предельный объём очереди
+   * @param syncIntervalMs  [вх] наименьший интервал между fsync
+   * @param maxSegmentBytes [вх] размер сегмента архива
+   * @param maxSegmentSec   [вх] длительность сегмента архива
+   */
+  ArchiveWriter(const QString &path, const QAudioFormat &format,
+                qint64 maxQueueBytes = 32 * 1024 * 1024, int syncIntervalMs = 1000,
+                qint64 maxSegmentBytes = 64 * 1024 * 1024, int maxSegmentSec = 3600);
+  ~ArchiveWriter();
+
+  /**
+   * @brief Включить/выключить запись (можно во время работы);
+   * при выключении уже поставленное в очередь дописывается
+   */
+  void setEnabled(bool enabled);
+  bool isEnabled() const;
+
+  /**
+   * @brief Поставить фрагмент в очередь
+   * @param id       [вх] номер фрагмента
+   * @param position [вх] позиция начала в записи, семплы
+   * @param pcm      [вх] звук
+   * @return false - запись выключена или очередь переполнена
+   */
+  bool writeFragment(quint64 id, qint64 position, const QByteArray &pcm);
+
+  /**
+   * @brief Поставить в очередь гипотезу фрагмента id
+   */
+  bool writeHypothesis(quint64 id, const QString &hypothesis, int score);
+
+  /**
+   * @brief Количество отброшенных из-за переполнения очереди записей
+   */
+  int dropped() const;
+
+  /**
+   * @brief Дописать очередь и сбросить файлы на диск (ждёт fsync)
+   */
+  void flush();
+
+  /**
+   * @brief Попросить поток записи дописать очередь и сбросить файлы на
+   * диск, не дожидаясь этого (можно из потока GUI)
+   */
+  void requestFlush();
+
+private:
+  /**
+   * @brief Поток записи
+   */
+  class WriterThread : public QThread
+  {
+  public:
+    WriterThread(ArchiveWriter *writer) : _self(writer) {}
+    void run();
+  protected:
+    ArchiveWriter *_self;
+  };
+
+  struct Job
+  {
+    SegmentWriter::RecordType type;
+    quint64 id;
+    qint64 position;
+    qint64 timeMs;
+    int score;
+    QByteArray data;  // звук или текст гипотезы
+  };
+
+  bool enqueue(const Job &job);
+  void process();
+  void write(const Job &job);
+  void sync();
+
+  const qint64 _maxQueueBytes;
+  const int _syncIntervalMs;
+
+  QAtomicInt _enabled;
+  QAtomicInt _dropped;
+
+  mutable QMutex _mutex;        // защищает очередь и флаги ниже
+  QWaitCondition _condition;    // новые записи или остановка
+  QWaitCondition _idle;         // очередь записана на диск
+  QList<Job> _queue;
+  qint64 _queueBytes;
+  bool _flushRequested;
+  bool _busy;                   // поток пишет взятые из очереди записи
+  bool _stop;
+
+  SegmentWriter _segments;  // используется только потоком записи
+  WriterThread _thread;
+};
+
+#endif // ARCHIVEWRITER_H
@@ -10,10 +10,15 @@ DEFINES += LOG_WAVEFORM
 # Debug output from engine
 DEFINES += LOG_ENGINE
 
+# Measure the cost of delivering captured data on each notify
+# (reported through the engine debug output)
+#DEFINES += BENCHMARK_ENGINE
+
 # Dump input data to spectrum analyer, plus artefact data files
 #DEFINES += DUMP_SPECTRUMANALYSER
 
-# Dump captured audio data
+# Dump captured audio data (the whole recording on stop; recognized
+# fragments are archived by ArchiveWriter regardless of this macro)
 DEFINES += DUMP_CAPTURED_AUDIO
 
 # Disable calculation of level
@@ -34,6 +39,9 @@ DEFINES += SUPERIMPOSE_PROGRESS_ON_WAVEFORM
 # Perform spectrum analysis calculation in a separate thread
 DEFINES += SPECTRUM_ANALYSER_SEPARATE_THREAD
 
+# Build identifier printed in metrics reports
+include($$PWD/buildid.pri)
+
 # Suppress warnings about strncpy potentially being unsafe, emitted by MSVC
 win32: DEFINES += _CRT_SECURE_NO_WARNINGS
 
@@ -55,7 +63,14 @@ SOURCES += \
     $$PWD/utils.cpp \
     $$PWD/progressbar.cpp \
     $$PWD/levelmeter.cpp \
-    $$PWD/wavfileio.cpp
+    $$PWD/wavfileio.cpp \
+    $$PWD/ringbuffer.cpp \
+    $$PWD/samplekernels.cpp \
+    $$PWD/metrics.cpp \
+    $$PWD/archivewriter.cpp \
+    $$PWD/segmentarchive.cpp \
+    $$PWD/peakpyramid.cpp \
+    $$PWD/resampler.cpp
 
 HEADERS  += \
     $$PWD/engine.h \
@@ -63,4 +78,12 @@ HEADERS  += \
     $$PWD/utils.h \
     $$PWD/progressbar.h \
     $$PWD/levelmeter.h \
-    $$PWD/wavfileio.h
+    $$PWD/wavfileio.h \
+    $$PWD/ringbuffer.h \
+    $$PWD/audioblock.h \
+    $$PWD/samplekernels.h \
+    $$PWD/metrics.h \
+    $$PWD/archivewriter.h \
+    $$PWD/segmentarchive.h \
+    $$PWD/peakpyramid.h \
+    $$PWD/resampler.h
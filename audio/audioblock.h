@@ -0,0 +1,53 @@
+/****************************************************************************
+**
+** Блок записанных аудио-данных
+**
+****************************************************************************/
+
+#ifndef AUDIOBLOCK_H
+#define AUDIOBLOCK_H
+
+#include <QByteArray>
+#include <QMetaType>
+
+/**
+ * @brief Непрерывный участок записанных данных
+ *
+ * data - представление памяти кольцевого буфера без копирования
+ * (QByteArray::fromRawData). Оно действительно только до возврата из
+ * слота, подключённого напрямую (Qt::DirectConnection); для хранения или
+ * передачи в другой поток используйте detached().
+ */
+struct AudioBlock
+{
+  qint64     position;    // абсолютный номер первого кадра (семпла по всем каналам)
+  int        frameSize;   // размер кадра в байтах
+  QByteArray data;        // данные блока
+  qint64     captureNs;   // время (Metrics::now()) чтения последнего кадра с устройства; 0 - неизвестно
+
+  AudioBlock()
+    : position(0), frameSize(0), captureNs(0)
+  {
+  }
+
+  AudioBlock(qint64 position_, int frameSize_, const QByteArray &data_, qint64 captureNs_ = 0)
+    : position(position_), frameSize(frameSize_), data(data_), captureNs(captureNs_)
+  {
+  }
+
+  // Количество кадров в блоке
+  int frameCount() const { return frameSize ? data.size() / frameSize : 0; }
+
+  // Номер кадра, следующего за блоком
+  qint64 endPosition() const { return position + frameCount(); }
+
+  // Копия блока, владеющая своими данными
+  AudioBlock detached() const
+  {
+    return AudioBlock(position, frameSize, QByteArray(data.constData(), data.size()), captureNs);
+  }
+};
+
+Q_DECLARE_METATYPE(AudioBlock)
+
+#endif // AUDIOBLOCK_H
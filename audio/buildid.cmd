@@ -0,0 +1,13 @@
+@echo off
+rem Идентификатор сборки для отчётов Metrics (см. buildid.sh): пишет в
+rem файл %2 строку #define BUILD_ID с git describe рабочей копии %1,
+rem вне репозитория - время сборки. Файл переписывается, только если
+rem строка изменилась.
+
+set id=
+for /f %%i in ('git -C "%~1" describe --always --dirty 2^>nul') do set id=%%i
+if "%id%"=="" set id=%DATE%-%TIME%
+set id=%id: =0%
+
+> "%~2.tmp" echo #define BUILD_ID "%id%"
+fc /b "%~2.tmp" "%~2" >nul 2>&1 && (del "%~2.tmp") || (move /y "%~2.tmp" "%~2" >nul)
@@ -0,0 +1,22 @@
+# Идентификатор сборки в отчётах Metrics (BUILD_ID): заголовок buildid.h
+# в каталоге сборки пересоздаётся при каждом make (buildid.sh/buildid.cmd)
+# из git describe рабочей копии, вне репозитория - из времени сборки.
+# Подключается проектами, в которые входит metrics.cpp.
+
+BUILD_ID_HEADER = $$OUT_PWD/buildid.h
+win32: BUILD_ID_COMMAND = $$shell_path($$PWD/buildid.cmd) $$shell_quote($$shell_path($$PWD/..)) $$shell_quote($$shell_path($$BUILD_ID_HEADER))
+else: BUILD_ID_COMMAND = sh $$shell_quote($$PWD/buildid.sh) $$shell_quote($$PWD/..) $$shell_quote($$BUILD_ID_HEADER)
+
+# заголовок должен существовать уже при запуске qmake, чтобы попасть в
+# зависимости metrics.cpp; дальше его обновляет цель buildid
+!exists($$BUILD_ID_HEADER): system($$BUILD_ID_COMMAND)
+
+buildid.target = $$BUILD_ID_HEADER
+buildid.commands = $$BUILD_ID_COMMAND
+buildid.depends = FORCE
+QMAKE_EXTRA_TARGETS += buildid
+PRE_TARGETDEPS += $$BUILD_ID_HEADER
+QMAKE_CLEAN += $$BUILD_ID_HEADER
+
+INCLUDEPATH += $$OUT_PWD
+DEPENDPATH += $$OUT_PWD
@@ -0,0 +1,12 @@
+#!/bin/sh
+# Идентификатор сборки для отчётов Metrics: пишет в файл $2 строку
+#   #define BUILD_ID "<git describe рабочей копии $1>"
+# вне репозитория - время сборки. Файл переписывается, только если
+# строка изменилась, чтобы metrics.cpp не пересобирался на каждом make.
+
+id=$(git -C "$1" describe --always --dirty 2>/dev/null)
+[ -n "$id" ] || id=$(date +%Y%m%d-%H%M%S)
+line="#define BUILD_ID \"$id\""
+
+[ -f "$2" ] && [ "$(cat "$2")" = "$line" ] && exit 0
+echo "$line" > "$2"
@@ -39,6 +39,8 @@
 ****************************************************************************/
 
 #include "engine.h"
+#include "metrics.h"
+#include "samplekernels.h"
 #include "utils.h"
 #include "wavefilewriter.h"
 #include <math.h>
@@ -46,6 +48,7 @@
 #include <QAudioOutput>
 #include <QCoreApplication>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QMetaObject>
 #include <QSet>
@@ -58,12 +61,17 @@
 // Минимальная длина записываемой фразы (в байтах)
 const int WaveformMinDataLength   = 20000;
 
-const qint64 BufferDurationUs       = 15 * 1000000; // 15 секунд. Определяет максимальную длину записываемой фразы
+const qint64 BufferDurationUs       = 15 * 1000000; // 15 секунд. Ёмкость кольцевого буфера записи (сколько данных хранится для отстающих читателей)
 const int    NotifyIntervalMs       = 100;
 
 // Size of the level calculation window in microseconds
 const int    LevelWindowUs          = 0.1 * 1000000;
 
+#ifdef BENCHMARK_ENGINE
+// Количество уведомлений, по которым усредняется время доставки данных
+const int    BenchmarkWindow        = 50;
+#endif
+
 //-----------------------------------------------------------------------------
 // Constructor and destructor
 //-----------------------------------------------------------------------------
@@ -83,12 +91,22 @@ Engine::Engine(QObject *parent)
   ,   _audioOutputDevice(QAudioDeviceInfo::defaultOutputDevice())
   ,   _audioOutput(nullptr)
   ,   _playPosition(0)
+  ,   _recordStart(0)
+  ,   _blockPosition(0)
+  ,   _readPendingNs(-1)
+  ,   _writeNs(0)
   ,   _maxBufferLength(0)
   ,   _dataLength(0)
   ,   _levelBufferLength(0)
   ,   _rmsLevel(0.0)
   ,   _peakLevel(0.0)
+#ifdef BENCHMARK_ENGINE
+  ,   _benchmarkNotifies(0)
+  ,   _benchmarkTotalNs(0)
+  ,   _benchmarkMaxNs(0)
+#endif
 {
+  qRegisterMetaType<AudioBlock>();
 //  initialize();
 
 #ifdef DUMP_DATA
@@ -112,6 +130,13 @@ bool Engine::initializeRecord()
   return initialize();
 }
 
+bool Engine::initializeRecord(const QAudioDeviceInfo &device, const QAudioFormat &format)
+{
+  _audioInputDevice = device;
+  if (!setAudioFormat(format)) return false;
+  return initialize();
+}
+
 qint64 Engine::maxBufferLength() const
 {
   return _maxBufferLength;
@@ -149,17 +174,17 @@ void Engine::startRecording()
       QAudio::SuspendedState == _state) {
     _audioInput->resume();
   } else {
-     _buffer.resize(_maxBufferLength);
-    _buffer.fill(0);
-    setRecordPosition(0, true);
+    // Кольцевой буфер не очищается: позиции записи непрерывны между
+    // сеансами, и курсоры потребителей остаются действительными
+    _recordStart = _ringBuffer.writePosition();
+    _blockPosition = _recordStart;
+    setRecordPosition(_recordStart, true);
     stopPlayback();
     _mode = QAudio::AudioInput;
     connect(_audioInput, SIGNAL(stateChanged(QAudio::State)),
             this, SLOT(audioStateChanged(QAudio::State)));
     connect(_audioInput, SIGNAL(notify()),
             this, SLOT(audioNotify()));
-    _dataLength = 0;
-    emit dataLengthChanged(0);
     _audioInputIODevice = _audioInput->start();
     connect(_audioInputIODevice, SIGNAL(readyRead()),
             this, SLOT(audioDataReady()));
@@ -250,12 +275,46 @@ void Engine::audioNotify()
   switch (_mode) {
   case QAudio::AudioInput: {
 //    ENGINE_DEBUG << "Engine::audioNotify" << "QAudio::AudioInput";
-    const qint64 recordPosition = qMin(_maxBufferLength, audioLength(_format, _audioInput->processedUSecs()));
-    setRecordPosition(recordPosition);
-    const qint64 levelPosition = _dataLength - _levelBufferLength;
-    if (levelPosition >= 0)
-      calculateLevel(levelPosition, _levelBufferLength);
-    emit bufferChanged(_dataLength, _buffer);
+    const qint64 writePosition = _ringBuffer.writePosition();
+    setRecordPosition(writePosition);
+    qint64 levelPosition = writePosition - _levelBufferLength;
+    if (levelPosition >= 0 && _levelBufferLength > 0) {
+      _levelBuffer.resize(_levelBufferLength);
+      const qint64 length = _ringBuffer.peek(levelPosition, _levelBuffer.data(), _levelBufferLength);
+      if (length > 0)
+        calculateLevel(_levelBuffer.constData(), length);
+    }
+    emit dataAvailable(writePosition);
+
+    // сколько прочитанные данные ждали уведомления и сколько заняла их рассылка
+    static LatencyHistogram *const notifyLatency = Metrics::instance().histogram("capture.notify");
+    static LatencyHistogram *const deliverLatency = Metrics::instance().histogram("capture.deliver");
+    const qint64 notifyNs = Metrics::now();
+    if (_readPendingNs >= 0) {
+      notifyLatency->record(notifyNs - _readPendingNs);
+      _readPendingNs = -1;
+    }
+
+#ifdef BENCHMARK_ENGINE
+    QElapsedTimer timer;
+    timer.start();
+#endif
+    emitCapturedBlocks();
+    deliverLatency->record(Metrics::now() - notifyNs);
+#ifdef BENCHMARK_ENGINE
+    // Время доставки не должно зависеть от длительности записи
+    const qint64 elapsed = timer.nsecsElapsed();
+    _benchmarkTotalNs += elapsed;
+    _benchmarkMaxNs = qMax(_benchmarkMaxNs, elapsed);
+    if (++_benchmarkNotifies == BenchmarkWindow) {
+      ENGINE_DEBUG << "Engine::audioNotify" << "captured, s:" << audioDuration(_format, writePosition) / 1000000
+                   << "delivery avg, us:" << _benchmarkTotalNs / _benchmarkNotifies / 1000
+                   << "max, us:" << _benchmarkMaxNs / 1000;
+      _benchmarkNotifies = 0;
+      _benchmarkTotalNs = 0;
+      _benchmarkMaxNs = 0;
+    }
+#endif
   }
     break;
   case QAudio::AudioOutput: {
@@ -264,7 +323,7 @@ void Engine::audioNotify()
     const qint64 levelPosition = playPosition - _levelBufferLength;
     if ( playPosition >= _dataLength ) stopPlayback();
     if ( levelPosition >= 0 && (levelPosition + _levelBufferLength < _dataLength) )
-      calculateLevel(levelPosition, _levelBufferLength);
+      calculateLevel(_buffer.constData() + levelPosition, _levelBufferLength);
   }
     break;
   }
@@ -294,21 +353,37 @@ void Engine::audioStateChanged(QAudio::State state)
 
 void Engine::audioDataReady()
 {
-  const qint64 bytesReady = _audioInput->bytesReady();
-  const qint64 bytesSpace = _buffer.size() - _dataLength;
-  const qint64 bytesToRead = qMin(bytesReady, bytesSpace);
-
-  const qint64 bytesRead = _audioInputIODevice->read(
-        _buffer.data() + _dataLength,
-        bytesToRead);
-
-  if (bytesRead) {
-    _dataLength += bytesRead;
-    emit dataLengthChanged(dataLength());
+  if (!_audioInputIODevice) return;
+
+  // Данные читаются прямо в память кольцевого буфера; на границе
+  // буфера чтение разбивается на два участка. Запись не
+  // останавливается при заполнении - старые данные перезаписываются.
+  static LatencyHistogram *const readLatency = Metrics::instance().histogram("capture.read");
+  const qint64 readNs = Metrics::now();
+
+  qint64 bytesReady = _audioInput->bytesReady();
+  qint64 bytesTotal = 0;
+  while (bytesReady > 0) {
+    qint64 length = bytesReady;
+    char *region = _ringBuffer.writeRegion(&length);
+    if (!region || !length) break;
+    const qint64 bytesRead = _audioInputIODevice->read(region, length);
+    if (bytesRead <= 0) {
+      _ringBuffer.commit(0);
+      break;
+    }
+    _ringBuffer.commit(bytesRead);
+    bytesReady -= bytesRead;
+    bytesTotal += bytesRead;
   }
 
-  if (_buffer.size() == _dataLength) {
-    stopRecording(true);
+  if (bytesTotal) {
+    const qint64 readEndNs = Metrics::now();
+    readLatency->record(readEndNs - readNs);
+    if (_readPendingNs < 0)
+      _readPendingNs = readEndNs;
+    _writeNs = readEndNs;
+    emit dataLengthChanged(_ringBuffer.writePosition());
   }
 }
 
@@ -334,6 +409,9 @@ void Engine::reset()
   stopPlayback();
   setState(QAudio::AudioInput, QAudio::StoppedState);
   setAudioFormat(QAudioFormat());
+  _ringBuffer.reset(0);
+  _recordStart = 0;
+  _blockPosition = 0;
   _buffer.clear();
   _maxBufferLength = 0;
   _dataLength = 0;
@@ -346,23 +424,30 @@ bool Engine::initialize()
 {
   bool result = false;
 
-  QAudioFormat format = _format;
-
 //  ENGINE_DEBUG << "______________-Engine::initialize" << "format" << _format;
 
   if (selectFormat()) {
-    if (_format != format) {
+    // устройства пересоздаются при смене формата или устройства записи
+    if (!_audioInput || _audioInput->format() != _format
+        || _audioInputDevice.deviceName() != _audioInputDeviceName) {
       resetAudioDevices();
-      _maxBufferLength = audioLength(_format, BufferDurationUs);
-      _buffer.resize(_maxBufferLength);
-      _buffer.fill(0);
+      _ringBuffer.reset(audioLength(_format, BufferDurationUs), _format.bytesPerFrame());
+      _recordStart = 0;
+      _blockPosition = 0;
+      _maxBufferLength = _ringBuffer.capacity();
+      _buffer.clear();
+      _dataLength = 0;
       emit bufferLengthChanged(maxBufferLength());
       emit bufferChanged(0, _buffer);
       _audioInput = new QAudioInput(_audioInputDevice, _format, this);
       _audioInput->setNotifyInterval(NotifyIntervalMs);
+      _audioInputDeviceName = _audioInputDevice.deviceName();
       result = true;
-      _audioOutput = new QAudioOutput(_audioOutputDevice, _format, this);
-      _audioOutput->setNotifyInterval(NotifyIntervalMs);
+      // многоканальную запись устройство воспроизведения может не поддерживать
+      if (_audioOutputDevice.isFormatSupported(_format)) {
+        _audioOutput = new QAudioOutput(_audioOutputDevice, _format, this);
+        _audioOutput->setNotifyInterval(NotifyIntervalMs);
+      }
     }
   } else {
     //      emit errorMessage(tr("Audio format not supported"), formatToString(_format));
@@ -382,7 +467,7 @@ bool Engine::selectFormat()
 
   if (QAudioFormat() != _format) {
     QAudioFormat format = _format;
-    if (_audioOutputDevice.isFormatSupported(format)) {
+    if (_audioInputDevice.isFormatSupported(format)) {
       setAudioFormat(format);
       foundSupportedFormat = true;
     }
@@ -456,12 +541,20 @@ void Engine::stopRecording(bool flag)
   }
   _audioInputIODevice = nullptr;
 
+  if (QAudio::AudioInput == _mode) {
+    // Последняя запись (в пределах ёмкости кольцевого буфера) сохраняется
+    // в линейный буфер для воспроизведения
+    const qint64 writePosition = _ringBuffer.writePosition();
+    const qint64 start = qMax(_recordStart, _ringBuffer.tailPosition());
+    _buffer = _ringBuffer.peek(start, writePosition - start);
+    _dataLength = _buffer.size();
+    _recordStart = writePosition;
+  }
 
   //TODO убрать константу (повесить её на кнопку Стоп, чтобы запрещалось нажимать её раньше времени)
   if (_dataLength > WaveformMinDataLength && QAudio::AudioInput == _mode && flag) {
-    QByteArray buf(_buffer.data(), _dataLength);
-    ENGINE_DEBUG << "Engine::stopRecording()" << _buffer.size() << _maxBufferLength << _dataLength << buf.size();
-    emit completeRecord(buf);
+    ENGINE_DEBUG << "Engine::stopRecording()" << _maxBufferLength << _dataLength;
+    emit completeRecord(_buffer);
   }
 
 #ifdef DUMP_CAPTURED_AUDIO
@@ -514,28 +607,20 @@ void Engine::setPlayPosition(qint64 position, bool forceEmit)
 }
 
 // Вычислить уровень громкости на кадре
-void Engine::calculateLevel(qint64 position, qint64 length)
+void Engine::calculateLevel(const char *data, qint64 length)
 {
 #ifdef DISABLE_LEVEL
-  Q_UNUSED(position)
+  Q_UNUSED(data)
   Q_UNUSED(length)
 #else
-  Q_ASSERT(position + length <= _dataLength);
-
-  qreal peakLevel = 0.0;
-
-  qreal sum = 0.0;
-  const char *ptr = _buffer.constData() + position;
-  const char *const end = ptr + length;
-  while (ptr < end) {
-    const qint16 value = *reinterpret_cast<const qint16*>(ptr);
-    const qreal fracValue = pcmToReal(value);
-    peakLevel = qMax(peakLevel, fracValue);
-    sum += fracValue * fracValue;
-    ptr += 2;
-  }
-  const int numSamples = length / 2;
-  qreal rmsLevel = sqrt(sum / numSamples);
+  // целочисленное накопление; пик - по модулю, с учётом отрицательных семплов
+  const int numSamples = int(length / 2);
+  if (numSamples <= 0)
+    return;
+  const SampleLevel level = measureLevel(reinterpret_cast<const qint16*>(data), numSamples);
+  const qreal amplitude = 32768.0;  // как в pcmToReal
+  const qreal peakLevel = qMin(qreal(1.0), level.peak / amplitude);
+  qreal rmsLevel = sqrt(qreal(level.sumSquares) / numSamples) / amplitude;
 
   rmsLevel = qMax(qreal(0.0), rmsLevel);
   rmsLevel = qMin(qreal(1.0), rmsLevel);
@@ -546,6 +631,34 @@ void Engine::calculateLevel(qint64 position, qint64 length)
 #endif
 }
 
+void Engine::emitCapturedBlocks()
+{
+  const int frameSize = _format.bytesPerFrame();
+  if (frameSize <= 0) return;
+
+  const qint64 writePosition = _ringBuffer.writePosition();
+  const qint64 end = writePosition - writePosition % frameSize;
+
+  // Данные, которые успели перезаписать, пропускаются
+  const qint64 tailPosition = _ringBuffer.tailPosition();
+  if (_blockPosition < tailPosition)
+    _blockPosition = tailPosition + (frameSize - tailPosition % frameSize) % frameSize;
+
+  // Ёмкость буфера кратна размеру кадра, поэтому на границе буфера
+  // участок разбивается на два блока целых кадров. Время записи блока -
+  // время последнего чтения за вычетом длительности данных после блока
+  while (_blockPosition < end) {
+    qint64 length = end - _blockPosition;
+    const char *data = _ringBuffer.readRegion(_blockPosition, &length);
+    if (!data || !length) break;
+    const qint64 captureNs = _writeNs
+        - _format.durationForBytes(qint32(writePosition - _blockPosition - length)) * 1000;
+    emit blockCaptured(AudioBlock(_blockPosition / frameSize, frameSize,
+                                  QByteArray::fromRawData(data, length), captureNs));
+    _blockPosition += length;
+  }
+}
+
 void Engine::setLevel(qreal rmsLevel, qreal peakLevel)
 {
   _rmsLevel = rmsLevel;
@@ -589,27 +702,4 @@ void Engine::dumpData()
   pcmFile.write(_buffer.constData(), _dataLength);
 }
 
-void Engine::dumpData(const QString &name, const QByteArray &image)
-{
-  QString fileName = name + (".txt");
-  const QString txtFileName = _outputDir.filePath(fileName);
-  QFile txtFile(txtFileName);
-  txtFile.open(QFile::WriteOnly | QFile::Text);
-  QTextStream stream(&txtFile);
-  const qint16 *ptr = reinterpret_cast<const qint16*>(image.constData());
-  const int numSamples = image.size() / (2 * _format.channelCount());
-  for (int i=0; i<numSamples; ++i) {
-    stream << i << "\t" << *ptr << "\n";
-    ptr += _format.channelCount();
-  }
-  txtFile.close();
-
-  fileName = name + (".wav");
-  const QString wavFileName = _outputDir.filePath(fileName);
-  WaveFileWriter wavFile;
-  if (wavFile.open(wavFileName, _format)) {
-    wavFile.write(image);
-    wavFile.close();
-  }
-}
 #endif // DUMP_CAPTURED_AUDIO
@@ -41,6 +41,8 @@
 #ifndef ENGINE_H
 #define ENGINE_H
 
+#include "audioblock.h"
+#include "ringbuffer.h"
 #include "wavfileio.h"
 
 #include <QAudioDeviceInfo>
@@ -117,6 +119,13 @@ public:
      */
     bool initializeRecord();
 
+    /**
+     * @brief Подготовить запись с устройства device в формате format
+     * (любое количество каналов; устройство воспроизведения создаётся,
+     * только если поддерживает тот же формат)
+     */
+    bool initializeRecord(const QAudioDeviceInfo &device, const QAudioFormat &format);
+
     /**
      * Position of the audio input device.
      * \return Position in bytes.
@@ -148,11 +157,24 @@ public:
     qint64 maxBufferLength() const;
 
     /**
-     * Amount of data held in the buffer.
+     * Amount of data held in the buffer (playback data or the last
+     * completed recording).
      * \return Data length in bytes.
      */
     qint64 dataLength() const { return _dataLength; }
 
+    /**
+     * @brief Кольцевой буфер записи
+     * Запись идёт непрерывно, потребители читают данные через собственные
+     * курсоры (RingBuffer::reader())
+     */
+    const RingBuffer &ringBuffer() const { return _ringBuffer; }
+
+    /**
+     * @brief Всего записано байт (абсолютная позиция записи)
+     */
+    qint64 capturedLength() const { return _ringBuffer.writePosition(); }
+
     /**
      * @brief Установить параметры аудио
      * @param format [in] параметры аудио
@@ -165,10 +187,6 @@ public:
      */
     void setBuffer(const QByteArray &buffer);
 
-#ifdef DUMP_CAPTURED_AUDIO
-    void dumpData(const QString &name, const QByteArray &image);
-#endif
-
 public slots:
     void startRecording();    
     void startPlayback();
@@ -234,7 +252,23 @@ signals:
     void bufferChanged(qint64 length, const QByteArray &buffer);
 
     /**
-     * @brief completeRecord
+     * @brief В кольцевой буфер записаны новые данные (посылается с периодом уведомлений устройства)
+     * @param position [вх] абсолютная позиция записи в байтах
+     */
+    void dataAvailable(qint64 position);
+
+    /**
+     * @brief Записан новый участок данных (только данные, появившиеся с
+     *        предыдущего сигнала, без копирования)
+     * @param block [вх] участок кольцевого буфера; данные действительны
+     *                   только внутри слота (см. AudioBlock)
+     */
+    void blockCaptured(const AudioBlock &block);
+
+    /**
+     * @brief Запись остановлена
+     * @param buffer [вх] данные, записанные с момента startRecording()
+     *                    (не больше ёмкости кольцевого буфера)
      */
     void completeRecord(const QByteArray &buffer);
 
@@ -260,16 +294,20 @@ private:
     void setPlayPosition(qint64 position, bool forceEmit = false);
     /**
      * @brief Вычислить уровень громкости на кадре
-     * @param position [in] начало кадра
-     * @param length   [in] ширина кадра
+     * @param data     [in] начало кадра
+     * @param length   [in] ширина кадра в байтах
      */
-    void calculateLevel(qint64 position, qint64 length);
+    void calculateLevel(const char *data, qint64 length);
     /**
      * @brief Обновить индикатор уровня громкости
      * @param rmsLevel  [in] громкость в диапазоне от 0.0 до 1.0
      * @param peakLevel [in] пиковая громкость в диапазоне от 0.0 до 1.0
      */
     void setLevel(qreal rmsLevel, qreal peakLevel);
+    /**
+     * @brief Разослать участки кольцевого буфера, записанные с прошлого вызова
+     */
+    void emitCapturedBlocks();
 
 #ifdef DUMP_CAPTURED_AUDIO
     /**
@@ -288,6 +326,7 @@ private:
 
     const QList<QAudioDeviceInfo> _availableAudioInputDevices;    // доступные устройства записи
     QAudioDeviceInfo    _audioInputDevice;                        // выбранное устройство записи
+    QString             _audioInputDeviceName;                    // устройство, для которого создан _audioInput
     QAudioInput*        _audioInput;                              // интерфейс взаимодействия с устройством записи
     QIODevice*          _audioInputIODevice;
     qint64              _recordPosition;                          // позиция записи
@@ -298,9 +337,16 @@ private:
     qint64              _playPosition;                            // позиция воспроизведения
     QBuffer             _audioOutputIODevice;
 
-    QByteArray          _buffer;                                  // блок аудио-данных, полученных от устройства записи
-    qint64              _maxBufferLength;                         // максимально возможный размер блока под записываемые данные (определяет максимальную длину записываемой фразы)
-    qint64              _dataLength;                              // размер реально записанных данных
+    RingBuffer          _ringBuffer;                              // кольцевой буфер записи
+    qint64              _recordStart;                             // позиция в _ringBuffer, с которой начата текущая запись
+    qint64              _blockPosition;                           // позиция в _ringBuffer, до которой разосланы blockCaptured()
+    qint64              _readPendingNs;                           // время чтения (Metrics::now()) первых данных, ещё не разосланных blockCaptured(); -1 - нет
+    qint64              _writeNs;                                 // время чтения (Metrics::now()) данных до writePosition() буфера
+    QByteArray          _levelBuffer;                             // кадр для расчёта уровня громкости при записи
+
+    QByteArray          _buffer;                                  // блок аудио-данных для воспроизведения (последняя завершённая запись или setBuffer())
+    qint64              _maxBufferLength;                         // ёмкость кольцевого буфера записи
+    qint64              _dataLength;                              // размер данных в _buffer
 
     int                 _levelBufferLength;                       // ширина кадра на котором рассчитывается уровень громкости
     qreal               _rmsLevel;                                // текущая громкость (от 0.0 до 1.0)
@@ -310,6 +356,12 @@ private:
     QDir                _outputDir;
 #endif
 
+#ifdef BENCHMARK_ENGINE
+    int                 _benchmarkNotifies;                       // количество уведомлений в текущем окне замера
+    qint64              _benchmarkTotalNs;                        // суммарное время доставки данных в окне
+    qint64              _benchmarkMaxNs;                          // максимальное время доставки данных в окне
+#endif
+
 };
 
 #endif // ENGINE_H
@@ -0,0 +1,250 @@
+/****************************************************************************
+**
+** Метрики задержек конвейера "микрофон - гипотеза"
+**
+****************************************************************************/
+
+#include <QDateTime>
+#include <QFile>
+#include <QTextStream>
+#include <QtAlgorithms>
+#include "metrics.h"
+// BUILD_ID; заголовок создаётся при сборке, см. buildid.pri
+#include "buildid.h"
+
+#ifdef Q_OS_WIN
+#   include <windows.h>
+#else
+#   include <time.h>
+#endif
+
+namespace {
+
+QElapsedTimer startedTimer()
+{
+  QElapsedTimer timer;
+  timer.start();
+  return timer;
+}
+
+} // namespace
+
+// LatencyHistogram
+
+LatencyHistogram::LatencyHistogram(const QString &name)
+  : _name(name)
+{
+  reset();
+}
+
+int LatencyHistogram::bucketOf(quint64 ns)
+{
+  // до SubBuckets нс - точные значения, дальше на каждую октаву
+  // [2^e, 2^(e+1)) приходится SubBuckets равных интервалов
+  if (ns < quint64(SubBuckets))
+    return int(ns);
+  const int exponent = 63 - qCountLeadingZeroBits(ns);
+  const int mantissa = int(ns >> (exponent - 4));  // 16..31
+  const int bucket = (exponent - 3) * SubBuckets + mantissa - SubBuckets;
+  return qMin(bucket, Buckets - 1);
+}
+
+qint64 LatencyHistogram::bucketUpperBound(int bucket)
+{
+  if (bucket < SubBuckets)
+    return bucket;
+  const int exponent = bucket / SubBuckets + 3;
+  const qint64 mantissa = bucket % SubBuckets + SubBuckets;
+  return ((mantissa + 1) << (exponent - 4)) - 1;
+}
+
+void LatencyHistogram::record(qint64 ns)
+{
+  const quint64 value = quint64(qMax(qint64(0), ns));
+  _counts[bucketOf(value)].fetchAndAddRelaxed(1);
+  _count.fetchAndAddRelaxed(1);
+  _total.fetchAndAddRelaxed(value);
+  quint64 max = _max.loadAcquire();
+  while (value > max && !_max.testAndSetOrdered(max, value, max)) {}
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() const
+{
+  Summary summary;
+  summary.count = _count.loadAcquire();
+  summary.max = qint64(_max.loadAcquire());
+  summary.mean = summary.count ? qint64(_total.loadAcquire() / summary.count) : 0;
+  summary.p50 = summary.p95 = summary.p99 = 0;
+  if (!summary.count)
+    return summary;
+
+  // счётчики читаются без блокировки, их сумма может немного отличаться от count
+  quint64 counts[Buckets];
+  quint64 total = 0;
+  for (int i = 0; i < Buckets; ++i) {
+    counts[i] = _counts[i].loadAcquire();
+    total += counts[i];
+  }
+
+  const quint64 rank50 = (total * 50 + 99) / 100;
+  const quint64 rank95 = (total * 95 + 99) / 100;
+  const quint64 rank99 = (total * 99 + 99) / 100;
+  quint64 cumulative = 0;
+  for (int i = 0; i < Buckets; ++i) {
+    if (!counts[i])
+      continue;
+    const quint64 before = cumulative;
+    cumulative += counts[i];
+    const qint64 bound = qMin(bucketUpperBound(i), summary.max);
+    if (before < rank50 && cumulative >= rank50) summary.p50 = bound;
+    if (before < rank95 && cumulative >= rank95) summary.p95 = bound;
+    if (before < rank99 && cumulative >= rank99) summary.p99 = bound;
+  }
+  return summary;
+}
+
+void LatencyHistogram::reset()
+{
+  for (int i = 0; i < Buckets; ++i)
+    _counts[i].storeRelease(0);
+  _count.storeRelease(0);
+  _total.storeRelease(0);
+  _max.storeRelease(0);
+}
+
+// Metrics
+
+Metrics::Metrics()
+  : _dumpThread(this)
+  , _dumpIntervalMs(0)
+  , _dumpStop(false)
+{
+}
+
+Metrics::~Metrics()
+{
+  stopDump();
+  qDeleteAll(_histograms);
+}
+
+Metrics &Metrics::instance()
+{
+  static Metrics metrics;
+  return metrics;
+}
+
+qint64 Metrics::now()
+{
+  static const QElapsedTimer timer = startedTimer();
+  return timer.nsecsElapsed();
+}
+
+qint64 Metrics::threadCpuTime()
+{
+#ifdef Q_OS_WIN
+  FILETIME created, exited, kernel, user;
+  if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+    return 0;
+  // интервалы по 100 нс
+  const quint64 kernelTicks = (quint64(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+  const quint64 userTicks = (quint64(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+  return qint64(kernelTicks + userTicks) * 100;
+#else
+  timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    return 0;
+  return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+LatencyHistogram *Metrics::histogram(const QString &name)
+{
+  QMutexLocker locker(&_mutex);
+  foreach (LatencyHistogram *histogram, _histograms)
+    if (histogram->name() == name)
+      return histogram;
+  LatencyHistogram *histogram = new LatencyHistogram(name);
+  _histograms.append(histogram);
+  return histogram;
+}
+
+QString Metrics::report() const
+{
+  QList<LatencyHistogram*> histograms;
+  {
+    QMutexLocker locker(&_mutex);
+    histograms = _histograms;
+  }
+
+  QString result;
+  QTextStream stream(&result);
+  stream << qSetFieldWidth(28) << left << "stage" << qSetFieldWidth(12) << right
+         << "count" << "p50,us" << "p95,us" << "p99,us" << "max,us" << qSetFieldWidth(0) << '\n';
+  foreach (const LatencyHistogram *histogram, histograms) {
+    const LatencyHistogram::Summary summary = histogram->summary();
+    stream << qSetFieldWidth(28) << left << histogram->name() << qSetFieldWidth(12) << right
+           << summary.count << summary.p50 / 1000 << summary.p95 / 1000
+           << summary.p99 / 1000 << summary.max / 1000 << qSetFieldWidth(0) << '\n';
+  }
+  stream.flush();
+  return result;
+}
+
+void Metrics::reset()
+{
+  QMutexLocker locker(&_mutex);
+  foreach (LatencyHistogram *histogram, _histograms)
+    histogram->reset();
+}
+
+void Metrics::startDump(const QString &path, int intervalMs)
+{
+  stopDump();
+  {
+    QMutexLocker locker(&_mutex);
+    _dumpPath = path;
+    _dumpIntervalMs = qMax(intervalMs, 100);
+    _dumpStop = false;
+  }
+  _dumpThread.start(QThread::LowPriority);
+}
+
+void Metrics::stopDump()
+{
+  {
+    QMutexLocker locker(&_mutex);
+    _dumpStop = true;
+    _dumpCondition.wakeAll();
+  }
+  _dumpThread.wait();
+}
+
+bool Metrics::appendReport()
+{
+  QString path;
+  {
+    QMutexLocker locker(&_mutex);
+    path = _dumpPath;
+  }
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+    return false;
+  QTextStream stream(&file);
+  // сборка в заголовке - для сравнения задержек между версиями
+  stream << "# " << QDateTime::currentDateTime().toString(Qt::ISODate)
+         << " uptime, s: " << now() / 1000000000
+         << " build: " << BUILD_ID << '\n'
+         << report() << '\n';
+  return true;
+}
+
+void Metrics::DumpThread::run()
+{
+  QMutexLocker locker(&_self->_mutex);
+  while (!_self->_dumpStop) {
+    _self->_dumpCondition.wait(&_self->_mutex, _self->_dumpIntervalMs);
+    locker.unlock();
+    _self->appendReport();
+    locker.relock();
+  }
+}
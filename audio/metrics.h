@@ -0,0 +1,162 @@
+/****************************************************************************
+**
+** Метрики задержек конвейера "микрофон - гипотеза"
+**
+** Каждый этап (чтение устройства, выдача блоков, выделение фрагментов,
+** очередь распознавания, декодер) записывает длительности в свою
+** гистограмму реестра. Гистограммы лог-линейные (16 интервалов на
+** октаву, погрешность не более 6%), запись - несколько атомарных
+** операций без блокировок, поэтому точки замера можно ставить в
+** потоке записи. Реестр выдаёт p50/p95/p99 по всем этапам и может
+** периодически дописывать их в файл, чтобы сравнивать сборки.
+**
+****************************************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+/**
+ * @brief Гистограмма длительностей, нс
+ */
+class LatencyHistogram
+{
+public:
+  /**
+   * @brief Сводка гистограммы
+   */
+  struct Summary
+  {
+    quint64 count;
+    qint64  mean;
+    qint64  p50;
+    qint64  p95;
+    qint64  p99;
+    qint64  max;
+  };
+
+  explicit LatencyHistogram(const QString &name);
+
+  const QString &name() const { return _name; }
+
+  /**
+   * @brief Записать длительность, нс (отрицательные считаются нулём)
+   */
+  void record(qint64 ns);
+
+  /**
+   * @brief Сводка по всем записям с начала работы или reset()
+   */
+  Summary summary() const;
+
+  void reset();
+
+private:
+  static const int SubBuckets = 16;
+  static const int Buckets = 40 * SubBuckets;  // до 2^40 нс (около 18 минут)
+
+  static int bucketOf(quint64 ns);
+  static qint64 bucketUpperBound(int bucket);
+
+  const QString _name;
+  QAtomicInteger<quint32> _counts[Buckets];
+  QAtomicInteger<quint64> _count;
+  QAtomicInteger<quint64> _total;
+  QAtomicInteger<quint64> _max;
+};
+
+/**
+ * @brief Реестр гистограмм процесса
+ */
+class Metrics
+{
+public:
+  static Metrics &instance();
+
+  /**
+   * @brief Монотонное время с запуска процесса, нс
+   */
+  static qint64 now();
+
+  /**
+   * @brief Процессорное время вызывающего потока, нс
+   * (CLOCK_THREAD_CPUTIME_ID; в Windows - GetThreadTimes)
+   */
+  static qint64 threadCpuTime();
+
+  /**
+   * @brief Гистограмма этапа; создаётся при первом обращении и живёт до
+   * конца процесса, поэтому указатель можно хранить в статической переменной
+   */
+  LatencyHistogram *histogram(const QString &name);
+
+  /**
+   * @brief Таблица p50/p95/p99 всех этапов, мкс
+   */
+  QString report() const;
+
+  void reset();
+
+  /**
+   * @brief Дописывать report() в файл каждые intervalMs (в отдельном потоке)
+   */
+  void startDump(const QString &path, int intervalMs);
+  void stopDump();
+
+private:
+  /**
+   * @brief Поток периодической записи
+   */
+  class DumpThread : public QThread
+  {
+  public:
+    DumpThread(Metrics *metrics) : _self(metrics) {}
+    void run();
+  protected:
+    Metrics *_self;
+  };
+
+  Metrics();
+  ~Metrics();
+
+  bool appendReport();
+
+  mutable QMutex _mutex;  // защищает _histograms и параметры записи
+  QList<LatencyHistogram*> _histograms;
+
+  DumpThread _dumpThread;
+  QWaitCondition _dumpCondition;
+  QString _dumpPath;
+  int _dumpIntervalMs;
+  bool _dumpStop;
+};
+
+/**
+ * @brief Замер длительности участка кода до выхода из области видимости
+ */
+class LatencyTimer
+{
+public:
+  explicit LatencyTimer(LatencyHistogram *histogram)
+    : _histogram(histogram), _start(Metrics::now())
+  {
+  }
+
+  ~LatencyTimer()
+  {
+    _histogram->record(Metrics::now() - _start);
+  }
+
+private:
+  LatencyHistogram *_histogram;
+  qint64 _start;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,137 @@
+/****************************************************************************
+**
+** Пирамида пиков (min/max) для отображения осциллограммы
+**
+****************************************************************************/
+
+#include "peakpyramid.h"
+
+namespace {
+
+// Пустой участок: объединение с ним не меняет min/max
+inline PeakPyramid::Peak emptyPeak()
+{
+  PeakPyramid::Peak peak;
+  peak.min = 32767;
+  peak.max = -32768;
+  return peak;
+}
+
+inline void combine(PeakPyramid::Peak &result, const PeakPyramid::Peak &peak)
+{
+  result.min = qMin(result.min, peak.min);
+  result.max = qMax(result.max, peak.max);
+}
+
+// Интервалы верхнего уровня: граница хранимых данных кратна этому числу
+// интервалов уровня 0, чтобы интервалы всех уровней были выровнены
+const qint64 TopBuckets = qint64(1) << (PeakPyramid::Levels - 1);
+
+} // namespace
+
+PeakPyramid::PeakPyramid()
+  : _channels(1)
+  , _baseBucket(0)
+  , _end(0)
+  , _pending(emptyPeak())
+  , _pendingFrames(0)
+{
+}
+
+void PeakPyramid::reset(qint64 startFrame, int channels)
+{
+  for (int level = 0; level < Levels; ++level)
+    _levels[level].clear();
+  _channels = qMax(channels, 1);
+
+  const qint64 startBucket = startFrame / BucketFrames;
+  _baseBucket = startBucket - startBucket % TopBuckets;
+  for (qint64 bucket = _baseBucket; bucket < startBucket; ++bucket)
+    push(0, emptyPeak());
+  _pending = emptyPeak();
+  _pendingFrames = int(startFrame % BucketFrames);
+  _end = startFrame;
+}
+
+void PeakPyramid::append(const qint16 *frames, qint64 count)
+{
+  const qint16 *ptr = frames;
+  qint64 remaining = count;
+  while (remaining > 0) {
+    const int n = int(qMin(remaining, qint64(BucketFrames - _pendingFrames)));
+    for (int i = 0; i < n; ++i, ptr += _channels) {
+      _pending.min = qMin(_pending.min, *ptr);
+      _pending.max = qMax(_pending.max, *ptr);
+    }
+    _pendingFrames += n;
+    remaining -= n;
+    if (_pendingFrames == BucketFrames) {
+      push(0, _pending);
+      _pending = emptyPeak();
+      _pendingFrames = 0;
+    }
+  }
+  _end += count;
+}
+
+void PeakPyramid::discardBefore(qint64 frame)
+{
+  const qint64 bucket = qMin(frame, _end) / BucketFrames;
+  const qint64 base = bucket - bucket % TopBuckets;
+  // данные сдвигаются, только когда освобождается не меньше половины
+  const qint64 discarded = base - _baseBucket;
+  if (discarded <= 0 || discarded < _levels[0].size() / 2)
+    return;
+  for (int level = 0; level < Levels; ++level) {
+    QVector<Peak> &peaks = _levels[level];
+    peaks.remove(0, int(qMin(discarded >> level, qint64(peaks.size()))));
+  }
+  _baseBucket = base;
+}
+
+void PeakPyramid::columns(qint64 from, qint64 to, Peak *out, int count) const
+{
+  const qint64 length = to - from;
+  for (int column = 0; column < count; ++column) {
+    const qint64 columnStart = from + length * column / count;
+    const qint64 columnEnd = qMax(columnStart + 1, from + length * (column + 1) / count);
+    Peak &result = out[column];
+    if (!peak(columnStart / BucketFrames, (columnEnd - 1) / BucketFrames, result))
+      result.min = result.max = 0;
+  }
+}
+
+void PeakPyramid::push(int level, const Peak &peak)
+{
+  QVector<Peak> &peaks = _levels[level];
+  peaks.append(peak);
+  // завершена пара - интервал следующего уровня
+  const qint64 index = (_baseBucket >> level) + peaks.size() - 1;
+  if ((index & 1) && level + 1 < Levels && peaks.size() >= 2) {
+    Peak parent = peaks.at(peaks.size() - 2);
+    combine(parent, peak);
+    push(level + 1, parent);
+  }
+}
+
+bool PeakPyramid::peak(qint64 firstBucket, qint64 lastBucket, Peak &result) const
+{
+  result = emptyPeak();
+  const qint64 complete = _baseBucket + _levels[0].size();
+  const qint64 stop = qMin(lastBucket + 1, complete);
+  qint64 bucket = qMax(firstBucket, _baseBucket);
+
+  // самые крупные выровненные интервалы, целиком лежащие в участке
+  while (bucket < stop) {
+    int level = 0;
+    while (level + 1 < Levels
+           && (bucket & ((qint64(2) << level) - 1)) == 0
+           && bucket + (qint64(2) << level) <= stop)
+      ++level;
+    combine(result, _levels[level].at(int((bucket >> level) - (_baseBucket >> level))));
+    bucket += qint64(1) << level;
+  }
+  if (firstBucket <= complete && lastBucket >= complete && _pendingFrames > 0)
+    combine(result, _pending);
+  return result.min <= result.max;
+}
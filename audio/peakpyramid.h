@@ -0,0 +1,81 @@
+/****************************************************************************
+**
+** Пирамида пиков (min/max) для отображения осциллограммы
+**
+** Уровень 0 хранит min/max каждых BucketFrames кадров, уровень k - пар
+** интервалов уровня k-1. Данные добавляются по мере записи; min/max
+** любого участка собирается из O(log n) интервалов разных уровней, поэтому
+** стоимость отрисовки зависит от количества столбцов, а не от частоты
+** дискретизации. Используется первый канал.
+**
+****************************************************************************/
+
+#ifndef PEAKPYRAMID_H
+#define PEAKPYRAMID_H
+
+#include <QVector>
+#include <QtGlobal>
+
+class PeakPyramid
+{
+public:
+  /**
+   * @brief Минимум и максимум участка
+   */
+  struct Peak
+  {
+    qint16 min;
+    qint16 max;
+  };
+
+  static const int BucketFrames = 8;  // кадров в интервале уровня 0
+  static const int Levels = 16;
+
+  PeakPyramid();
+
+  /**
+   * @brief Очистить; следующие данные начинаются с кадра startFrame
+   * @param channels [вх] каналов в кадре
+   */
+  void reset(qint64 startFrame, int channels);
+
+  /**
+   * @brief Добавить count кадров (чередующиеся каналы)
+   */
+  void append(const qint16 *frames, qint64 count);
+
+  /**
+   * @brief Первый хранимый кадр
+   */
+  qint64 start() const { return _baseBucket * BucketFrames; }
+
+  /**
+   * @brief Кадр за последним добавленным
+   */
+  qint64 end() const { return _end; }
+
+  /**
+   * @brief Освободить данные до кадра frame (с точностью до интервала
+   * верхнего уровня)
+   */
+  void discardBefore(qint64 frame);
+
+  /**
+   * @brief Разбить [from, to) на count равных столбцов и получить min/max
+   * каждого; столбцы вне хранимых данных - {0, 0}
+   */
+  void columns(qint64 from, qint64 to, Peak *out, int count) const;
+
+private:
+  void push(int level, const Peak &peak);
+  bool peak(qint64 firstBucket, qint64 lastBucket, Peak &result) const;
+
+  int _channels;
+  qint64 _baseBucket;                // абсолютный номер первого интервала уровня 0
+  qint64 _end;
+  QVector<Peak> _levels[Levels];     // завершённые интервалы уровней
+  Peak _pending;                     // незавершённый интервал уровня 0
+  int _pendingFrames;
+};
+
+#endif // PEAKPYRAMID_H
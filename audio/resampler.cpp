@@ -0,0 +1,156 @@
+/****************************************************************************
+**
+** Потоковое преобразование частоты дискретизации
+**
+****************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include "resampler.h"
+#include "samplekernels.h"
+
+namespace {
+
+const double Pi = 3.14159265358979323846;
+
+// Пересечений нуля sinc с каждой стороны (на меньшей из частот)
+const int ZeroCrossings = 12;
+// Срез относительно половины меньшей частоты
+const double Rolloff = 0.9;
+// Окно Кайзера: подавление вне полосы около 80 дБ
+const double KaiserBeta = 8.0;
+
+int gcd(int a, int b)
+{
+  while (b) {
+    const int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Модифицированная функция Бесселя нулевого порядка
+double besselI0(double x)
+{
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 50 && term > 1e-12 * sum; ++k) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+} // namespace
+
+Resampler::Resampler(int inputRate, int outputRate)
+  : _inputRate(qMax(inputRate, 1))
+  , _outputRate(qMax(outputRate, 1))
+  , _taps(1)
+  , _index(0)
+  , _phase(0)
+{
+  const int divisor = gcd(_inputRate, _outputRate);
+  _up = _outputRate / divisor;
+  _down = _inputRate / divisor;
+  if (!isPassThrough())
+    design();
+  reset();
+}
+
+void Resampler::reset()
+{
+  // нулевая предыстория: первый выход не ждёт taps() входных семплов
+  _history.fill(0, _taps - 1);
+  _index = _taps - 1;
+  _phase = 0;
+}
+
+int Resampler::outputCapacity(int count) const
+{
+  if (isPassThrough())
+    return count;
+  const qint64 available = qint64(_history.size() - _index + count) * _up;
+  return int(available / _down) + 1;
+}
+
+int Resampler::process(const qint16 *input, int count, qint16 *output)
+{
+  if (isPassThrough()) {
+    memcpy(output, input, count * sizeof(qint16));
+    return count;
+  }
+
+  const int start = _history.size();
+  _history.resize(start + count);
+  memcpy(_history.data() + start, input, count * sizeof(qint16));
+
+  // выход y[k] в момент k * down / up входа: фаза (k * down) % up,
+  // последний входной семпл - (k * down) / up
+  const qint16 *history = _history.constData();
+  const qint16 *coefficients = _coefficients.constData();
+  int produced = 0;
+  while (_index < _history.size()) {
+    const qint32 sum = dotProductSamples(history + _index - _taps + 1, coefficients + _phase * _taps, _taps);
+    output[produced++] = qint16(qBound(-32768, (sum + (1 << 14)) >> 15, 32767));
+    _phase += _down;
+    _index += _phase / _up;
+    _phase %= _up;
+  }
+
+  // остаётся хвост для следующих выходов
+  const int consumed = qMin(_index - _taps + 1, _history.size());
+  if (consumed > 0) {
+    _history.remove(0, consumed);
+    _index -= consumed;
+  }
+  return produced;
+}
+
+QByteArray Resampler::process(const QByteArray &input)
+{
+  if (isPassThrough())
+    return input;
+  const int count = input.size() / int(sizeof(qint16));
+  QByteArray output(outputCapacity(count) * int(sizeof(qint16)), Qt::Uninitialized);
+  const int produced = process(reinterpret_cast<const qint16 *>(input.constData()), count,
+                               reinterpret_cast<qint16 *>(output.data()));
+  output.resize(produced * int(sizeof(qint16)));
+  return output;
+}
+
+void Resampler::design()
+{
+  // прототип на частоте input * up: срез - у меньшей из частот
+  const int factor = qMax(_up, _down);
+  const double cutoff = 0.5 * Rolloff / factor;
+  _taps = int(ceil(2.0 * ZeroCrossings * qMax(1.0, double(_down) / _up) / Rolloff));
+  _taps = (_taps + 7) & ~7;  // кратно ширине векторов
+  const int length = _taps * _up;
+  const double center = (length - 1) / 2.0;
+  const double window = besselI0(KaiserBeta);
+
+  QVector<double> prototype(length);
+  for (int n = 0; n < length; ++n) {
+    const double t = n - center;
+    const double x = 2.0 * cutoff * t;
+    const double sinc = fabs(x) < 1e-12 ? 1.0 : sin(Pi * x) / (Pi * x);
+    const double r = t / (center + 1.0);
+    prototype[n] = 2.0 * cutoff * sinc * besselI0(KaiserBeta * sqrt(qMax(0.0, 1.0 - r * r))) / window;
+  }
+
+  // фаза p: h[p + j * up] умножается на семпл index - j; коэффициенты
+  // фазы хранятся в порядке семплов (j от taps - 1 до 0), сумма фазы - 1
+  _coefficients.resize(_up * _taps);
+  for (int phase = 0; phase < _up; ++phase) {
+    double sum = 0.0;
+    for (int j = 0; j < _taps; ++j)
+      sum += prototype[phase + j * _up];
+    qint16 *coefficients = _coefficients.data() + phase * _taps;
+    for (int j = 0; j < _taps; ++j) {
+      const double value = sum != 0.0 ? prototype[phase + j * _up] / sum : 0.0;
+      coefficients[_taps - 1 - j] = qint16(qBound(-32767.0, floor(value * 32768.0 + 0.5), 32767.0));
+    }
+  }
+}
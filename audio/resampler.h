@@ -0,0 +1,81 @@
+/****************************************************************************
+**
+** Потоковое преобразование частоты дискретизации
+**
+** Многофазный КИХ-фильтр: частоты сводятся к отношению up / down
+** (44100 -> 8000 = 80 / 441), прототип - sinc с окном Кайзера, срез чуть
+** ниже половины меньшей из частот. Каждый выходной семпл - скалярное
+** произведение taps() входных семплов на коэффициенты своей фазы
+** (dotProductSamples, 16-битные коэффициенты, целочисленное накопление).
+**
+** Данные обрабатываются блоками любого размера; между блоками хранится
+** только хвост из taps() - 1 входных семплов, поэтому задержка - около
+** taps() / 2 входных семплов (около 2 мс для 48000 -> 8000).
+** При равных частотах данные передаются без изменений.
+**
+****************************************************************************/
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QtGlobal>
+
+class Resampler
+{
+public:
+  /**
+   * @param inputRate  [вх] частота входа, Гц
+   * @param outputRate [вх] частота выхода, Гц
+   */
+  Resampler(int inputRate, int outputRate);
+
+  int inputRate() const { return _inputRate; }
+  int outputRate() const { return _outputRate; }
+  bool isPassThrough() const { return _up == _down; }
+
+  /**
+   * @brief Длина фильтра одной фазы, входных семплов
+   */
+  int taps() const { return _taps; }
+
+  /**
+   * @brief Начать новый поток (забыть хвост предыдущего)
+   */
+  void reset();
+
+  /**
+   * @brief Наибольшее число выходных семплов для count входных
+   */
+  int outputCapacity(int count) const;
+
+  /**
+   * @brief Преобразовать очередной блок (16 бит, моно)
+   * @param input  [вх] семплы
+   * @param count  [вх] количество семплов
+   * @param output [вых] не меньше outputCapacity(count) семплов
+   * @return количество выходных семплов
+   */
+  int process(const qint16 *input, int count, qint16 *output);
+
+  /**
+   * @brief Преобразовать очередной блок PCM
+   */
+  QByteArray process(const QByteArray &input);
+
+private:
+  void design();
+
+  int _inputRate;
+  int _outputRate;
+  int _up;                        // выход: _up / _down входа
+  int _down;
+  int _taps;
+  QVector<qint16> _coefficients;  // _up фаз по _taps, в порядке входных семплов
+  QVector<qint16> _history;       // хвост предыдущих блоков и текущий блок
+  int _index;                     // последний входной семпл следующего выхода в _history
+  int _phase;                     // фаза следующего выхода (0.._up-1)
+};
+
+#endif // RESAMPLER_H
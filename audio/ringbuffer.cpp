@@ -0,0 +1,205 @@
+/****************************************************************************
+**
+** Кольцевой буфер аудио-данных
+**
+****************************************************************************/
+
+#include <string.h>
+#include "ringbuffer.h"
+
+// RingBuffer::Reader
+
+RingBuffer::Reader::Reader()
+  : _ring(nullptr)
+  , _position(0)
+  , _lost(0)
+{
+}
+
+RingBuffer::Reader::Reader(const RingBuffer *ring, qint64 position)
+  : _ring(ring)
+  , _position(position)
+  , _lost(0)
+{
+}
+
+void RingBuffer::Reader::seek(qint64 position)
+{
+  if (!_ring) return;
+  _position = qBound(_ring->tailPosition(), position, _ring->writePosition());
+}
+
+qint64 RingBuffer::Reader::available() const
+{
+  if (!_ring) return 0;
+  const qint64 writePosition = _ring->writePosition();
+  const qint64 start = qMax(_position, _ring->tailPosition());
+  return qMax(qint64(0), writePosition - start);
+}
+
+qint64 RingBuffer::Reader::read(char *data, qint64 maxLength)
+{
+  if (!_ring) return 0;
+
+  // буфер был очищен - продолжаем с начала
+  if (_position > _ring->writePosition())
+    _position = _ring->writePosition();
+
+  qint64 position = _position;
+  const qint64 bytesRead = _ring->peek(position, data, maxLength);
+  _lost += position - _position;
+  _position = position + bytesRead;
+  return bytesRead;
+}
+
+QByteArray RingBuffer::Reader::readAll()
+{
+  QByteArray result;
+  const qint64 length = available();
+  if (length <= 0) return result;
+  result.resize(length);
+  result.resize(read(result.data(), length));
+  return result;
+}
+
+qint64 RingBuffer::Reader::peek(qint64 &position, char *data, qint64 length) const
+{
+  if (!_ring) return 0;
+  return _ring->peek(position, data, length);
+}
+
+// RingBuffer
+
+RingBuffer::RingBuffer(qint64 capacity)
+  : _capacity(0)
+  , _writePosition(0)
+  , _reservePosition(0)
+{
+  reset(capacity);
+}
+
+void RingBuffer::reset(qint64 capacity, int alignment)
+{
+  qint64 size = qMax(qint64(0), capacity);
+  if (alignment > 1 && size % alignment)
+    size += alignment - size % alignment;
+  _data.resize(size);
+  _data.fill(0);
+  _capacity = size;
+  clear();
+}
+
+void RingBuffer::clear()
+{
+  _reservePosition.storeRelease(0);
+  _writePosition.storeRelease(0);
+}
+
+qint64 RingBuffer::tailPosition() const
+{
+  return qMax(qint64(0), writePosition() - _capacity);
+}
+
+char *RingBuffer::writeRegion(qint64 *length)
+{
+  if (!_capacity) {
+    *length = 0;
+    return nullptr;
+  }
+  const qint64 writePosition = _writePosition.loadAcquire();
+  const qint64 offset = writePosition % _capacity;
+  *length = qMin(*length, _capacity - offset);
+  // сначала объявляем участок занятым, чтобы читатели могли
+  // обнаружить, что данные под ним перезаписываются
+  _reservePosition.storeRelease(writePosition + *length);
+  return _data.data() + offset;
+}
+
+void RingBuffer::commit(qint64 length)
+{
+  const qint64 writePosition = _writePosition.loadAcquire() + length;
+  _writePosition.storeRelease(writePosition);
+  _reservePosition.storeRelease(writePosition);
+}
+
+void RingBuffer::write(const char *data, qint64 length)
+{
+  // данные длиннее буфера: сохраняем только хвост
+  if (length > _capacity) {
+    const qint64 skip = length - _capacity;
+    const qint64 writePosition = _writePosition.loadAcquire() + skip;
+    _reservePosition.storeRelease(writePosition);
+    _writePosition.storeRelease(writePosition);
+    data += skip;
+    length = _capacity;
+  }
+
+  while (length > 0) {
+    qint64 region = length;
+    char *ptr = writeRegion(&region);
+    if (!region) break;
+    memcpy(ptr, data, region);
+    commit(region);
+    data += region;
+    length -= region;
+  }
+}
+
+void RingBuffer::copyOut(qint64 position, char *data, qint64 length) const
+{
+  const qint64 offset = position % _capacity;
+  const qint64 first = qMin(length, _capacity - offset);
+  memcpy(data, _data.constData() + offset, first);
+  if (first < length)
+    memcpy(data + first, _data.constData(), length - first);
+}
+
+qint64 RingBuffer::peek(qint64 &position, char *data, qint64 length) const
+{
+  if (!_capacity || length <= 0) return 0;
+
+  forever {
+    const qint64 writePosition = _writePosition.loadAcquire();
+    position = qMax(position, writePosition - _capacity);
+    position = qMax(position, qint64(0));
+    const qint64 count = qMin(length, writePosition - position);
+    if (count <= 0) return 0;
+
+    copyOut(position, data, count);
+
+    // писатель мог успеть перезаписать начало скопированного участка
+    const qint64 oldest = _reservePosition.loadAcquire() - _capacity;
+    if (oldest <= position)
+      return count;
+    position = oldest;
+  }
+}
+
+QByteArray RingBuffer::peek(qint64 position, qint64 length) const
+{
+  QByteArray result;
+  if (length <= 0) return result;
+  result.resize(length);
+  result.resize(peek(position, result.data(), length));
+  return result;
+}
+
+const char *RingBuffer::readRegion(qint64 position, qint64 *length) const
+{
+  const qint64 writePosition = this->writePosition();
+  if (!_capacity || position < writePosition - _capacity || position >= writePosition) {
+    *length = 0;
+    return nullptr;
+  }
+  const qint64 offset = position % _capacity;
+  *length = qMin(qMin(*length, writePosition - position), _capacity - offset);
+  return _data.constData() + offset;
+}
+
+RingBuffer::Reader RingBuffer::reader(qint64 position) const
+{
+  const qint64 writePosition = this->writePosition();
+  if (position < 0 || position > writePosition)
+    position = writePosition;
+  return Reader(this, qMax(position, tailPosition()));
+}
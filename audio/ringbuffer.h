@@ -0,0 +1,167 @@
+/****************************************************************************
+**
+** Кольцевой буфер аудио-данных
+**
+** Один писатель (устройство записи) и произвольное число читателей.
+** Позиции во всех методах абсолютные: количество байт, записанных
+** с момента последнего reset()/clear(), поэтому они не "заворачиваются"
+** и могут использоваться как время записи. Писатель никогда не ждёт
+** читателей: если читатель отстал больше, чем на ёмкость буфера, он
+** перескакивает на самые старые сохранившиеся данные, а пропущенный
+** объём учитывается в lostBytes().
+**
+****************************************************************************/
+
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+
+class RingBuffer
+{
+public:
+  /**
+   * @brief Курсор чтения из кольцевого буфера
+   */
+  class Reader
+  {
+  public:
+    Reader();
+
+    bool isValid() const { return _ring != nullptr; }
+
+    /**
+     * @brief Абсолютная позиция следующего читаемого байта
+     */
+    qint64 position() const { return _position; }
+
+    /**
+     * @brief Переместить курсор (позиция ограничивается сохранившимися данными)
+     */
+    void seek(qint64 position);
+
+    /**
+     * @brief Количество байт, доступных для чтения
+     */
+    qint64 available() const;
+
+    /**
+     * @brief Прочитать до maxLength байт и сдвинуть курсор
+     * @return количество прочитанных байт
+     */
+    qint64 read(char *data, qint64 maxLength);
+
+    /**
+     * @brief Прочитать все доступные данные
+     */
+    QByteArray readAll();
+
+    /**
+     * @brief Прочитать данные с произвольной позиции, не сдвигая курсор
+     * @see RingBuffer::peek
+     */
+    qint64 peek(qint64 &position, char *data, qint64 length) const;
+
+    /**
+     * @brief Объём данных, перезаписанных до того, как курсор их прочитал
+     */
+    qint64 lostBytes() const { return _lost; }
+
+    const RingBuffer *ring() const { return _ring; }
+
+  private:
+    friend class RingBuffer;
+    Reader(const RingBuffer *ring, qint64 position);
+
+    const RingBuffer *_ring;
+    qint64            _position;
+    qint64            _lost;
+  };
+
+public:
+  explicit RingBuffer(qint64 capacity = 0);
+
+  /**
+   * @brief Выделить память и очистить буфер
+   * @param capacity  [вх] ёмкость в байтах
+   * @param alignment [вх] ёмкость округляется вверх до кратной alignment
+   *                  (размер кадра), чтобы кадр не разрывался на границе
+   * @note Существующие курсоры после вызова нужно пересоздать
+   */
+  void reset(qint64 capacity, int alignment = 1);
+
+  /**
+   * @brief Очистить буфер, сохранив ёмкость
+   */
+  void clear();
+
+  qint64 capacity() const { return _capacity; }
+
+  /**
+   * @brief Абсолютная позиция записи (всего записано байт)
+   */
+  qint64 writePosition() const { return _writePosition.loadAcquire(); }
+
+  /**
+   * @brief Абсолютная позиция самого старого сохранившегося байта
+   */
+  qint64 tailPosition() const;
+
+  /**
+   * @brief Получить непрерывный участок памяти для записи
+   * @param length [вх/вых] желаемый размер / размер участка (не больше
+   *               расстояния до конца памяти буфера)
+   * @return указатель на участок; данные становятся видимы читателям
+   *         только после commit()
+   */
+  char *writeRegion(qint64 *length);
+
+  /**
+   * @brief Опубликовать length байт, записанных в участок от writeRegion()
+   */
+  void commit(qint64 length);
+
+  /**
+   * @brief Записать данные (с копированием)
+   */
+  void write(const char *data, qint64 length);
+
+  /**
+   * @brief Скопировать данные, начиная с абсолютной позиции
+   * @param position [вх/вых] позиция начала; если данные по ней уже
+   *                 перезаписаны, сдвигается на самые старые сохранившиеся
+   * @param data     [вых] приёмник
+   * @param length   [вх] максимальное количество байт
+   * @return количество скопированных байт
+   */
+  qint64 peek(qint64 &position, char *data, qint64 length) const;
+  QByteArray peek(qint64 position, qint64 length) const;
+
+  /**
+   * @brief Получить непрерывный участок сохранившихся данных без копирования
+   * @param position [вх] абсолютная позиция начала (не раньше tailPosition())
+   * @param length   [вх/вых] желаемый размер / размер участка (не больше
+   *                 расстояния до конца памяти буфера)
+   * @return указатель на данные; они остаются действительными, пока
+   *         писатель не пройдёт ещё capacity() байт
+   */
+  const char *readRegion(qint64 position, qint64 *length) const;
+
+  /**
+   * @brief Создать курсор чтения
+   * @param position [вх] начальная позиция, -1 - текущая позиция записи
+   */
+  Reader reader(qint64 position = -1) const;
+
+private:
+  void copyOut(qint64 position, char *data, qint64 length) const;
+
+private:
+  QByteArray              _data;           // память буфера
+  qint64                  _capacity;       // ёмкость
+  QAtomicInteger<qint64>  _writePosition;  // опубликованная позиция записи
+  QAtomicInteger<qint64>  _reservePosition;// граница участка, в который идёт запись
+};
+
+#endif // RINGBUFFER_H
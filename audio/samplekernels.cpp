@@ -0,0 +1,405 @@
+/****************************************************************************
+**
+** Векторные функции обработки 16-битных семплов
+**
+****************************************************************************/
+
+#include <QtAlgorithms>
+#include "samplekernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define SAMPLEKERNELS_SSE2
+#  include <emmintrin.h>
+#  if defined(__GNUC__) || defined(_MSC_VER)
+#    define SAMPLEKERNELS_AVX2
+#    include <immintrin.h>
+#  endif
+#endif
+
+#if defined(_MSC_VER) && defined(SAMPLEKERNELS_AVX2)
+#  include <intrin.h>
+#endif
+
+#if defined(__GNUC__)
+#  define SAMPLEKERNELS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#  define SAMPLEKERNELS_TARGET_AVX2
+#endif
+
+namespace {
+
+// Модуль семпла сравнивается как (s > threshold || s < -threshold),
+// поэтому -32768 тоже считается импульсом
+
+//-----------------------------------------------------------------------------
+// Скалярная реализация
+//-----------------------------------------------------------------------------
+
+int findFirstAboveScalar(const qint16 *data, int count, qint16 threshold)
+{
+  const qint16 negative = -threshold;
+  for (int i = 0; i < count; ++i)
+    if (data[i] > threshold || data[i] < negative)
+      return i;
+  return count;
+}
+
+int findLastAboveScalar(const qint16 *data, int count, qint16 threshold)
+{
+  const qint16 negative = -threshold;
+  for (int i = count - 1; i >= 0; --i)
+    if (data[i] > threshold || data[i] < negative)
+      return i;
+  return -1;
+}
+
+SampleLevel measureLevelScalar(const qint16 *data, int count)
+{
+  SampleLevel level = { 0, 0 };
+  for (int i = 0; i < count; ++i) {
+    const int value = data[i];
+    level.sumSquares += quint64(value * value);
+    level.peak = qMax(level.peak, qAbs(value));
+  }
+  return level;
+}
+
+qint32 dotProductScalar(const qint16 *samples, const qint16 *coefficients, int count)
+{
+  qint32 sum = 0;
+  for (int i = 0; i < count; ++i)
+    sum += qint32(samples[i]) * coefficients[i];
+  return sum;
+}
+
+void deinterleaveScalar(const qint16 *frames, int frameCount, int channels, qint16 *const *outputs)
+{
+  for (int channel = 0; channel < channels; ++channel) {
+    const qint16 *in = frames + channel;
+    qint16 *out = outputs[channel];
+    for (int i = 0; i < frameCount; ++i, in += channels)
+      out[i] = *in;
+  }
+}
+
+#ifdef SAMPLEKERNELS_SSE2
+//-----------------------------------------------------------------------------
+// SSE2: 8 семплов за итерацию
+//-----------------------------------------------------------------------------
+
+inline int aboveMaskSse2(const qint16 *data, __m128i positive, __m128i negative)
+{
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+  const __m128i above = _mm_or_si128(_mm_cmpgt_epi16(v, positive),
+                                     _mm_cmplt_epi16(v, negative));
+  return _mm_movemask_epi8(above);
+}
+
+int findFirstAboveSse2(const qint16 *data, int count, qint16 threshold)
+{
+  const __m128i positive = _mm_set1_epi16(threshold);
+  const __m128i negative = _mm_set1_epi16(-threshold);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const int bits = aboveMaskSse2(data + i, positive, negative);
+    if (bits)
+      return i + (qCountTrailingZeroBits(quint32(bits)) >> 1);
+  }
+  return i + findFirstAboveScalar(data + i, count - i, threshold);
+}
+
+int findLastAboveSse2(const qint16 *data, int count, qint16 threshold)
+{
+  const __m128i positive = _mm_set1_epi16(threshold);
+  const __m128i negative = _mm_set1_epi16(-threshold);
+  int i = count;
+  for (; i >= 8; i -= 8) {
+    const int bits = aboveMaskSse2(data + i - 8, positive, negative);
+    if (bits)
+      return i - 8 + ((31 - qCountLeadingZeroBits(quint32(bits))) >> 1);
+  }
+  return findLastAboveScalar(data, i, threshold);
+}
+
+// _mm_madd_epi16(v, v) даёт суммы пар квадратов - до 2^31, что помещается
+// только в беззнаковое 32-битное; суммы расширяются до 64 бит на каждой
+// итерации. Модуль без SSSE3 считается по минимуму и максимуму: -(-32768)
+// в 16 битах не представимо
+SampleLevel measureLevelSse2(const qint16 *data, int count)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sum = zero;
+  __m128i minimum = _mm_set1_epi16(32767);
+  __m128i maximum = _mm_set1_epi16(-32768);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    const __m128i squares = _mm_madd_epi16(v, v);
+    sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(squares, zero));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(squares, zero));
+    minimum = _mm_min_epi16(minimum, v);
+    maximum = _mm_max_epi16(maximum, v);
+  }
+
+  SampleLevel level = measureLevelScalar(data + i, count - i);
+  quint64 sums[2];
+  qint16 minimums[8], maximums[8];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), sum);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(minimums), minimum);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(maximums), maximum);
+  level.sumSquares += sums[0] + sums[1];
+  for (int k = 0; k < 8; ++k)
+    level.peak = qMax(level.peak, qMax(-int(minimums[k]), int(maximums[k])));
+  return level;
+}
+
+// Коэффициенты по модулю меньше 32768, поэтому сумма пары в madd не
+// переполняется
+qint32 dotProductSse2(const qint16 *samples, const qint16 *coefficients, int count)
+{
+  __m128i sum = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefficients + i));
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(v, c));
+  }
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum) + dotProductScalar(samples + i, coefficients + i, count - i);
+}
+
+// Чётные и нечётные семплы пар векторов: поток из channels каналов
+// превращается в два потока по channels / 2 каналов (чётные и нечётные
+// каналы). Знаковое расширение перед упаковкой делает её точной
+inline void splitEvenOddSse2(const __m128i *in, int count, __m128i *even, __m128i *odd)
+{
+  for (int k = 0; k < count; k += 2) {
+    even[k / 2] = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(in[k], 16), 16),
+                                  _mm_srai_epi32(_mm_slli_epi32(in[k + 1], 16), 16));
+    odd[k / 2] = _mm_packs_epi32(_mm_srai_epi32(in[k], 16), _mm_srai_epi32(in[k + 1], 16));
+  }
+}
+
+// 8 кадров из channels векторов; в потоке in каналы first, first + step, ...
+void deinterleaveBlockSse2(const __m128i *in, int channels, int first, int step,
+                           qint16 *const *outputs, int offset)
+{
+  if (channels == 1) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(outputs[first] + offset), in[0]);
+    return;
+  }
+  __m128i even[4], odd[4];
+  splitEvenOddSse2(in, channels, even, odd);
+  deinterleaveBlockSse2(even, channels / 2, first, step * 2, outputs, offset);
+  deinterleaveBlockSse2(odd, channels / 2, first + step, step * 2, outputs, offset);
+}
+
+// 2, 4 и 8 каналов - векторно по 8 кадров, остальное - скалярно
+void deinterleaveSse2(const qint16 *frames, int frameCount, int channels, qint16 *const *outputs)
+{
+  if (channels != 2 && channels != 4 && channels != 8) {
+    deinterleaveScalar(frames, frameCount, channels, outputs);
+    return;
+  }
+  __m128i block[8];
+  int i = 0;
+  for (; i + 8 <= frameCount; i += 8) {
+    const qint16 *in = frames + i * channels;
+    for (int k = 0; k < channels; ++k)
+      block[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + k * 8));
+    deinterleaveBlockSse2(block, channels, 0, 1, outputs, i);
+  }
+  if (i < frameCount) {
+    qint16 *tail[8];
+    for (int k = 0; k < channels; ++k)
+      tail[k] = outputs[k] + i;
+    deinterleaveScalar(frames + i * channels, frameCount - i, channels, tail);
+  }
+}
+#endif // SAMPLEKERNELS_SSE2
+
+#ifdef SAMPLEKERNELS_AVX2
+//-----------------------------------------------------------------------------
+// AVX2: 16 семплов за итерацию
+//-----------------------------------------------------------------------------
+
+SAMPLEKERNELS_TARGET_AVX2
+inline quint32 aboveMaskAvx2(const qint16 *data, __m256i positive, __m256i negative)
+{
+  const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+  const __m256i above = _mm256_or_si256(_mm256_cmpgt_epi16(v, positive),
+                                        _mm256_cmpgt_epi16(negative, v));
+  return quint32(_mm256_movemask_epi8(above));
+}
+
+SAMPLEKERNELS_TARGET_AVX2
+int findFirstAboveAvx2(const qint16 *data, int count, qint16 threshold)
+{
+  const __m256i positive = _mm256_set1_epi16(threshold);
+  const __m256i negative = _mm256_set1_epi16(-threshold);
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const quint32 bits = aboveMaskAvx2(data + i, positive, negative);
+    if (bits)
+      return i + (qCountTrailingZeroBits(bits) >> 1);
+  }
+  return i + findFirstAboveSse2(data + i, count - i, threshold);
+}
+
+SAMPLEKERNELS_TARGET_AVX2
+int findLastAboveAvx2(const qint16 *data, int count, qint16 threshold)
+{
+  const __m256i positive = _mm256_set1_epi16(threshold);
+  const __m256i negative = _mm256_set1_epi16(-threshold);
+  int i = count;
+  for (; i >= 16; i -= 16) {
+    const quint32 bits = aboveMaskAvx2(data + i - 16, positive, negative);
+    if (bits)
+      return i - 16 + ((31 - qCountLeadingZeroBits(bits)) >> 1);
+  }
+  return findLastAboveSse2(data, i, threshold);
+}
+
+SAMPLEKERNELS_TARGET_AVX2
+SampleLevel measureLevelAvx2(const qint16 *data, int count)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sum = zero;
+  __m256i minimum = _mm256_set1_epi16(32767);
+  __m256i maximum = _mm256_set1_epi16(-32768);
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    const __m256i squares = _mm256_madd_epi16(v, v);
+    sum = _mm256_add_epi64(sum, _mm256_unpacklo_epi32(squares, zero));
+    sum = _mm256_add_epi64(sum, _mm256_unpackhi_epi32(squares, zero));
+    minimum = _mm256_min_epi16(minimum, v);
+    maximum = _mm256_max_epi16(maximum, v);
+  }
+
+  SampleLevel level = measureLevelSse2(data + i, count - i);
+  quint64 sums[4];
+  qint16 minimums[16], maximums[16];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums), sum);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(minimums), minimum);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(maximums), maximum);
+  level.sumSquares += sums[0] + sums[1] + sums[2] + sums[3];
+  for (int k = 0; k < 16; ++k)
+    level.peak = qMax(level.peak, qMax(-int(minimums[k]), int(maximums[k])));
+  return level;
+}
+
+SAMPLEKERNELS_TARGET_AVX2
+qint32 dotProductAvx2(const qint16 *samples, const qint16 *coefficients, int count)
+{
+  __m256i sum = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+    const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(coefficients + i));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(v, c));
+  }
+  __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(half) + dotProductSse2(samples + i, coefficients + i, count - i);
+}
+
+bool cpuHasAvx2()
+{
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  // AVX и сохранение YMM-регистров операционной системой
+  if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)))
+    return false;
+  if ((_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // SAMPLEKERNELS_AVX2
+
+//-----------------------------------------------------------------------------
+// Выбор реализации
+//-----------------------------------------------------------------------------
+
+typedef int (*FindFunction)(const qint16 *, int, qint16);
+typedef SampleLevel (*LevelFunction)(const qint16 *, int);
+typedef qint32 (*DotProductFunction)(const qint16 *, const qint16 *, int);
+typedef void (*DeinterleaveFunction)(const qint16 *, int, int, qint16 *const *);
+
+struct SampleKernels
+{
+  const char           *name;
+  FindFunction          findFirstAbove;
+  FindFunction          findLastAbove;
+  LevelFunction         measureLevel;
+  DotProductFunction    dotProduct;
+  DeinterleaveFunction  deinterleave;
+};
+
+SampleKernels selectKernels()
+{
+#ifdef SAMPLEKERNELS_AVX2
+  if (cpuHasAvx2()) {
+    const SampleKernels kernels = { "avx2", findFirstAboveAvx2, findLastAboveAvx2,
+                                      measureLevelAvx2, dotProductAvx2, deinterleaveSse2 };
+    return kernels;
+  }
+#endif
+#ifdef SAMPLEKERNELS_SSE2
+  const SampleKernels kernels = { "sse2", findFirstAboveSse2, findLastAboveSse2,
+                                    measureLevelSse2, dotProductSse2, deinterleaveSse2 };
+#else
+  const SampleKernels kernels = { "scalar", findFirstAboveScalar, findLastAboveScalar,
+                                    measureLevelScalar, dotProductScalar, deinterleaveScalar };
+#endif
+  return kernels;
+}
+
+const SampleKernels &kernels()
+{
+  static const SampleKernels selected = selectKernels();
+  return selected;
+}
+
+} // namespace
+
+int findFirstAboveThreshold(const qint16 *data, int count, qint16 threshold)
+{
+  return kernels().findFirstAbove(data, count, threshold);
+}
+
+int findLastAboveThreshold(const qint16 *data, int count, qint16 threshold)
+{
+  return kernels().findLastAbove(data, count, threshold);
+}
+
+SampleLevel measureLevel(const qint16 *data, int count)
+{
+  return kernels().measureLevel(data, count);
+}
+
+qint32 dotProductSamples(const qint16 *samples, const qint16 *coefficients, int count)
+{
+  return kernels().dotProduct(samples, coefficients, count);
+}
+
+void deinterleaveChannels(const qint16 *frames, int frameCount, int channels, qint16 *const *outputs)
+{
+  kernels().deinterleave(frames, frameCount, channels, outputs);
+}
+
+const char *sampleKernelsName()
+{
+  return kernels().name;
+}
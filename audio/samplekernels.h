@@ -0,0 +1,68 @@
+/****************************************************************************
+**
+** Векторные функции обработки 16-битных семплов
+**
+** Реализация (AVX2, SSE2 или скалярная) выбирается один раз во время
+** выполнения по возможностям процессора.
+**
+****************************************************************************/
+
+#ifndef SAMPLEKERNELS_H
+#define SAMPLEKERNELS_H
+
+#include <QtGlobal>
+
+/**
+ * @brief Найти первый семпл, модуль которого больше порога
+ * @param data      [вх] семплы
+ * @param count     [вх] количество семплов
+ * @param threshold [вх] порог (>= 0)
+ * @return индекс семпла или count, если такого нет
+ */
+int findFirstAboveThreshold(const qint16 *data, int count, qint16 threshold);
+
+/**
+ * @brief Найти последний семпл, модуль которого больше порога
+ * @return индекс семпла или -1, если такого нет
+ */
+int findLastAboveThreshold(const qint16 *data, int count, qint16 threshold);
+
+/**
+ * @brief Сумма квадратов и наибольший модуль семплов
+ */
+struct SampleLevel
+{
+  quint64 sumSquares;
+  int     peak;       // 0..32768
+};
+
+/**
+ * @brief Измерить громкость участка (целочисленное накопление)
+ * @param data  [вх] семплы (каналы чередуются - учитываются все)
+ * @param count [вх] количество семплов
+ */
+SampleLevel measureLevel(const qint16 *data, int count);
+
+/**
+ * @brief Скалярное произведение (целочисленное накопление)
+ * @param samples      [вх] семплы
+ * @param coefficients [вх] коэффициенты (по модулю меньше 32768)
+ * @param count        [вх] длина
+ */
+qint32 dotProductSamples(const qint16 *samples, const qint16 *coefficients, int count);
+
+/**
+ * @brief Разделить чередующиеся каналы
+ * @param frames     [вх] кадры (семплы каналов подряд)
+ * @param frameCount [вх] количество кадров
+ * @param channels   [вх] каналов в кадре
+ * @param outputs    [вых] channels буферов по frameCount семплов
+ */
+void deinterleaveChannels(const qint16 *frames, int frameCount, int channels, qint16 *const *outputs);
+
+/**
+ * @brief Название выбранной реализации ("avx2", "sse2", "scalar")
+ */
+const char *sampleKernelsName();
+
+#endif // SAMPLEKERNELS_H
@@ -0,0 +1,368 @@
+/****************************************************************************
+**
+** Сегментированный архив фрагментов
+**
+****************************************************************************/
+
+#include <string.h>
+#include <QDateTime>
+#include <QDir>
+#include <QStringList>
+#include "segmentarchive.h"
+#include "utils.h"
+
+namespace {
+
+inline qint64 aligned(qint64 offset)
+{
+  return (offset + 7) & ~qint64(7);
+}
+
+const char Padding[8] = { 0 };
+
+} // namespace
+
+// SegmentWriter
+
+SegmentWriter::SegmentWriter(const QString &path, const QAudioFormat &format,
+                             qint64 maxSegmentBytes, int maxSegmentSec)
+  : _path(path)
+  , _format(format)
+  , _maxSegmentBytes(maxSegmentBytes)
+  , _maxSegmentMs(qint64(maxSegmentSec) * 1000)
+  , _openedMs(0)
+  , _awaiting(0)
+{
+}
+
+SegmentWriter::~SegmentWriter()
+{
+  close();
+}
+
+bool SegmentWriter::appendFragment(quint64 id, qint64 position, qint64 timeMs, const QByteArray &pcm)
+{
+  if (_file.isOpen() && needsRollover())
+    close();
+  if (!_file.isOpen() && !openSegment())
+    return false;
+
+  FragmentInfo info;
+  info.id = id;
+  info.position = position;
+  info.timeMs = timeMs;
+  const qint64 offset = appendRecord(FragmentRecord, &info, sizeof(info), pcm);
+  if (offset < 0)
+    return false;
+
+  const int index = _indexOf.value(id, -1);
+  if (index >= 0 && _index[index].fragmentOffset == 0) {
+    // гипотеза пришла раньше фрагмента
+    _index[index].fragmentOffset = offset;
+    _index[index].position = position;
+    return true;
+  }
+  IndexEntry entry;
+  entry.id = id;
+  entry.position = position;
+  entry.fragmentOffset = offset;
+  entry.hypothesisOffset = 0;
+  _indexOf.insert(id, _index.size());
+  _index.append(entry);
+  ++_awaiting;
+  return true;
+}
+
+bool SegmentWriter::appendHypothesis(quint64 id, qint64 timeMs, int score, const QByteArray &utf8)
+{
+  if (!_file.isOpen() && !openSegment())
+    return false;
+
+  HypothesisInfo info;
+  info.id = id;
+  info.timeMs = timeMs;
+  info.score = score;
+  info.reserved = 0;
+  const qint64 offset = appendRecord(HypothesisRecord, &info, sizeof(info), utf8);
+  if (offset < 0)
+    return false;
+
+  const int index = _indexOf.value(id, -1);
+  if (index >= 0) {
+    if (_index[index].hypothesisOffset == 0 && _index[index].fragmentOffset != 0)
+      --_awaiting;
+    _index[index].hypothesisOffset = offset;
+    return true;
+  }
+  // фрагмент в прошлом сегменте (или отброшен)
+  IndexEntry entry;
+  entry.id = id;
+  entry.position = 0;
+  entry.fragmentOffset = 0;
+  entry.hypothesisOffset = offset;
+  _indexOf.insert(id, _index.size());
+  _index.append(entry);
+  return true;
+}
+
+bool SegmentWriter::sync()
+{
+  return _file.isOpen() && syncFile(_file);
+}
+
+void SegmentWriter::close()
+{
+  if (!_file.isOpen())
+    return;
+
+  SegmentTrailer trailer;
+  trailer.indexOffset = quint64(_file.pos());
+  trailer.count = quint32(_index.size());
+  trailer.magic = IndexMagic;
+  const qint64 indexLength = qint64(_index.size()) * sizeof(IndexEntry);
+  _file.write(reinterpret_cast<const char *>(_index.constData()), indexLength);
+  _file.write(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+  syncFile(_file);
+  _file.close();
+
+  _index.clear();
+  _indexOf.clear();
+  _awaiting = 0;
+}
+
+bool SegmentWriter::openSegment()
+{
+#ifndef Q_LITTLE_ENDIAN
+  // only implemented for LITTLE ENDIAN
+  return false;
+#else
+  QDir dir(_path);
+  if (!dir.mkpath("."))
+    return false;
+  const QString stamp = QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss-zzz");
+  QString fileName = dir.filePath(QString("segment-%1.lba").arg(stamp));
+  for (int n = 1; QFile::exists(fileName); ++n)
+    fileName = dir.filePath(QString("segment-%1-%2.lba").arg(stamp).arg(n));
+
+  _file.setFileName(fileName);
+  if (!_file.open(QIODevice::WriteOnly))
+    return false;
+
+  SegmentHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = SegmentMagic;
+  header.version = Version;
+  header.sampleRate = quint32(_format.sampleRate());
+  header.channels = quint16(_format.channelCount());
+  header.sampleSize = quint16(_format.sampleSize());
+  header.createdMs = QDateTime::currentMSecsSinceEpoch();
+  if (_file.write(reinterpret_cast<const char *>(&header), sizeof(header)) != sizeof(header)) {
+    _file.close();
+    return false;
+  }
+  _openedMs = header.createdMs;
+  return true;
+#endif
+}
+
+bool SegmentWriter::needsRollover() const
+{
+  const qint64 size = _file.pos();
+  const qint64 age = QDateTime::currentMSecsSinceEpoch() - _openedMs;
+  if (size < _maxSegmentBytes && age < _maxSegmentMs)
+    return false;
+  // гипотезы недавних фрагментов лучше держать в их сегменте
+  return _awaiting == 0 || size >= 2 * _maxSegmentBytes || age >= 2 * _maxSegmentMs;
+}
+
+qint64 SegmentWriter::appendRecord(RecordType type, const void *info, int infoLength, const QByteArray &data)
+{
+  const qint64 offset = _file.pos();
+  RecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = RecordMagic;
+  header.type = quint8(type);
+  header.length = quint32(infoLength + data.size());
+
+  bool ok = _file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header)
+         && _file.write(reinterpret_cast<const char *>(info), infoLength) == infoLength
+         && _file.write(data) == data.size();
+  const qint64 end = offset + qint64(sizeof(header)) + header.length;
+  ok = ok && _file.write(Padding, aligned(end) - end) == aligned(end) - end;
+  if (ok)
+    return offset;
+
+  // оборванная запись: следующие записи не должны лечь за ней, иначе
+  // читатель потеряет их при просмотре. Сегмент обрезается до последней
+  // целой записи, а если не удалось - закрывается, и следующая запись
+  // начнёт новый сегмент
+  if (_file.resize(offset) && _file.seek(offset))
+    _file.unsetError();
+  else
+    close();
+  return -1;
+}
+
+// SegmentReader
+
+QByteArray SegmentReader::Record::pcm() const
+{
+  if (!samples)
+    return QByteArray();
+  return QByteArray::fromRawData(reinterpret_cast<const char *>(samples), int(sampleCount * sizeof(qint16)));
+}
+
+SegmentReader::SegmentReader()
+  : _data(nullptr)
+  , _size(0)
+  , _hasIndex(false)
+{
+}
+
+SegmentReader::~SegmentReader()
+{
+  close();
+}
+
+bool SegmentReader::open(const QString &fileName)
+{
+  close();
+  _file.setFileName(fileName);
+  if (!_file.open(QIODevice::ReadOnly))
+    return false;
+  _size = _file.size();
+  if (_size >= qint64(sizeof(SegmentHeader)))
+    _data = _file.map(0, _size);
+  if (!_data) {
+    close();
+    return false;
+  }
+
+  const SegmentHeader *header = reinterpret_cast<const SegmentHeader *>(_data);
+  if (header->magic != SegmentWriter::SegmentMagic || header->version != SegmentWriter::Version) {
+    close();
+    return false;
+  }
+  _format.setCodec("audio/pcm");
+  _format.setByteOrder(QAudioFormat::LittleEndian);
+  _format.setSampleType(QAudioFormat::SignedInt);
+  _format.setSampleRate(int(header->sampleRate));
+  _format.setChannelCount(header->channels);
+  _format.setSampleSize(header->sampleSize);
+
+  _hasIndex = readIndex();
+  if (!_hasIndex)
+    scanRecords();
+  for (int i = 0; i < _index.size(); ++i)
+    _indexOf.insert(_index.at(i).id, i);
+  return true;
+}
+
+void SegmentReader::close()
+{
+  if (_data)
+    _file.unmap(const_cast<uchar *>(_data));
+  _data = nullptr;
+  _size = 0;
+  _file.close();
+  _hasIndex = false;
+  _index.clear();
+  _indexOf.clear();
+}
+
+SegmentReader::Record SegmentReader::record(int index) const
+{
+  const IndexEntry &entry = _index.at(index);
+  Record record;
+  record.id = entry.id;
+  record.position = entry.position;
+  record.timeMs = 0;
+  record.samples = nullptr;
+  record.sampleCount = 0;
+  record.hasHypothesis = false;
+  record.score = 0;
+
+  if (const RecordHeader *header = recordAt(entry.fragmentOffset)) {
+    const FragmentInfo *info = reinterpret_cast<const FragmentInfo *>(header + 1);
+    record.timeMs = info->timeMs;
+    record.samples = reinterpret_cast<const qint16 *>(info + 1);
+    record.sampleCount = (header->length - sizeof(FragmentInfo)) / sizeof(qint16);
+  }
+  if (const RecordHeader *header = recordAt(entry.hypothesisOffset)) {
+    const HypothesisInfo *info = reinterpret_cast<const HypothesisInfo *>(header + 1);
+    record.hasHypothesis = true;
+    record.score = info->score;
+    record.hypothesis = QString::fromUtf8(reinterpret_cast<const char *>(info + 1),
+                                          int(header->length - sizeof(HypothesisInfo)));
+    if (!record.timeMs)
+      record.timeMs = info->timeMs;
+  }
+  return record;
+}
+
+QStringList SegmentReader::segments(const QString &path)
+{
+  // имена содержат время создания - сортировка по имени даёт порядок записи
+  const QDir dir(path);
+  QStringList result;
+  foreach (const QString &name, dir.entryList(QStringList() << "*.lba", QDir::Files, QDir::Name))
+    result << dir.filePath(name);
+  return result;
+}
+
+bool SegmentReader::readIndex()
+{
+  if (_size < qint64(sizeof(SegmentHeader) + sizeof(SegmentTrailer)))
+    return false;
+  const SegmentTrailer *trailer = reinterpret_cast<const SegmentTrailer *>(_data + _size - sizeof(SegmentTrailer));
+  const qint64 indexLength = qint64(trailer->count) * sizeof(IndexEntry);
+  if (trailer->magic != SegmentWriter::IndexMagic
+      || trailer->indexOffset < sizeof(SegmentHeader)
+      || qint64(trailer->indexOffset) + indexLength + qint64(sizeof(SegmentTrailer)) != _size)
+    return false;
+
+  _index.resize(int(trailer->count));
+  memcpy(_index.data(), _data + trailer->indexOffset, indexLength);
+  return true;
+}
+
+void SegmentReader::scanRecords()
+{
+  // сегмент не закрыт: индекс восстанавливается по записям
+  QHash<quint64, int> indexOf;
+  quint64 offset = aligned(sizeof(SegmentHeader));
+  while (const RecordHeader *header = recordAt(offset)) {
+    if (header->type == SegmentWriter::FragmentRecord || header->type == SegmentWriter::HypothesisRecord) {
+      // первое поле FragmentInfo и HypothesisInfo - номер фрагмента
+      const quint64 id = *reinterpret_cast<const quint64 *>(header + 1);
+      int index = indexOf.value(id, -1);
+      if (index < 0) {
+        IndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.id = id;
+        index = _index.size();
+        indexOf.insert(id, index);
+        _index.append(entry);
+      }
+      if (header->type == SegmentWriter::FragmentRecord) {
+        _index[index].fragmentOffset = offset;
+        _index[index].position = reinterpret_cast<const FragmentInfo *>(header + 1)->position;
+      } else {
+        _index[index].hypothesisOffset = offset;
+      }
+    }
+    offset = aligned(offset + sizeof(RecordHeader) + header->length);
+  }
+}
+
+const RecordHeader *SegmentReader::recordAt(quint64 offset) const
+{
+  if (offset < sizeof(SegmentHeader) || qint64(offset + sizeof(RecordHeader)) > _size)
+    return nullptr;
+  const RecordHeader *header = reinterpret_cast<const RecordHeader *>(_data + offset);
+  const quint64 minLength = header->type == SegmentWriter::FragmentRecord ? sizeof(FragmentInfo) : sizeof(HypothesisInfo);
+  if (header->magic != SegmentWriter::RecordMagic || header->length < minLength
+      || qint64(offset + sizeof(RecordHeader) + header->length) > _size)
+    return nullptr;
+  return header;
+}
@@ -0,0 +1,206 @@
+/****************************************************************************
+**
+** Сегментированный архив фрагментов
+**
+** Архив - каталог файлов-сегментов *.lba, в которые записи только
+** дописываются. Сегмент:
+**   SegmentHeader                       - формат звука, время создания;
+**   записи RecordHeader + данные        - фрагмент (FragmentInfo + PCM) или
+**                                         гипотеза (HypothesisInfo + UTF-8);
+**                                         каждая запись выровнена на 8 байт,
+**                                         заголовок - 16 байт, поэтому 64-битные
+**                                         поля читаются из отображения на месте;
+**   IndexEntry[count] + SegmentTrailer  - индекс при закрытии сегмента.
+** Индекс даёт запись по номеру за O(1) и по номеру фрагмента через хэш;
+** сегмент без индекса (процесс прерван) читается последовательным
+** просмотром записей до первой неполной. Новый сегмент начинается по
+** размеру или времени; пока не пришли гипотезы фрагментов сегмента, смена
+** откладывается (не дольше чем до двойного предела).
+**
+** Все числа - little endian; структуры пишутся как есть, их размеры
+** проверяются при сборке.
+**
+****************************************************************************/
+
+#ifndef SEGMENTARCHIVE_H
+#define SEGMENTARCHIVE_H
+
+#include <QAudioFormat>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct SegmentHeader
+{
+  quint32     magic;          // "LBNS"
+  quint32     version;
+  quint32     sampleRate;
+  quint16     channels;
+  quint16     sampleSize;     // бит
+  qint64      createdMs;      // мс UTC
+  quint64     reserved;
+};
+static_assert(sizeof(SegmentHeader) == 32, "SegmentHeader is part of the archive format");
+
+struct RecordHeader
+{
+  quint32     magic;          // "LBNR"
+  quint32     length;         // размер данных за заголовком (без выравнивания)
+  quint8      type;           // SegmentWriter::RecordType
+  quint8      reserved[7];    // до 16 байт: данные записи выровнены на 8
+};
+static_assert(sizeof(RecordHeader) == 16, "RecordHeader is part of the archive format");
+
+struct FragmentInfo
+{
+  quint64     id;             // номер фрагмента
+  qint64      position;       // начало в записи, семплы
+  qint64      timeMs;         // время выделения, мс UTC
+};
+static_assert(sizeof(FragmentInfo) == 24, "FragmentInfo is part of the archive format");
+
+struct HypothesisInfo
+{
+  quint64     id;
+  qint64      timeMs;
+  qint32      score;
+  quint32     reserved;
+};
+static_assert(sizeof(HypothesisInfo) == 24, "HypothesisInfo is part of the archive format");
+
+struct IndexEntry
+{
+  quint64     id;
+  qint64      position;
+  quint64     fragmentOffset;    // смещение RecordHeader фрагмента, 0 - нет
+  quint64     hypothesisOffset;  // смещение RecordHeader гипотезы, 0 - нет
+};
+static_assert(sizeof(IndexEntry) == 32, "IndexEntry is part of the archive format");
+
+struct SegmentTrailer
+{
+  quint64     indexOffset;
+  quint32     count;
+  quint32     magic;          // "LBNI"
+};
+static_assert(sizeof(SegmentTrailer) == 16, "SegmentTrailer is part of the archive format");
+
+/**
+ * @brief Запись сегментов архива (из одного потока)
+ */
+class SegmentWriter
+{
+public:
+  enum RecordType { FragmentRecord = 1, HypothesisRecord = 2 };
+
+  static const quint32 SegmentMagic = 0x534e424c;  // "LBNS"
+  static const quint32 RecordMagic = 0x524e424c;   // "LBNR"
+  static const quint32 IndexMagic = 0x494e424c;    // "LBNI"
+  static const quint32 Version = 1;
+
+  /**
+   * @param path            [вх] каталог архива (создаётся при необходимости)
+   * @param format          [вх] формат фрагментов
+   * @param maxSegmentBytes [вх] размер сегмента, после которого начинается новый
+   * @param maxSegmentSec   [вх] длительность сегмента, после которой начинается новый
+   */
+  SegmentWriter(const QString &path, const QAudioFormat &format,
+                qint64 maxSegmentBytes, int maxSegmentSec);
+  ~SegmentWriter();
+
+  bool appendFragment(quint64 id, qint64 position, qint64 timeMs, const QByteArray &pcm);
+  bool appendHypothesis(quint64 id, qint64 timeMs, int score, const QByteArray &utf8);
+
+  /**
+   * @brief Сбросить текущий сегмент на диск (fsync)
+   */
+  bool sync();
+
+  /**
+   * @brief Записать индекс и закрыть текущий сегмент
+   */
+  void close();
+
+  QString currentPath() const { return _file.fileName(); }
+
+private:
+  bool openSegment();
+  bool needsRollover() const;
+  qint64 appendRecord(RecordType type, const void *info, int infoLength, const QByteArray &data);
+
+  const QString _path;
+  const QAudioFormat _format;
+  const qint64 _maxSegmentBytes;
+  const qint64 _maxSegmentMs;
+
+  QFile _file;
+  qint64 _openedMs;
+  QVector<IndexEntry> _index;
+  QHash<quint64, int> _indexOf;  // номер фрагмента -> элемент _index
+  int _awaiting;                 // фрагменты сегмента без гипотезы
+};
+
+/**
+ * @brief Чтение сегмента, отображённого в память
+ */
+class SegmentReader
+{
+public:
+  /**
+   * @brief Фрагмент сегмента; samples указывают в отображённый файл и
+   * действительны до close()
+   */
+  struct Record
+  {
+    quint64 id;
+    qint64 position;
+    qint64 timeMs;
+    const qint16 *samples;  // nullptr - звука в сегменте нет (гипотеза к фрагменту прошлого сегмента)
+    qint64 sampleCount;
+    bool hasHypothesis;
+    QString hypothesis;
+    int score;
+
+    /**
+     * @brief Звук без копирования (QByteArray::fromRawData)
+     */
+    QByteArray pcm() const;
+  };
+
+  SegmentReader();
+  ~SegmentReader();
+
+  bool open(const QString &fileName);
+  void close();
+
+  const QAudioFormat &format() const { return _format; }
+  // индекс прочитан из сегмента (сегмент закрыт штатно)
+  bool hasIndex() const { return _hasIndex; }
+  int count() const { return _index.size(); }
+  Record record(int index) const;
+  // номер записи фрагмента id, -1 - нет
+  int indexOf(quint64 id) const { return _indexOf.value(id, -1); }
+
+  /**
+   * @brief Сегменты каталога в порядке создания
+   */
+  static QStringList segments(const QString &path);
+
+private:
+  bool readIndex();
+  void scanRecords();
+  const RecordHeader *recordAt(quint64 offset) const;
+
+  QFile _file;
+  const uchar *_data;
+  qint64 _size;
+  QAudioFormat _format;
+  bool _hasIndex;
+  QVector<IndexEntry> _index;
+  QHash<quint64, int> _indexOf;
+};
+
+#endif // SEGMENTARCHIVE_H
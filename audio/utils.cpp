@@ -39,8 +39,15 @@
 ****************************************************************************/
 
 #include <QAudioFormat>
+#include <QFile>
 #include "utils.h"
 
+#ifdef Q_OS_WIN
+#   include <io.h>
+#else
+#   include <unistd.h>
+#endif
+
 qint64 audioDuration(const QAudioFormat &format, qint64 bytes)
 {
     return (bytes * 1000000) /
@@ -123,6 +130,17 @@ bool isPCMS16LE(const QAudioFormat &format)
            format.byteOrder() == QAudioFormat::LittleEndian;
 }
 
+bool syncFile(QFile &file)
+{
+    if (!file.isOpen() || !file.flush())
+        return false;
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
 const qint16  PCMS16MaxValue     =  32767;
 const quint16 PCMS16MaxAmplitude =  32768; // because minimum is -32768
 
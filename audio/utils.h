@@ -45,6 +45,7 @@
 #include <QDebug>
 
 QT_FORWARD_DECLARE_CLASS(QAudioFormat)
+QT_FORWARD_DECLARE_CLASS(QFile)
 
 //-----------------------------------------------------------------------------
 // Miscellaneous utility functions
@@ -69,6 +70,9 @@ bool isPCM(const QAudioFormat &format);
 // Check whether the audio format is signed, little-endian, 16-bit PCM
 bool isPCMS16LE(const QAudioFormat &format);
 
+// Flush the file and force its data to disk (fsync)
+bool syncFile(QFile &file);
+
 // Compile-time calculation of powers of two
 
 template<int N> class PowerOfTwo
@@ -39,6 +39,7 @@
 ****************************************************************************/
 
 #include "waveform.h"
+#include "metrics.h"
 #include "utils.h"
 #include <QPainter>
 #include <QResizeEvent>
@@ -60,16 +61,27 @@ Waveform::Waveform(QWidget *parent)
   ,   m_tileArrayStart(0)
   ,   m_windowPosition(0)
   ,   m_windowLength(0)
+  ,   m_tileGeneration(0)
+  ,   m_nextTileId(0)
+  ,   m_renderer(new WaveformTileRenderer)
 {  
   setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
 
   setMinimumHeight(200);
   setMinimumWidth(400);
+
+  qRegisterMetaType<WaveformTileJob>();
+  m_renderer->moveToThread(&m_renderThread);
+  connect(m_renderer, SIGNAL(rendered(WaveformTileJob,QImage)),
+          this, SLOT(tileRendered(WaveformTileJob,QImage)));
+  m_renderThread.start(QThread::LowPriority);
 }
 
 Waveform::~Waveform()
 {
-  deletePixmaps();
+  m_renderThread.quit();
+  m_renderThread.wait();
+  delete m_renderer;
 }
 
 void Waveform::paintEvent(QPaintEvent * /*event*/)
@@ -107,7 +119,7 @@ void Waveform::paintEvent(QPaintEvent * /*event*/)
           destRect.setLeft(destLeft);
           destRect.setRight(destRight);
 
-          QRect sourceRect(QPoint(), m_pixmapSize);
+          QRect sourceRect(QPoint(), m_tileSize);
           sourceRect.setLeft(point.pixelOffset);
           sourceRect.setRight(sourceRight);
 
@@ -115,7 +127,8 @@ void Waveform::paintEvent(QPaintEvent * /*event*/)
                                << "source" << point.pixelOffset << sourceRight
                                << "dest" << destLeft << destRight;
 
-          painter.drawPixmap(destRect, *tile.pixmap, sourceRect);
+          if (!tile.image.isNull())
+            painter.drawImage(destRect, tile.image, sourceRect);
 
           destLeft = destRight;
 
@@ -146,7 +159,7 @@ void Waveform::paintEvent(QPaintEvent * /*event*/)
 void Waveform::resizeEvent(QResizeEvent *event)
 {
   if (event->size() != event->oldSize())
-    createPixmaps(event->size());
+    resizeTiles(event->size());
 }
 
 void Waveform::initialize(const QAudioFormat &format, qint64 audioBufferSize, qint64 windowDurationUs)
@@ -180,10 +193,13 @@ void Waveform::initialize(const QAudioFormat &format, qint64 audioBufferSize, qi
 //                 << "windowLength" << m_windowLength
 //                 << "nTiles" << nTiles;
 
-  m_pixmaps.fill(0, nTiles);
+  // Ids are not reused, so renders still in flight for tiles from before
+  // reset() never match the new tiles
   m_tiles.resize(nTiles);
+  for (int i=0; i<m_tiles.count(); ++i)
+    m_tiles[i].id = m_nextTileId++;
 
-  createPixmaps(rect().size());
+  resizeTiles(rect().size());
 
   m_active = true;
 }
@@ -193,11 +209,13 @@ void Waveform::reset()
 //  WAVEFORM_DEBUG << "Waveform::reset";
 
   _buffer = QByteArray();
+  _reader = RingBuffer::Reader();
+  _peaks.reset(0, 1);
   m_audioPosition = 0;
   m_format = QAudioFormat();
   m_active = false;
-  deletePixmaps();
   m_tiles.clear();
+  ++m_tileGeneration;
   m_tileLength = 0;
   m_tileArrayStart = 0;
   m_windowPosition = 0;
@@ -209,8 +227,31 @@ void Waveform::bufferChanged(qint64 length, const QByteArray &buffer)
 //  WAVEFORM_DEBUG << "Waveform::bufferChanged"
 //                 << "audioPosition" << m_audioPosition
 //                 << "_dataLength" << length;
-  _dataLength = length;
+  // новый буфер (или буфер стал короче) - пики строятся заново
+  const bool sameBuffer = _buffer.constData() == buffer.constData() && !_reader.isValid();
+  _reader = RingBuffer::Reader();
   _buffer = buffer;
+  const int frameBytes = 2 * qMax(m_format.channelCount(), 1);
+  if (!sameBuffer || length / frameBytes < _peaks.end())
+    _peaks.reset(0, m_format.channelCount());
+  _dataLength = length;
+  updatePeaks();
+  paintTiles();
+}
+
+void Waveform::setReader(const RingBuffer::Reader &reader)
+{
+  _buffer = QByteArray();
+  _reader = reader;
+  _dataLength = reader.position();
+  _peaks.reset(_dataLength / (2 * qMax(m_format.channelCount(), 1)), m_format.channelCount());
+  resetTiles(_dataLength);
+}
+
+void Waveform::dataAvailable(qint64 position)
+{
+  _dataLength = position;
+  updatePeaks();
   paintTiles();
 }
 
@@ -226,37 +267,23 @@ void Waveform::audioPositionChanged(qint64 position)
   setWindowPosition(position);
 }
 
-void Waveform::deletePixmaps()
+void Waveform::resizeTiles(const QSize &widgetSize)
 {
-  QPixmap *pixmap;
-  foreach (pixmap, m_pixmaps)
-    delete pixmap;
-  m_pixmaps.clear();
-}
-
-void Waveform::createPixmaps(const QSize &widgetSize)
-{
-  m_pixmapSize = widgetSize;
+  m_tileSize = widgetSize;
   if (m_windowLength) {
-    m_pixmapSize.setWidth(qreal(widgetSize.width()) * m_tileLength / m_windowLength);
+    m_tileSize.setWidth(qreal(widgetSize.width()) * m_tileLength / m_windowLength);
   }
 
-//  WAVEFORM_DEBUG << "Waveform::createPixmaps"
+//  WAVEFORM_DEBUG << "Waveform::resizeTiles"
 //                 << "widgetSize" << widgetSize
-//                 << "pixmapSize" << m_pixmapSize;
+//                 << "tileSize" << m_tileSize;
 
-  Q_ASSERT(m_tiles.count() == m_pixmaps.count());
-
-  // (Re)create pixmaps
-  for (int i=0; i<m_pixmaps.size(); ++i) {
-    delete m_pixmaps[i];
-    m_pixmaps[i] = 0;
-    m_pixmaps[i] = new QPixmap(m_pixmapSize);
-  }
+  // Renders in flight are for the old size
+  ++m_tileGeneration;
 
-  // Update tile pixmap pointers, and mark for repainting
+  // Mark for repainting
   for (int i=0; i<m_tiles.count(); ++i) {
-    m_tiles[i].pixmap = m_pixmaps[i];
+    m_tiles[i].image = QImage();
     m_tiles[i].painted = false;
   }
 }
@@ -300,7 +327,7 @@ Waveform::TilePoint Waveform::tilePoint(qint64 position) const
       Q_ASSERT(result.index >= 0 && result.index <= m_tiles.count());
       result.positionOffset = offsetIntoTileArray % m_tileLength;
       result.pixelOffset = tilePixelOffset(result.positionOffset);
-      Q_ASSERT(result.pixelOffset >= 0 && result.pixelOffset <= m_pixmapSize.width());
+      Q_ASSERT(result.pixelOffset >= 0 && result.pixelOffset <= m_tileSize.width());
     }
   }
 
@@ -310,7 +337,7 @@ Waveform::TilePoint Waveform::tilePoint(qint64 position) const
 int Waveform::tilePixelOffset(qint64 positionOffset) const
 {
   Q_ASSERT(positionOffset >= 0 && positionOffset <= m_tileLength);
-  const int result = (qreal(positionOffset) / m_tileLength) * m_pixmapSize.width();
+  const int result = (qreal(positionOffset) / m_tileLength) * m_tileSize.width();
   return result;
 }
 
@@ -321,6 +348,33 @@ int Waveform::windowPixelOffset(qint64 positionOffset) const
   return result;
 }
 
+void Waveform::updatePeaks()
+{
+  const int frameBytes = 2 * qMax(m_format.channelCount(), 1);
+  const qint64 endFrame = _dataLength / frameBytes;
+  if (endFrame <= _peaks.end())
+    return;
+
+  if (!_reader.isValid()) {
+    const qint64 available = qMin(endFrame, qint64(_buffer.size() / frameBytes));
+    if (available > _peaks.end())
+      _peaks.append(reinterpret_cast<const qint16*>(_buffer.constData()) + _peaks.end() * m_format.channelCount(),
+                    available - _peaks.end());
+    return;
+  }
+
+  // Новые данные копируются из кольцевого буфера; отставшие больше, чем на
+  // ёмкость буфера, пики начинаются заново с самых старых сохранившихся данных
+  qint64 position = _peaks.end() * frameBytes;
+  const qint64 start = position;
+  _readData.resize(int(qMin(_dataLength - position, _reader.ring()->capacity())));
+  const qint64 length = _reader.peek(position, _readData.data(), _readData.size());
+  if (position != start)
+    _peaks.reset(position / frameBytes, m_format.channelCount());
+  _peaks.append(reinterpret_cast<const qint16*>(_readData.constData()), length / frameBytes);
+  _peaks.discardBefore(_reader.ring()->tailPosition() / frameBytes);
+}
+
 bool Waveform::paintTiles()
 {
 //  WAVEFORM_DEBUG << "Waveform::paintTiles";
@@ -328,13 +382,11 @@ bool Waveform::paintTiles()
 
   for (int i=0; i<m_tiles.count(); ++i) {
     const Tile &tile = m_tiles[i];
-    if (!tile.painted) {
+    if (!tile.painted && tile.inFlight < 0) {
       const qint64 tileStart = m_tileArrayStart + i * m_tileLength;
       const qint64 tileEnd = tileStart + m_tileLength;
-      if (_dataLength >= tileEnd) {
-        paintTile(i);
+      if (_dataLength >= tileEnd && paintTile(i))
         updateRequired = true;
-      }
     }
   }
 
@@ -344,7 +396,7 @@ bool Waveform::paintTiles()
   return updateRequired;
 }
 
-void Waveform::paintTile(int index)
+bool Waveform::paintTile(int index)
 {
   const qint64 tileStart = m_tileArrayStart + index * m_tileLength;
 
@@ -357,51 +409,87 @@ void Waveform::paintTile(int index)
   Q_ASSERT(_dataLength >= tileStart + m_tileLength);
 
   Tile &tile = m_tiles[index];
-  Q_ASSERT(!tile.painted);
-
-  const qint16* base = reinterpret_cast<const qint16*>(_buffer.constData());
-  const qint16* buffer = base + (tileStart / 2);
-  const int numSamples = m_tileLength / (2 * m_format.channelCount());
-
-  QPainter painter(tile.pixmap);
-
-  painter.fillRect(tile.pixmap->rect(), Qt::black);
-
-  QPen pen(Qt::white);
-  painter.setPen(pen);
-
-  // Calculate initial PCM value
-  qint16 previousPcmValue = 0;
-  if (buffer > base)
-    previousPcmValue = *(buffer - m_format.channelCount());
-
-  // Calculate initial point
-  const qreal previousRealValue = pcmToReal(previousPcmValue);
-  const int originY = ((previousRealValue + 1.0) / 2) * m_pixmapSize.height();
-  const QPoint origin(0, originY);
-
-  QLine line(origin, origin);
-
-  for (int i=0; i<numSamples; ++i) {
-    const qint16* ptr = buffer + i * m_format.channelCount();
+  Q_ASSERT(!tile.painted && tile.inFlight < 0);
+
+  // Tile data which is no longer held by the pyramid (overwritten in the
+  // ring buffer) is left blank
+  const int frameBytes = 2 * m_format.channelCount();
+  const qint64 startFrame = tileStart / frameBytes;
+  const qint64 endFrame = (tileStart + m_tileLength) / frameBytes;
+  const int width = m_tileSize.width();
+  if (startFrame < _peaks.start() || width <= 0 || m_tileSize.height() <= 0) {
+    tile.image = QImage();
+    tile.painted = true;
+    return true;
+  }
 
-    const int offset = reinterpret_cast<const char*>(ptr) - _buffer.constData();
-    Q_ASSERT(offset >= 0);
-    Q_ASSERT(offset < _dataLength);
-    Q_UNUSED(offset);
+  // Only the column peaks are taken here; rasterization is done by the
+  // render thread
+  WaveformTileJob job;
+  job.tile = tile.id;
+  job.position = tileStart;
+  job.generation = m_tileGeneration;
+  job.size = m_tileSize;
+  job.columns.resize(width);
+  _peaks.columns(startFrame, endFrame, job.columns.data(), width);
+
+  tile.inFlight = tileStart;
+  QMetaObject::invokeMethod(m_renderer, "render", Qt::QueuedConnection, Q_ARG(WaveformTileJob, job));
+  return false;
+}
 
-    const qint16 pcmValue = *ptr;
-    const qreal realValue = pcmToReal(pcmValue);
+void Waveform::tileRendered(const WaveformTileJob &job, const QImage &image)
+{
+  bool updateRequired = false;
+  for (int i=0; i<m_tiles.count(); ++i) {
+    Tile &tile = m_tiles[i];
+    if (tile.id != job.tile || tile.inFlight != job.position)
+      continue;
+    tile.inFlight = -1;
+    // The tile may have been scrolled, reset or resized meanwhile
+    if (job.generation == m_tileGeneration && tilePosition(i) == job.position && !tile.painted) {
+      tile.image = image;
+      tile.painted = true;
+      updateRequired = true;
+    }
+    break;
+  }
 
-    const int x = tilePixelOffset(i * 2 * m_format.channelCount());
-    const int y = ((realValue + 1.0) / 2) * m_pixmapSize.height();
+  // Tiles which waited for this render
+  if (!paintTiles() && updateRequired)
+    update();
+}
 
-    line.setP2(QPoint(x, y));
-    painter.drawLine(line);
-    line.setP1(line.p2());
+void WaveformTileRenderer::render(const WaveformTileJob &job)
+{
+  static LatencyHistogram *const renderLatency = Metrics::instance().histogram("waveform.renderTile");
+  LatencyTimer timer(renderLatency);
+
+  QImage image(job.size, QImage::Format_RGB32);
+  image.fill(Qt::black);
+
+  // One vertical line per column, joined to the previous column so that
+  // the trace stays continuous where the column range is narrow
+  const QVector<PeakPyramid::Peak> &columns = job.columns;
+  const int width = columns.size();
+  const int height = job.size.height();
+  QVector<QLine> lines(width);
+  int previousY = ((pcmToReal(columns[0].min) + pcmToReal(columns[0].max)) / 2 + 1.0) / 2 * height;
+  for (int x = 0; x < width; ++x) {
+    int top = ((pcmToReal(columns[x].min) + 1.0) / 2) * height;
+    int bottom = ((pcmToReal(columns[x].max) + 1.0) / 2) * height;
+    if (previousY < top) top = previousY;
+    if (previousY > bottom) bottom = previousY;
+    lines[x] = QLine(x, top, x, bottom);
+    previousY = ((pcmToReal(columns[x].min) + pcmToReal(columns[x].max)) / 2 + 1.0) / 2 * height;
   }
 
-  tile.painted = true;
+  QPainter painter(&image);
+  painter.setPen(QPen(Qt::white));
+  painter.drawLines(lines);
+  painter.end();
+
+  emit rendered(job, image);
 }
 
 void Waveform::shuffleTiles(int n)
@@ -410,6 +498,7 @@ void Waveform::shuffleTiles(int n)
 
   while (n--) {
     Tile tile = m_tiles.first();
+    tile.image = QImage();
     tile.painted = false;
     m_tiles.erase(m_tiles.begin());
     m_tiles += tile;
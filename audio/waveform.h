@@ -42,18 +42,56 @@
 #define WAVEFORM_H
 
 #include <QAudioFormat>
-#include <QPixmap>
+#include <QImage>
+#include <QMetaType>
 #include <QScopedPointer>
+#include <QThread>
 #include <QWidget>
+#include "peakpyramid.h"
+#include "ringbuffer.h"
+
+/*
+ * Request to rasterize one tile
+ */
+struct WaveformTileJob
+{
+    quint64                     tile;        // Tile::id
+    qint64                      position;    // tile start, bytes
+    quint64                     generation;  // tile layout the job was made for
+    QSize                       size;
+    QVector<PeakPyramid::Peak>  columns;     // min/max per pixel column
+};
+Q_DECLARE_METATYPE(WaveformTileJob)
+
+/*
+ * Rasterizes tiles; lives on the waveform render thread
+ */
+class WaveformTileRenderer : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void render(const WaveformTileJob &job);
+
+signals:
+    void rendered(const WaveformTileJob &job, const QImage &image);
+};
 
 /**
  * Widget which displays a section of the audio waveform.
  *
- * The waveform is rendered on a set of QPixmaps which form a group of tiles
+ * The waveform is rendered on a set of QImages which form a group of tiles
  * whose extent covers the widget.  As the audio position is updated, these
  * tiles are scrolled from left to right; when the left-most tile scrolls
  * outside the widget, it is moved to the right end of the tile array and
  * painted with the next section of the waveform.
+ *
+ * Tiles are drawn from a min/max peak pyramid which is updated as data
+ * arrives, one vertical line per pixel column in a single drawLines()
+ * call, so the cost of a tile depends on its width, not on the sample rate.
+ * The GUI thread only takes the column peaks from the pyramid; tiles are
+ * rasterized by WaveformTileRenderer on a worker thread, with at most one
+ * render in flight per tile, and are shown when the finished image arrives.
  */
 class Waveform : public QWidget
 {
@@ -72,20 +110,28 @@ public:
 
     void setAutoUpdatePosition(bool enabled);
 
+    /*
+     * Display data from the capture ring buffer.  Positions passed to
+     * dataAvailable() and audioPositionChanged() are absolute ring positions.
+     */
+    void setReader(const RingBuffer::Reader &reader);
+
 public slots:
     void bufferChanged(qint64 length, const QByteArray &buffer);
+    void dataAvailable(qint64 position);
     void audioPositionChanged(qint64 position);
 
+private slots:
+    void tileRendered(const WaveformTileJob &job, const QImage &image);
+
 private:
     static const int NullIndex = -1;
 
-    void deletePixmaps();
-
     /*
-     * (Re)create all pixmaps, repaint and update the display.
-     * Triggers an update();
+     * Recalculate the tile size and mark all tiles for repainting.
+     * Images rendered for the old size are discarded.
      */
-    void createPixmaps(const QSize &newSize);
+    void resizeTiles(const QSize &newSize);
 
     /*
      * Update window position.
@@ -114,13 +160,13 @@ private:
         // Number of bytes from start of tile
         qint64  positionOffset;
 
-        // Number of pixels from left of corresponding pixmap
+        // Number of pixels from left of corresponding tile image
         int     pixelOffset;
     };
 
     /*
      * Convert position in m_buffer into a tile index and an offset in pixels
-     * into the corresponding pixmap.
+     * into the corresponding tile image.
      *
      * \param position  Offset into m_buffer, in bytes
 
@@ -142,18 +188,25 @@ private:
     int windowPixelOffset(qint64 positionOffset) const;
 
     /*
-     * Paint all tiles which can be painted.
+     * Append data up to _dataLength to the peak pyramid.
+     */
+    void updatePeaks();
+
+    /*
+     * Request rendering of all tiles which can be painted and have no
+     * render in flight.
      * \return true iff update() was called
      */
     bool paintTiles();
 
     /*
-     * Paint the specified tile
+     * Send the specified tile to the render thread
      *
      * \pre Sufficient data is available to completely paint the tile, i.e.
      *      m_dataLength is greater than the upper bound of the tile.
+     * \return true iff the tile was painted blank immediately
      */
-    void paintTile(int index);
+    bool paintTile(int index);
 
     /*
      * Move the first n tiles to the end of the array, and mark them as not
@@ -168,6 +221,9 @@ private:
 
 private:
     QByteArray              _buffer;             // блок аудио-данных
+    RingBuffer::Reader      _reader;             // курсор кольцевого буфера записи (если задан, _buffer не используется)
+    QByteArray              _readData;           // данные, скопированные из кольцевого буфера для _peaks
+    PeakPyramid             _peaks;              // min/max отображаемых данных, кадры
     qint64                  _dataLength;         // размер реально записанных данных в массиве _buffer (не равен _buffer.size(), т.к. память под _buffer выделяется заранее и первые _dataLength байт содержат данные, а далее идут нули)
 
     qint64                  m_audioPosition;
@@ -175,15 +231,22 @@ private:
 
     bool                    m_active;
 
-    QSize                   m_pixmapSize;
-    QVector<QPixmap*>       m_pixmaps;
+    QSize                   m_tileSize;
 
     struct Tile {
-        // Pointer into parent m_pixmaps array
-        QPixmap*            pixmap;
+        Tile() : id(0), painted(false), inFlight(-1) { }
+
+        // Identifies the tile while it moves through the array
+        quint64             id;
+
+        // Rendered image of the tile
+        QImage              image;
 
         // Flag indicating whether this tile has been painted
         bool                painted;
+
+        // Position of the tile render in flight, -1 if none
+        qint64              inFlight;
     };
 
     QVector<Tile>           m_tiles;
@@ -196,6 +259,15 @@ private:
 
     qint64                  m_windowPosition;
     qint64                  m_windowLength;
+
+    // Incremented whenever tile images of pending renders become unusable
+    quint64                 m_tileGeneration;
+
+    // Id of the next tile created by initialize(); never reset
+    quint64                 m_nextTileId;
+
+    QThread                 m_renderThread;
+    WaveformTileRenderer*   m_renderer;
 };
 
 #endif // WAVEFORM_H
@@ -15,6 +15,7 @@
 WavFileReader::WavFileReader(QObject *parent)
     : QFile(parent)
     , _headerLength(0)
+    , _dataLength(0)
 {
 
 }
@@ -33,51 +34,92 @@ qint64 WavFileReader::headerLength() const {
   return _headerLength;
 }
 
+qint64 WavFileReader::dataLength() const {
+  return _dataLength;
+}
+
+QByteArray WavFileReader::readAll() {
+  return read(qMax(qint64(0), _headerLength + _dataLength - pos()));
+}
+
+uchar *WavFileReader::mapData(qint64 offset, qint64 *length) {
+  *length = qBound(qint64(0), *length, _dataLength - offset);
+  if (offset < 0 || *length <= 0)
+    return nullptr;
+  return map(_headerLength + offset, *length);
+}
+
 bool WavFileReader::readHeader() {
     seek(0);
-    CombinedHeader header;
-    bool result = read(reinterpret_cast<char *>(&header), sizeof(CombinedHeader)) == sizeof(CombinedHeader);
-    if (result) {
-        if ((memcmp(&header.riff.descriptor.id, "RIFF", 4) == 0
-            || memcmp(&header.riff.descriptor.id, "RIFX", 4) == 0)
-            && memcmp(&header.riff.type, "WAVE", 4) == 0
-            && memcmp(&header.wave.descriptor.id, "fmt ", 4) == 0
-            && (header.wave.audioFormat == 1 || header.wave.audioFormat == 0)) {
-
-            // Read off remaining header information
-            if (qFromLittleEndian<quint32>(header.wave.descriptor.size) > sizeof(WAVEHeader)) {
-                // Extended data available
-                quint16 extraFormatBytes;
-                if (peek((char*)&extraFormatBytes, sizeof(quint16)) != sizeof(quint16))
-                    return false;
-                const qint64 throwAwayBytes = sizeof(quint16) + qFromLittleEndian<quint16>(extraFormatBytes);
-                if (read(throwAwayBytes).size() != throwAwayBytes)
-                    return false;
-            }
+    const bool result = readHeader(*this, _format, _dataLength);
+    _headerLength = pos();
+    qDebug() << "read" << _format << "data at" << _headerLength << "length" << _dataLength;
+    return result;
+}
+
+bool WavFileReader::readHeader(QIODevice &device, QAudioFormat &format, qint64 &dataLength) {
+    RIFFHeader riff;
+    if (device.read(reinterpret_cast<char *>(&riff), sizeof(RIFFHeader)) != sizeof(RIFFHeader))
+        return false;
+    const bool bigEndian = memcmp(&riff.descriptor.id, "RIFX", 4) == 0;
+    if ((memcmp(&riff.descriptor.id, "RIFF", 4) != 0 && !bigEndian)
+        || memcmp(&riff.type, "WAVE", 4) != 0)
+        return false;
+
+    bool haveFormat = false;
+    forever {
+        chunk descriptor;
+        if (device.read(reinterpret_cast<char *>(&descriptor), sizeof(chunk)) != sizeof(chunk))
+            return false;
+        const qint64 size = bigEndian ? qFromBigEndian<quint32>(descriptor.size)
+                                      : qFromLittleEndian<quint32>(descriptor.size);
+
+        if (memcmp(&descriptor.id, "data", 4) == 0) {
+            if (!haveFormat)
+                return false;
+            // размер 0 или 0xFFFFFFFF пишут при записи потока - данные до конца файла
+            const qint64 rest = device.isSequential() ? size : device.size() - device.pos();
+            dataLength = (size == 0 || size == 0xFFFFFFFF || size > rest) ? rest : size;
+            return true;
+        }
+
+        if (memcmp(&descriptor.id, "fmt ", 4) == 0) {
+            WAVEHeader wave;
+            const qint64 fieldsLength = sizeof(WAVEHeader) - sizeof(chunk);
+            if (size < fieldsLength
+                || device.read(reinterpret_cast<char *>(&wave) + sizeof(chunk), fieldsLength) != fieldsLength)
+                return false;
+            const quint16 audioFormat = qFromLittleEndian<quint16>(wave.audioFormat);
+            // PCM или WAVE_FORMAT_EXTENSIBLE (подформат не проверяется)
+            if (audioFormat != 1 && audioFormat != 0 && audioFormat != 0xFFFE)
+                return false;
 
             // Establish format
-            if (memcmp(&header.riff.descriptor.id, "RIFF", 4) == 0)
-                _format.setByteOrder(QAudioFormat::LittleEndian);
-            else
-                _format.setByteOrder(QAudioFormat::BigEndian);
-
-            int bps = qFromLittleEndian<quint16>(header.wave.bitsPerSample);
-            _format.setChannelCount(qFromLittleEndian<quint16>(header.wave.numChannels));
-            _format.setCodec("audio/pcm");
-            _format.setSampleRate(qFromLittleEndian<quint32>(header.wave.sampleRate));
-            _format.setSampleSize(qFromLittleEndian<quint16>(header.wave.bitsPerSample));
-            _format.setSampleType(bps == 8 ? QAudioFormat::UnSignedInt : QAudioFormat::SignedInt);
-        } else {
-            result = false;
+            format.setByteOrder(bigEndian ? QAudioFormat::BigEndian : QAudioFormat::LittleEndian);
+            const int bps = qFromLittleEndian<quint16>(wave.bitsPerSample);
+            format.setChannelCount(qFromLittleEndian<quint16>(wave.numChannels));
+            format.setCodec("audio/pcm");
+            format.setSampleRate(qFromLittleEndian<quint32>(wave.sampleRate));
+            format.setSampleSize(bps);
+            format.setSampleType(bps == 8 ? QAudioFormat::UnSignedInt : QAudioFormat::SignedInt);
+            haveFormat = true;
+
+            // остаток расширенного заголовка и выравнивание chunk-а
+            const qint64 skip = size - fieldsLength + (size & 1);
+            if (skip && device.read(skip).size() != skip)
+                return false;
+            continue;
+        }
+
+        // LIST, fact, cue и прочие chunk-и пропускаются; chunk-и выровнены на 2 байта
+        const qint64 skip = size + (size & 1);
+        if (device.isSequential()) {
+            if (device.read(skip).size() != skip)
+                return false;
+        } else if (!device.seek(device.pos() + skip)) {
+            return false;
         }
     }
-    _headerLength = pos();
-    qDebug() << "read"
-             << header.riff.descriptor.id << header.riff.descriptor.size << header.riff.type
-             << header.wave.descriptor.id << header.wave.descriptor.size << header.wave.audioFormat << header.wave.numChannels << header.wave.sampleRate << header.wave.byteRate << header.wave.blockAlign << header.wave.bitsPerSample
-             << header.data.descriptor.id << header.data.descriptor.size;
-    qDebug() << "read" << _format;
-    return result;
 }
 
 // WaveFileWriter
@@ -49,6 +49,8 @@ struct CombinedHeader
 static const int HeaderLength = sizeof(CombinedHeader);
 
 // Чтение из файла
+// Заголовок разбирается по chunk-ам, поэтому LIST, fact и другие chunk-и
+// перед "data", а также расширенный "fmt " не мешают найти данные
 class WavFileReader : public QFile
 {
   Q_OBJECT
@@ -58,7 +60,30 @@ public:
   using QFile::open;
   bool open(const QString &fileName);
   const QAudioFormat &audioFormat() const;
+  // смещение данных от начала файла
   qint64 headerLength() const;
+  // размер данных (без chunk-ов после "data")
+  qint64 dataLength() const;
+
+  // прочитать остаток данных, не заходя за конец chunk-а "data"
+  QByteArray readAll();
+
+  /**
+   * @brief Отобразить участок данных в память
+   * @param offset [вх] смещение от начала данных
+   * @param length [вх/вых] желаемый размер / размер участка
+   * @return указатель или nullptr; освобождается unmap()
+   */
+  uchar *mapData(qint64 offset, qint64 *length);
+
+  /**
+   * @brief Разобрать заголовок WAV
+   * @param device     [вх] устройство, позиционированное на начало файла;
+   *                   после успешного разбора - на начале данных
+   * @param format     [вых] формат
+   * @param dataLength [вых] размер данных
+   */
+  static bool readHeader(QIODevice &device, QAudioFormat &format, qint64 &dataLength);
 
 private:
   bool readHeader();
@@ -66,6 +91,7 @@ private:
 private:
   QAudioFormat  _format;
   qint64        _headerLength;
+  qint64        _dataLength;
 };
 
 // Запись в файл
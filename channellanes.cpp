@@ -0,0 +1,240 @@
+#include "channellanes.h"
+#include <QMetaObject>
+#include "audio/samplekernels.h"
+#include "lbnt/CStreamingRecognizer.h"
+
+ChannelLaneWorker::ChannelLaneWorker(int lane, VoiceSplitter *splitter, Resampler *resampler) :
+  QObject(nullptr),
+  _lane(lane),
+  _splitter(splitter),
+  _resampler(resampler),
+  _sourcePosition(-1),
+  _position(0),
+  _captureNs(0)
+{
+  // splitter выделяет фрагменты в addBlock, в потоке полосы
+  connect(_splitter, SIGNAL(voiceFragmentAt(qint64,QByteArray)),
+          this, SLOT(splitterFragment(qint64,QByteArray)), Qt::DirectConnection);
+}
+
+ChannelLaneWorker::~ChannelLaneWorker()
+{
+  delete _resampler;
+}
+
+void ChannelLaneWorker::addSourceBlock(const AudioBlock &block)
+{
+  const int channels = _sourceLanes.size();
+  if (channels <= 0)
+    return;
+  if (channels == 1) {
+    addChannel(block);
+    return;
+  }
+  const int frameCount = block.frameCount();
+  if (frameCount <= 0)
+    return;
+
+  // каждый канал - в собственный буфер, который уходит в поток полосы
+  QVector<QByteArray> data(channels);
+  QVector<qint16 *> outputs(channels);
+  for (int channel = 0; channel < channels; ++channel) {
+    data[channel] = QByteArray(frameCount * int(sizeof(qint16)), Qt::Uninitialized);
+    outputs[channel] = reinterpret_cast<qint16 *>(data[channel].data());
+  }
+  deinterleaveChannels(reinterpret_cast<const qint16 *>(block.data.constData()), frameCount, channels,
+                       outputs.constData());
+
+  // полосы того же потока обрабатываются сразу, остальные - очередью
+  for (int channel = 0; channel < channels; ++channel)
+    QMetaObject::invokeMethod(_sourceLanes.at(channel), "addChannel", Qt::AutoConnection,
+                              Q_ARG(AudioBlock, AudioBlock(block.position, int(sizeof(qint16)),
+                                                           data.at(channel), block.captureNs)));
+}
+
+void ChannelLaneWorker::addChannel(const AudioBlock &block)
+{
+  // после пропуска данных источника преобразование частоты начинается
+  // заново с семпла полосы, соответствующего началу блока
+  if (block.position != _sourcePosition) {
+    _resampler->reset();
+    _position = block.position * _resampler->outputRate() / _resampler->inputRate();
+  }
+  _sourcePosition = block.endPosition();
+
+  // преобразование частоты дешевле выделения и декодирования: по
+  // скалярному произведению длины taps() на выходной семпл
+  const QByteArray resampled = _resampler->process(block.data);
+  if (resampled.isEmpty())
+    return;
+  _captureNs = block.captureNs;
+  const AudioBlock laneData(_position, int(sizeof(qint16)), resampled, block.captureNs);
+  // splitter выдаёт фрагменты из addBlock, они отсчитываются от конца блока
+  _position = laneData.endPosition();
+  _splitter->addBlock(laneData.position, resampled);
+  emit laneBlock(laneData);
+}
+
+void ChannelLaneWorker::splitterFragment(qint64 position, const QByteArray &fragment)
+{
+  // фрагмент заканчивается в уже переданных данных: время записи его
+  // конца отсчитывается назад от конца последнего блока
+  qint64 captureNs = 0;
+  if (_captureNs) {
+    const qint64 end = position + fragment.size() / int(sizeof(qint16));
+    captureNs = _captureNs - (_position - end) * 1000000000 / _resampler->outputRate();
+  }
+  emit voiceFragment(_lane, position, fragment, captureNs);
+}
+
+ChannelLanes::ChannelLanes(const QList<QAudioFormat> &sources, const AudioFormat &format,
+                           const VoiceSplitter::Params &params, CSpeechRecog *speech,
+                           int threads, QObject *parent) :
+  QObject(parent)
+{
+  for (int source = 0; source < sources.size(); ++source) {
+    _firstLane.append(_lanes.size());
+    for (int channel = 0; channel < sources.at(source).channelCount(); ++channel) {
+      Lane lane;
+      lane.source = source;
+      lane.channel = channel;
+      lane.splitter = nullptr;
+      lane.streaming = nullptr;
+      lane.worker = nullptr;
+      lane.fragments = 0;
+      _lanes.append(lane);
+    }
+  }
+
+  if (threads <= 0)
+    threads = QThread::idealThreadCount();
+  threads = qBound(1, threads, qMax(_lanes.size(), 1));
+  for (int i = 0; i < threads; ++i) {
+    QThread *thread = new QThread(this);
+    thread->start();
+    _threads.append(thread);
+  }
+
+  for (int i = 0; i < _lanes.size(); ++i) {
+    Lane &lane = _lanes[i];
+    QThread *thread = _threads.at(i % _threads.size());
+    lane.splitter = new VoiceSplitter(format, params);
+    if (speech) {
+      lane.streaming = new CStreamingRecognizer(speech, thread);
+      lane.streaming->connectSource(lane.splitter);
+      _laneOf.insert(lane.streaming, i);
+      connect(lane.streaming, SIGNAL(partialHypothesis(QString)), this, SLOT(streamPartial(QString)));
+      connect(lane.streaming, SIGNAL(recognized(qint64,CRecognitionResult,qint64)),
+              this, SLOT(streamRecognized(qint64,CRecognitionResult,qint64)));
+      // до первого блока, поэтому ещё из потока создания
+      lane.splitter->setStreaming(true);
+    }
+    lane.splitter->moveToThread(thread);
+
+    lane.worker = new ChannelLaneWorker(i, lane.splitter,
+                                        new Resampler(sources.at(lane.source).sampleRate(), format.samplingRate));
+    connect(lane.worker, SIGNAL(voiceFragment(int,qint64,QByteArray,qint64)),
+            this, SLOT(laneFragment(int,qint64,QByteArray,qint64)), Qt::QueuedConnection);
+  }
+
+  for (int source = 0; source < _firstLane.size(); ++source) {
+    QVector<ChannelLaneWorker *> workers;
+    for (int channel = 0; channel < sources.at(source).channelCount(); ++channel)
+      workers.append(_lanes.at(lane(source, channel)).worker);
+    if (!workers.isEmpty())
+      workers.first()->setSourceLanes(workers);
+  }
+  for (int i = 0; i < _lanes.size(); ++i)
+    _lanes.at(i).worker->moveToThread(_threads.at(i % _threads.size()));
+}
+
+ChannelLanes::~ChannelLanes()
+{
+  stop();
+  for (int i = 0; i < _lanes.size(); ++i) {
+    delete _lanes.at(i).worker;
+    delete _lanes.at(i).streaming;
+    delete _lanes.at(i).splitter;
+  }
+}
+
+int ChannelLanes::lane(int source, int channel) const
+{
+  return _firstLane.at(source) + channel;
+}
+
+void ChannelLanes::setParams(const VoiceSplitter::Params &params)
+{
+  for (int i = 0; i < _lanes.size(); ++i)
+    _lanes.at(i).splitter->setParams(params);
+}
+
+bool ChannelLanes::connectLane(int lane, QObject *receiver, const char *slot)
+{
+  if (lane < 0 || lane >= _lanes.size())
+    return false;
+  return connect(_lanes.at(lane).worker, SIGNAL(laneBlock(AudioBlock)), receiver, slot, Qt::QueuedConnection);
+}
+
+void ChannelLanes::stop()
+{
+  foreach (QThread *thread, _threads) {
+    thread->quit();
+    thread->wait();
+  }
+}
+
+void ChannelLanes::addBlock(int source, const AudioBlock &block)
+{
+  if (source < 0 || source >= _firstLane.size())
+    return;
+  const int first = _firstLane.at(source);
+  const int last = source + 1 < _firstLane.size() ? _firstLane.at(source + 1) : _lanes.size();
+  const int channels = last - first;
+  if (channels <= 0 || block.frameCount() <= 0 || block.frameSize != channels * int(sizeof(qint16)))
+    return;
+
+  // данные блока действительны только внутри вызова: копия уходит в
+  // поток первой полосы источника, там блок разделяется на каналы
+  QMetaObject::invokeMethod(_lanes.at(first).worker, "addSourceBlock", Qt::QueuedConnection,
+                            Q_ARG(AudioBlock, block.detached()));
+}
+
+void ChannelLanes::laneFragment(int lane, qint64 position, const QByteArray &fragment, qint64 captureNs)
+{
+  Lane &state = _lanes[lane];
+  const quint64 id = makeId(lane, state.fragments++);
+  if (state.streaming) {
+    // фрагменты без результата (декодер не был готов, нет активации)
+    // не копятся
+    state.pending.insert(position, id);
+    while (state.pending.size() > MaxPending)
+      state.pending.erase(state.pending.begin());
+  }
+  emit voiceFragment(lane, id, position, fragment, captureNs);
+}
+
+void ChannelLanes::streamPartial(const QString &hypothesis)
+{
+  const int lane = _laneOf.value(sender(), -1);
+  if (lane >= 0)
+    emit partialHypothesis(lane, hypothesis);
+}
+
+void ChannelLanes::streamRecognized(qint64 position, const CRecognitionResult &result, qint64 endLatencyMs)
+{
+  // задержка результата уже в гистограмме stream.endToHypothesis
+  Q_UNUSED(endLatencyMs);
+  const int lane = _laneOf.value(sender(), -1);
+  if (lane < 0)
+    return;
+  // voiceFragmentAt выдаётся раньше конца потока фрагмента, поэтому
+  // номер уже есть; более ранние фрагменты результата не получат
+  QMap<qint64, quint64> &pending = _lanes[lane].pending;
+  if (!pending.contains(position))
+    return;
+  const quint64 id = pending.value(position);
+  while (!pending.isEmpty() && pending.firstKey() <= position)
+    pending.erase(pending.begin());
+  emit recognized(lane, id, result);
+}
@@ -0,0 +1,171 @@
+/**
+ * @brief   Выделение и распознавание фрагментов по каналам записи
+ * @file    channellanes.h
+ *
+ * Каждый канал каждого источника (устройства записи) - отдельная полоса:
+ * свой VoiceSplitter и, в потоковом режиме, свой CStreamingRecognizer.
+ * Полосы работают на общих рабочих потоках (полоса i - на потоке
+ * i % threads): блок источника копируется в поток его первой полосы и
+ * разделяется там на каналы (deinterleaveChannels), каждая полоса в своём
+ * потоке приводит канал к частоте декодера (Resampler). Обработка
+ * масштабируется по ядрам, а поток интерфейса не ждёт ни разделения, ни
+ * преобразования частоты, ни выделения, ни декодирования.
+ *
+ * Номер фрагмента содержит номер полосы в старших битах (laneOf()),
+ * младшие - порядковый номер фрагмента полосы. Номера выдаются только
+ * здесь: результат CStreamingRecognizer сопоставляется с фрагментом по
+ * его началу. Позиции фрагментов и блоков полосы - в семплах после
+ * преобразования частоты; они пересчитываются из позиций блоков
+ * источника (AudioBlock::position), поэтому пропуск данных (переполнение
+ * кольцевого буфера) их не сдвигает.
+ */
+
+#ifndef CHANNELLANES_H
+#define CHANNELLANES_H
+
+#include <QAudioFormat>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QThread>
+#include <QVector>
+#include "audio/audioblock.h"
+#include "audio/resampler.h"
+#include "citis/AudioFormat.h"
+#include "citis/VoiceSplitter.h"
+#include "lbnt/CRecognitionResult.h"
+
+class CSpeechRecog;
+class CStreamingRecognizer;
+
+/**
+ * @brief Обработка звука полосы в её рабочем потоке
+ *
+ * Рабочий объект первой полосы источника разделяет блоки источника на
+ * каналы и раздаёт их рабочим объектам полос источника.
+ */
+class ChannelLaneWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    // resampler переходит во владение рабочего объекта
+    ChannelLaneWorker(int lane, VoiceSplitter *splitter, Resampler *resampler);
+    ~ChannelLaneWorker();
+
+    // Полосы источника по каналам (только у первой полосы источника)
+    void setSourceLanes(const QVector<ChannelLaneWorker *> &lanes) { _sourceLanes = lanes; }
+
+public slots:
+    // Блок источника, чередующиеся каналы (владеет памятью)
+    void addSourceBlock(const AudioBlock &block);
+    // Канал полосы на частоте источника (моно)
+    void addChannel(const AudioBlock &block);
+
+signals:
+    // Данные полосы (моно, частота декодера); выдаётся в потоке полосы
+    void laneBlock(const AudioBlock &block);
+    // Фрагмент splitter; captureNs - оценка времени записи (Metrics::now())
+    // последнего семпла фрагмента
+    void voiceFragment(int lane, qint64 position, const QByteArray &fragment, qint64 captureNs);
+
+private slots:
+    void splitterFragment(qint64 position, const QByteArray &fragment);
+
+private:
+    int _lane;
+    VoiceSplitter *_splitter;
+    Resampler *_resampler;
+    qint64 _sourcePosition;                    // ожидаемое начало следующего блока источника; -1 - блоков не было
+    qint64 _position;                          // следующий семпл полосы
+    qint64 _captureNs;                         // время записи последнего семпла, переданного в splitter
+    QVector<ChannelLaneWorker *> _sourceLanes;
+};
+
+class ChannelLanes : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int LaneShift = 48;
+
+    /**
+     * @param sources        [вх] формат записи каждого источника (16 бит, любая частота)
+     * @param format         [вх] формат полосы (моно, частота декодера)
+     * @param params         [вх] параметры выделения фрагментов
+     * @param speech         [вх] распознаватель для потокового режима; nullptr - без распознавания
+     * @param threads        [вх] рабочих потоков; 0 - по числу ядер (не больше числа полос)
+     *
+     * В потоковом режиме полоса занимает декодер пула speech без ожидания
+     * (см. CStreamingRecognizer): при занятых декодерах общий поток не
+     * блокируется, а фрагмент распознаётся, когда декодер освободится
+     */
+    ChannelLanes(const QList<QAudioFormat> &sources, const AudioFormat &format,
+                 const VoiceSplitter::Params &params, CSpeechRecog *speech,
+                 int threads = 0, QObject *parent = 0);
+    ~ChannelLanes();
+
+    int laneCount() const { return _lanes.size(); }
+    // полоса канала channel источника source
+    int lane(int source, int channel) const;
+    static int laneOf(quint64 id) { return int(id >> LaneShift); }
+
+    VoiceSplitter *splitter(int lane) const { return _lanes.at(lane).splitter; }
+    // nullptr - без потокового распознавания
+    CStreamingRecognizer *streamingRecognizer(int lane) const { return _lanes.at(lane).streaming; }
+
+    // Задать параметры выделения всех полос (из любого потока)
+    void setParams(const VoiceSplitter::Params &params);
+
+    // Передавать данные полосы lane (владеют памятью, моно) в слот
+    // slot(const AudioBlock &) объекта receiver очередью из потока
+    // полосы, минуя поток интерфейса
+    bool connectLane(int lane, QObject *receiver, const char *slot);
+
+    // Остановить рабочие потоки (необработанные блоки отбрасываются)
+    void stop();
+
+public slots:
+    // Блок источника source (данные действительны только внутри вызова;
+    // в вызове - только копирование)
+    void addBlock(int source, const AudioBlock &block);
+
+signals:
+    // Выделен фрагмент полосы lane; captureNs - время записи (Metrics::now())
+    // его последнего семпла, 0 - неизвестно
+    void voiceFragment(int lane, quint64 id, qint64 position, const QByteArray &fragment, qint64 captureNs);
+    // Частичная гипотеза открытого фрагмента полосы lane
+    void partialHypothesis(int lane, const QString &hypothesis);
+    // Фрагмент распознан в потоковом режиме
+    void recognized(int lane, quint64 id, const CRecognitionResult &result);
+
+private slots:
+    void laneFragment(int lane, qint64 position, const QByteArray &fragment, qint64 captureNs);
+    void streamPartial(const QString &hypothesis);
+    void streamRecognized(qint64 position, const CRecognitionResult &result, qint64 endLatencyMs);
+
+private:
+    struct Lane
+    {
+        int source;
+        int channel;
+        VoiceSplitter *splitter;
+        CStreamingRecognizer *streaming;
+        ChannelLaneWorker *worker;
+        quint64 fragments;   // выделено фрагментов
+        QMap<qint64, quint64> pending;  // начало -> номер фрагментов, ждущих потокового результата
+    };
+
+    static const int MaxPending = 64;
+
+    static quint64 makeId(int lane, quint64 number) { return (quint64(lane) << LaneShift) | number; }
+
+    QVector<Lane> _lanes;
+    QVector<int> _firstLane;            // первая полоса источника
+    QHash<QObject *, int> _laneOf;      // streaming -> полоса
+    QVector<QThread *> _threads;
+};
+
+#endif // CHANNELLANES_H
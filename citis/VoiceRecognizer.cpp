@@ -1,26 +1,31 @@
-#include <QFile>
 #include <QDebug>
-#include <pocketsphinx.h>
 #include "AudioFormat.h"
+#include "../lbnt/CSpeechRecog.h"
 #include "VoiceRecognizer.h"
 
+// Синхронная обёртка над CSpeechRecog с одним декодером: декодирование
+// и пул - те же, что у остальной программы
 class VoiceRecognizerPrivate
 {
 public:
     AudioFormat format;
-    ps_decoder_t* ps;
-    cmd_ln_t* config;
+    CSpeechRecog speech;
 
     VoiceRecognizerPrivate():
-        ps(NULL), config(NULL)
+        speech(QString(), QString(), QString())
     {
+        speech.setDecoderCount(1);
     }
 };
 
 
-VoiceRecognizer::VoiceRecognizer():
+VoiceRecognizer::VoiceRecognizer(CDecoderBackend* backend):
     d_ptr(new VoiceRecognizerPrivate)
 {
+    if (backend != NULL)
+    {
+        d_ptr->speech.setBackend(backend);
+    }
 }
 
 VoiceRecognizer::~VoiceRecognizer()
@@ -32,7 +37,7 @@ VoiceRecognizer::~VoiceRecognizer()
 bool VoiceRecognizer::init(const AudioFormat& format, const QString& hmmPath,
                            const QString& lmPath, const QString& dictPath)
 {
-    if (d_ptr->config != NULL)
+    if (isInit())
     {
         qDebug() << "already initialized!";
         return false;
@@ -41,21 +46,13 @@ bool VoiceRecognizer::init(const AudioFormat& format, const QString& hmmPath,
     // to stop spamming into stdout
 //    err_set_logfile("/dev/null");
 
-    d_ptr->config = cmd_ln_init(NULL, ps_args(), TRUE,
-                                "-hmm", hmmPath.toStdString().c_str(),
-                                "-lm", lmPath.toStdString().c_str(),
-                                "-dict", dictPath.toStdString().c_str(),
-                                NULL);
-    if (d_ptr->config == NULL)
-    {
-        qDebug() << "failed to initialize config";
-        return false;
-    }
-
-    d_ptr->ps = ps_init(d_ptr->config);
-    if (d_ptr->ps == NULL)
+    d_ptr->speech.setHmm(hmmPath);
+    d_ptr->speech.setLM(lmPath);
+    d_ptr->speech.setDict(dictPath);
+    d_ptr->speech.setSampleRate(format.samplingRate);
+    d_ptr->speech.init();
+    if (!d_ptr->speech.waitForInit())
     {
-        d_ptr->config = NULL;
         qDebug() << "failed to initialize voice recognition";
         return false;
     }
@@ -67,60 +64,61 @@ bool VoiceRecognizer::init(const AudioFormat& format, const QString& hmmPath,
 
 void VoiceRecognizer::free()
 {
-    ps_free(d_ptr->ps);
-    d_ptr->ps = NULL;
-    // we don't need to free config
-    d_ptr->config = NULL;
+    // декодер возвращается бэкенду (в кэш моделей)
+    d_ptr->speech.free();
 }
 
 bool VoiceRecognizer::isInit() const
 {
-    return d_ptr->ps != NULL;
+    return d_ptr->speech.isInit();
 }
 
 bool VoiceRecognizer::recognize(const QByteArray& fragment, QString& hypothesis, int* score)
 {
-    int res = ps_start_utt(d_ptr->ps);
-    if (res < 0)
+    if (!isInit())
     {
-        qDebug() << "Error while recognizing data: ps_start_utt";
+        qDebug() << "Error while recognizing data: not initialized";
         return false;
     }
 
-    res = ps_process_raw(d_ptr->ps,
-                         reinterpret_cast<const AudioFormat::sampleType*>(fragment.constData()),
-                         fragment.size() / AudioFormat::sampleSize, FALSE, TRUE);
-    if (res < 0)
+    QString resHypothesis;
+    int resScore = 0;
+    d_ptr->speech.decodeRaw(fragment, resHypothesis, resScore);
+    if (resHypothesis.isEmpty())
     {
-        qDebug() << "Error while recognizing data: ps_process_raw";
+        qDebug() << "Error while getting hypothesis";
         return false;
     }
 
-    res = ps_end_utt(d_ptr->ps);
-    if (res < 0)
+    hypothesis = resHypothesis;
+
+    if (score)
     {
-        qDebug() << "Error while recognizing data: ps_end_utt";
-        return false;
+        *score = resScore;
     }
 
+    return true;
+}
 
-    int32 resScore = 0;
-    char const* resHypothesis = NULL;
-    char const* uttid = NULL;
-
-    resHypothesis = ps_get_hyp(d_ptr->ps, &resScore);
-    if (resHypothesis == NULL)
+bool VoiceRecognizer::recognize(const QByteArray& fragment, CRecognitionResult& result, int nbestSize)
+{
+    if (!isInit())
     {
-        qDebug() << "Error while getting hypothesis";
+        qDebug() << "Error while recognizing data: not initialized";
         return false;
     }
 
-    hypothesis = QString::fromUtf8(resHypothesis);
-
-    if (score)
+    // все данные берутся из декодера после конца фразы, повторно фраза не декодируется
+    CRecognitionResult resResult;
+    d_ptr->speech.setNBestSize(nbestSize);
+    d_ptr->speech.decodeRaw(fragment, resResult);
+    if (resResult.isEmpty())
     {
-        *score = resScore;
+        qDebug() << "Error while getting hypothesis";
+        return false;
     }
 
+    result = resResult;
+
     return true;
 }
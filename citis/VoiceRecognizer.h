@@ -4,6 +4,8 @@
 #include <QThread>
 
 struct AudioFormat;
+struct CRecognitionResult;
+class CDecoderBackend;
 
 class VoiceRecognizerPrivate;
 
@@ -14,7 +16,9 @@ class VoiceRecognizer: public QObject
     Q_DECLARE_PRIVATE(VoiceRecognizer)
 
 public:
-    VoiceRecognizer();
+    // backend - фабрика декодеров (становится собственностью распознавателя);
+    // NULL - pocketsphinx
+    explicit VoiceRecognizer(CDecoderBackend* backend = NULL);
     ~VoiceRecognizer();
 
     bool init(const AudioFormat& format, const QString& hmmPath,
@@ -23,7 +27,10 @@ public:
 
     bool isInit() const;
 
+    // false - ошибка декодирования или декодер не выдал гипотезы
     bool recognize(const QByteArray& fragment, QString& hypothesis, int* score = NULL);
+    // гипотеза с уверенностью, границами слов и не более nbestSize альтернатив
+    bool recognize(const QByteArray& fragment, CRecognitionResult& result, int nbestSize = 5);
 
 private:
     VoiceRecognizerPrivate* d_ptr;
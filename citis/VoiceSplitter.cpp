@@ -1,116 +1,470 @@
 #include <limits>
+#include <math.h>
+#include <string.h>
+#include <QAtomicInteger>
+#include <QVector>
+#include <QFileInfo>
 #include <QIODevice>
+#include <QMutex>
+#include <QSettings>
 #include <QTimer>
 #include <QCoreApplication>
+#include "../audio/metrics.h"
+#include "../audio/samplekernels.h"
 #include "AudioFormat.h"
 #include "VoiceSplitter.h"
 
 class VoiceSplitterPrivate
 {
 public:
-    // минимальная длина фрагмента (слова) в мс
-    static const quint32 FRAGMENT_MIN_LENGTH_MS = 400;
-
-    // "запас" тишины до слова в мс
-    static const quint32 FRAGMENT_MARGIN_BEFORE_MS = 400;
-
-    // "запас" тишины после слова в мс
-    static const quint32 FRAGMENT_MARGIN_AFTER_MS = 400;
-
-    // максимальная продолжительность "тишины" внутри фрагмента
-    static const quint32 FRAGMENT_MAX_SILENCE_LENGTH_MS = 400;
-
-    // уровень при котором звук будет восприниматься как тишина, %
-    static const quint32 SILENCE_MAX_VALUE = 10;
-
-    // длительность тишины, при которой будет происходить очистка буфера от переполнения, мс
-    static const quint32 SILENCE_MAX_LENGTH_MS = 2000;
-
-
-public:
-    VoiceSplitterPrivate(const AudioFormat& format_):
+    VoiceSplitterPrivate(const AudioFormat& format_, const VoiceSplitter::Params& params_):
         format(format_),
         self(NULL),
-        begin(NULL),
+        mask(0),
         peakStart(-1),
         index(0),
         lastImpulse(0),
-        samples(0),
         totalReaded(0),
         gstart(0),
-        maxSilenceValue(AudioFormat::maxValue * SILENCE_MAX_VALUE / 100),
-        minFragmentLength(format_.samplesInMilliseconds(FRAGMENT_MIN_LENGTH_MS)),
-        marginBefore(format_.samplesInMilliseconds(FRAGMENT_MARGIN_BEFORE_MS)),
-        marginAfter(format_.samplesInMilliseconds(FRAGMENT_MARGIN_AFTER_MS)),
-        maxFragmentSilenceLength(format_.samplesInMilliseconds(FRAGMENT_MAX_SILENCE_LENGTH_MS)),
-        maxSilenceLength(format.samplesInMilliseconds(SILENCE_MAX_LENGTH_MS))
+        noiseFloor(-1.0),
+        speechFrames(0),
+        lastSpeech(0),
+        streaming(false),
+        streamPosition(-1),
+        requested(params_),
+        changed(0)
+    {
+        applyParams(params_);
+        reserve(maxSilenceLength * 2);
+    }
+
+    // пересчитать параметры в семплы
+    inline void applyParams(const VoiceSplitter::Params& params_)
+    {
+        const bool restart = params_.mode != params.mode
+                || params_.vadFrameLengthMs != params.vadFrameLengthMs;
+
+        params = params_;
+        maxSilenceValue = AudioFormat::maxValue * qMin<quint32>(params.silenceMaxValue, 100) / 100;
+        minFragmentLength = format.samplesInMilliseconds(params.fragmentMinLengthMs);
+        marginBefore = format.samplesInMilliseconds(params.fragmentMarginBeforeMs);
+        marginAfter = format.samplesInMilliseconds(params.fragmentMarginAfterMs);
+        maxFragmentSilenceLength = format.samplesInMilliseconds(params.fragmentMaxSilenceLengthMs);
+        maxSilenceLength = format.samplesInMilliseconds(params.silenceMaxLengthMs);
+        frameLength = qMax<int>(format.samplesInMilliseconds(params.vadFrameLengthMs), 1);
+        frame.resize(frameLength);
+
+        // при смене режима поиск фрагмента начинается заново
+        if (restart)
+        {
+            closeStream(qMin(index, totalReaded), false);
+            peakStart = -1;
+            speechFrames = 0;
+            lastImpulse = 0;
+        }
+    }
+
+    // принять параметры, заданные setParams() (между блоками)
+    inline void takeParams()
+    {
+        VoiceSplitter::Params params_;
+        {
+            QMutexLocker locker(&mutex);
+            params_ = requested;
+            changed.storeRelease(0);
+        }
+        applyParams(params_);
+    }
+
+    // семпл по абсолютной позиции
+    inline AudioFormat::sampleType sample(qint64 position) const
     {
-        buff.reserve(maxSilenceLength * AudioFormat::sampleSize);
+        return buff[position & mask];
+    }
+
+    // скопировать семплы [from, to) в непрерывный массив
+    inline void copy(qint64 from, qint64 to, AudioFormat::sampleType* dest) const
+    {
+        while (from < to)
+        {
+            const int offset = from & mask;
+            const int count = qMin<qint64>(to - from, buff.size() - offset);
+            memcpy(dest, buff.constData() + offset, count * AudioFormat::sampleSize);
+            dest += count;
+            from += count;
+        }
+    }
+
+    // записать count семплов, начиная с абсолютной позиции position
+    inline void place(qint64 position, const AudioFormat::sampleType* src, int count)
+    {
+        while (count > 0)
+        {
+            const int offset = position & mask;
+            const int n = qMin(count, buff.size() - offset);
+            memcpy(buff.data() + offset, src, n * AudioFormat::sampleSize);
+            src += n;
+            position += n;
+            count -= n;
+        }
+    }
+
+    // обеспечить место под size семплов, начиная с gstart
+    inline void reserve(qint64 size)
+    {
+        if (size <= buff.size())
+            return;
+
+        int capacity = qMax(buff.size(), 1);
+        while (capacity < size)
+            capacity *= 2;
+
+        // данные раскладываются заново, т.к. меняется маска позиций
+        QVector<AudioFormat::sampleType> retained(totalReaded - gstart);
+        copy(gstart, totalReaded, retained.data());
+        buff.resize(capacity);
+        mask = capacity - 1;
+        place(gstart, retained.constData(), retained.size());
+    }
+
+    // фрагмент [start, end) как непрерывный блок байт
+    inline QByteArray slice(qint64 start, qint64 end) const
+    {
+        QByteArray fragment;
+        fragment.resize((end - start) * AudioFormat::sampleSize);
+        copy(start, end, reinterpret_cast<AudioFormat::sampleType*>(fragment.data()));
+        return fragment;
+    }
+
+    // разослать фрагмент [start, end)
+    inline void emitFragment(qint64 start, qint64 end)
+    {
+        const QByteArray fragment = slice(start, end);
+        emit self->voiceFragment(fragment);
+        emit self->voiceFragmentAt(start, fragment);
+    }
+
+    // задержка обнаружения: сколько звука (нс) получено после семпла position
+    inline qint64 audioDelayNs(qint64 position) const
+    {
+        return (totalReaded - position) * 1000000000 / (format.samplingRate * format.channels);
+    }
+
+    // начался фрагмент: открыть поток его данных
+    inline void openStream()
+    {
+        static LatencyHistogram *const startLatency = Metrics::instance().histogram("splitter.start");
+        startLatency->record(audioDelayNs(peakStart));
+        if (!streaming)
+            return;
+        streamPosition = qMax(peakStart - marginBefore, gstart);
+        emit self->fragmentStarted(streamPosition);
+    }
+
+    // передать данные открытого фрагмента до семпла to
+    inline void streamTo(qint64 to)
+    {
+        if (streamPosition == -1 || streamPosition >= to)
+            return;
+        emit self->fragmentData(slice(streamPosition, to));
+        streamPosition = to;
+    }
+
+    // наименьший возможный конец открытого фрагмента (с отступом): данные
+    // после него ещё могут оказаться тишиной за фрагментом
+    inline qint64 minFragmentEnd() const
+    {
+        const qint64 speechEnd = params.mode == VoiceSplitter::FrameMode ? lastSpeech : index - lastImpulse - 1;
+        return qMin(speechEnd + marginAfter, totalReaded);
+    }
+
+    // фрагмент закончился на семпле end; accepted - фрагмент выдан voiceFragment
+    inline void closeStream(qint64 end, bool accepted)
+    {
+        if (streamPosition == -1)
+            return;
+        if (accepted)
+            streamTo(end);
+        streamPosition = -1;
+        emit self->fragmentFinished(end, accepted);
+    }
+
+    // первый импульс (семпл громче порога тишины) в [from, to), to - если нет
+    inline qint64 findImpulse(qint64 from, qint64 to) const
+    {
+        while (from < to)
+        {
+            const int offset = from & mask;
+            const int count = qMin<qint64>(to - from, buff.size() - offset);
+            const int found = findFirstAboveThreshold(buff.constData() + offset, count, maxSilenceValue);
+            if (found < count)
+                return from + found;
+            from += count;
+        }
+        return to;
+    }
+
+    // последний импульс в [from, to), -1 - если нет
+    inline qint64 findLastImpulse(qint64 from, qint64 to) const
+    {
+        while (to > from)
+        {
+            const int end = ((to - 1) & mask) + 1;
+            const int count = qMin<qint64>(to - from, end);
+            const int found = findLastAboveThreshold(buff.constData() + end - count, count, maxSilenceValue);
+            if (found >= 0)
+                return to - count + found;
+            to -= count;
+        }
+        return -1;
+    }
+
+    // тишина [index, to): буфер очищается так же, как при
+    // посемпловом просмотре - каждые maxSilenceLength + 1 семплов
+    inline void skipSilence(qint64 to)
+    {
+        const qint64 step = maxSilenceLength + 1;
+        const qint64 first = qMax(index, gstart + step);
+        if (first < to)
+            gstart = first + (to - 1 - first) / step * step;
+        index = to;
+    }
+
+    // речь закончилась на семпле speechEnd: записать задержку обнаружения конца
+    inline void recordEnd(qint64 speechEnd) const
+    {
+        static LatencyHistogram *const endLatency = Metrics::instance().histogram("splitter.end");
+        endLatency->record(audioDelayNs(speechEnd));
+    }
+
+    // фрагмент закончился на семпле position
+    inline void finishFragment(qint64 position)
+    {
+        recordEnd(position - lastImpulse);
+
+        // конец фрагмента с отступом
+        const qint64 end = qMin(position - lastImpulse + marginAfter, totalReaded);
+
+        // длина фрагмента > минимальной
+        const bool accepted = (position - peakStart - lastImpulse) >= minFragmentLength;
+        if (accepted)
+        {
+            // начало фрагмента с отступом
+            const qint64 start = qMax(peakStart - marginBefore, gstart);
+
+            emitFragment(start, end);
+        }
+        closeStream(end, accepted);
+
+        // данные до конца фрагмента больше не нужны; просмотр
+        // продолжается с конца фрагмента
+        gstart = end;
+        index = end;
+        peakStart = -1;
+    }
+
+    // данные продолжаются с семпла position: после пропуска открытый
+    // фрагмент не выдаётся, просмотр начинается заново
+    inline void skipTo(qint64 position)
+    {
+        if (position == totalReaded)
+            return;
+        closeStream(qMin(index, totalReaded), false);
+        peakStart = -1;
+        speechFrames = 0;
+        lastImpulse = 0;
+        totalReaded = position;
+        gstart = position;
+        index = position;
     }
 
     inline void addBlock(const QByteArray& readed)
     {
-        buff.append(readed);
-        totalReaded += readed.size();
+        if (changed.loadAcquire())
+            takeParams();
+
+        const int count = readed.size() / AudioFormat::sampleSize;
+        if (count <= 0)
+            return;
+
+        reserve(totalReaded - gstart + count);
+        place(totalReaded, reinterpret_cast<const AudioFormat::sampleType*>(readed.constData()), count);
+        totalReaded += count;
 
-        begin = reinterpret_cast<const AudioFormat::sampleType*>(buff.constData());
-        samples = buff.size() / AudioFormat::sampleSize;
+        if (params.mode == VoiceSplitter::FrameMode)
+            scanFrames();
+        else
+            scanSamples();
+
+        // фрагмент продолжается - отдать полученные данные, не дожидаясь
+        // конца, но не дальше, чем он может закончиться
+        if (peakStart != -1)
+            streamTo(minFragmentEnd());
+    }
 
-        for (; index < samples; ++index)
+    // Посемпловый режим: фрагмент - участок, где модуль семплов превышает
+    // порог тишины с перерывами не длиннее maxFragmentSilenceLength
+    inline void scanSamples()
+    {
+        // Просмотр идёт не по семплам, а от границы к границе: в тишине -
+        // до следующего импульса, внутри фрагмента - до последнего импульса
+        // в окне, после которого фрагмент ещё не закончился
+        while (index < totalReaded)
         {
-            if (qAbs(begin[index]) > maxSilenceValue)
+            if (peakStart == -1)
+            {
+                const qint64 impulse = findImpulse(index, totalReaded);
+                skipSilence(impulse);
+                if (impulse == totalReaded)
+                    break;
+
+                // начало фрагмента
+                peakStart = impulse;
+                lastImpulse = 1;
+                openStream();
+                if (lastImpulse > maxFragmentSilenceLength)
+                    finishFragment(impulse);
+                else
+                    ++index;
+            }
+            else
             {
-                if (peakStart == -1)
+                // семпл, на котором фрагмент закончится, если до него не будет импульсов
+                const qint64 last = index + (maxFragmentSilenceLength - lastImpulse);
+                const qint64 stop = qMin(last + 1, totalReaded);
+                const qint64 impulse = findLastImpulse(index, stop);
+                if (impulse != -1)
                 {
-                    // начало фрагмента
-                    peakStart = index;
+                    lastImpulse = stop - impulse;
+                    index = stop;
+                }
+                else if (stop > last)
+                {
+                    // конец фрагмента
+                    lastImpulse = maxFragmentSilenceLength + 1;
+                    finishFragment(last);
+                }
+                else
+                {
+                    lastImpulse += stop - index;
+                    index = stop;
                 }
-
-                lastImpulse = 0;
             }
+        }
+    }
+
+    // энергия (дБ) и частота пересечений нуля (0..1) кадра, начинающегося с position
+    inline void analyzeFrame(qint64 position, double& energy, double& zcr)
+    {
+        copy(position, position + frameLength, frame.data());
+
+        qint64 sum = 0;
+        int crossings = 0;
+        for (int i = 0; i < frameLength; ++i)
+        {
+            const int value = frame[i];
+            sum += value * value;
+            if (i > 0 && ((value >= 0) != (frame[i - 1] >= 0)))
+                ++crossings;
+        }
+
+        energy = 10.0 * log10(double(sum) / frameLength + 1.0);
+        zcr = double(crossings) / frameLength;
+    }
+
+    // является ли кадр речью
+    inline bool isSpeech(double energy, double zcr) const
+    {
+        if (energy < params.vadMinEnergyDb)
+            return false;
+
+        // громкий кадр, если он не похож на шум
+        if (energy >= noiseFloor + params.vadEnergyThresholdDb)
+            return zcr * 100 <= params.vadMaxZcr;
 
-            if (peakStart != -1)
+        // тихий глухой согласный продолжает уже начатый фрагмент
+        return peakStart != -1
+                && energy >= noiseFloor + params.vadEnergyThresholdDb / 2.0
+                && zcr * 100 >= params.vadFricativeZcr;
+    }
+
+    // подстроить уровень шума по неречевому кадру: вниз - сразу, вверх - медленно
+    inline void updateNoiseFloor(double energy)
+    {
+        if (noiseFloor < 0 || energy < noiseFloor)
+            noiseFloor = energy;
+        else
+            noiseFloor += (energy - noiseFloor) * params.vadNoiseAdaptRate / 100.0;
+    }
+
+    // Покадровый режим: кадры классифицируются по кратковременной энергии
+    // относительно адаптивного уровня шума и частоте пересечений нуля.
+    // Фрагмент начинается только после vadStartFrames речевых кадров
+    // подряд, поэтому одиночные щелчки фрагментов не образуют
+    inline void scanFrames()
+    {
+        while (index + frameLength <= totalReaded)
+        {
+            double energy, zcr;
+            analyzeFrame(index, energy, zcr);
+            if (noiseFloor < 0)
+                noiseFloor = energy;
+
+            const bool speech = isSpeech(energy, zcr);
+            const qint64 frameEnd = index + frameLength;
+
+            if (peakStart == -1)
+            {
+                if (speech)
+                {
+                    if (++speechFrames >= params.vadStartFrames)
+                    {
+                        // начало фрагмента - первый кадр серии
+                        peakStart = frameEnd - qint64(speechFrames) * frameLength;
+                        lastSpeech = frameEnd;
+                        openStream();
+                    }
+                }
+                else
+                {
+                    speechFrames = 0;
+                    updateNoiseFloor(energy);
+
+                    // тишина с начала буфера - очистка буфера
+                    if (frameEnd - gstart > maxSilenceLength)
+                        gstart = frameEnd;
+                }
+                index = frameEnd;
+            }
+            else
             {
-                ++lastImpulse;
+                if (speech)
+                    lastSpeech = frameEnd;
+                index = frameEnd;
 
                 // конец фрагмента
-                if (lastImpulse > maxFragmentSilenceLength)
+                if (frameEnd - lastSpeech > maxFragmentSilenceLength)
                 {
+                    recordEnd(lastSpeech);
+
                     // конец фрагмента с отступом
-                    int end = qMin(index - lastImpulse + marginAfter, samples);
+                    const qint64 end = qMin(lastSpeech + marginAfter, totalReaded);
 
                     // длина фрагмента > минимальной
-                    if ((index - peakStart - lastImpulse) >= minFragmentLength)
+                    const bool accepted = lastSpeech - peakStart >= minFragmentLength;
+                    if (accepted)
                     {
                         // начало фрагмента с отступом
-                        int start = qMax(peakStart - marginBefore, 0);
+                        const qint64 start = qMax(peakStart - marginBefore, gstart);
 
-                        emit self->voiceFragment(buff.mid(start * AudioFormat::sampleSize,
-                                                          (end - start) * AudioFormat::sampleSize));
+                        emitFragment(start, end);
                     }
+                    closeStream(end, accepted);
 
-                    gstart += end;
-                    buff.remove(0, end * AudioFormat::sampleSize);
-                    begin = reinterpret_cast<const AudioFormat::sampleType*>(buff.constData());
-                    index = -1;
-
-                    samples = buff.size() / AudioFormat::sampleSize;
-
+                    gstart = end;
+                    index = end;
                     peakStart = -1;
-                }
-            }
-            else
-            {
-                // тишина с начала буфера
-                if (index > maxSilenceLength)
-                {
-                    // очистка буфера
-                    gstart += index;
-                    buff.remove(0, index * AudioFormat::sampleSize);
-                    begin = reinterpret_cast<const AudioFormat::sampleType*>(buff.constData());
-                    index = -1;
-
-                    samples = buff.size() / AudioFormat::sampleSize;
+                    speechFrames = 0;
                 }
             }
         }
@@ -120,25 +474,110 @@ public:
     AudioFormat format;
     VoiceSplitter* self;
 
-    const AudioFormat::sampleType* begin;
-    int peakStart;
-    int index;
-    int lastImpulse;
-    int samples;
-    QByteArray buff;
-    qint64 totalReaded;
-    qint64 gstart;
-
-    const AudioFormat::sampleType maxSilenceValue; // максимальное значение тишины для данного типа семпла
-    const int minFragmentLength; // минимальный размер фрагмента
-    const int marginBefore; // запас тишины до фрагмента
-    const int marginAfter; // запас тишины после фрагмента
-    const int maxFragmentSilenceLength; // максимальная продолжительность тишины в фрагменте
-    const int maxSilenceLength; // максимальная длительность тишины
+    QVector<AudioFormat::sampleType> buff; // кольцевой буфер семплов, размер - степень двойки
+    int mask; // buff.size() - 1
+
+    // все позиции - абсолютные номера семплов с начала потока
+    qint64 peakStart; // начало текущего фрагмента, -1 - фрагмента нет
+    qint64 index; // следующий просматриваемый семпл
+    int lastImpulse; // количество семплов от последнего импульса (включительно)
+    qint64 totalReaded; // всего получено семплов
+    qint64 gstart; // первый хранимый семпл
+
+    QVector<AudioFormat::sampleType> frame; // семплы анализируемого кадра
+    double noiseFloor; // уровень шума, дБ (< 0 - ещё не измерен)
+    int speechFrames; // количество речевых кадров подряд до начала фрагмента
+    qint64 lastSpeech; // конец последнего речевого кадра фрагмента
+
+    bool streaming; // выдавать данные фрагмента по мере поступления
+    qint64 streamPosition; // следующий передаваемый семпл открытого фрагмента, -1 - не открыт
+
+    VoiceSplitter::Params params; // действующие параметры
+    AudioFormat::sampleType maxSilenceValue; // максимальное значение тишины для данного типа семпла
+    int minFragmentLength; // минимальный размер фрагмента
+    int marginBefore; // запас тишины до фрагмента
+    int marginAfter; // запас тишины после фрагмента
+    int maxFragmentSilenceLength; // максимальная продолжительность тишины в фрагменте
+    int maxSilenceLength; // максимальная длительность тишины
+    int frameLength; // длина кадра в семплах
+
+    QMutex mutex; // защищает requested
+    VoiceSplitter::Params requested; // последние параметры, заданные setParams()
+    QAtomicInt changed; // requested ещё не приняты
 };
 
-VoiceSplitter::VoiceSplitter(const AudioFormat& format):
-    d_ptr(new VoiceSplitterPrivate(format))
+VoiceSplitter::Params::Params():
+    mode(SampleMode),
+    fragmentMinLengthMs(400),
+    fragmentMarginBeforeMs(400),
+    fragmentMarginAfterMs(400),
+    fragmentMaxSilenceLengthMs(400),
+    silenceMaxValue(10),
+    silenceMaxLengthMs(2000),
+    vadFrameLengthMs(20),
+    vadEnergyThresholdDb(10),
+    vadMinEnergyDb(25),
+    vadMaxZcr(50),
+    vadFricativeZcr(25),
+    vadStartFrames(3),
+    vadNoiseAdaptRate(5)
+{
+}
+
+bool VoiceSplitter::Params::load(const QString& path)
+{
+    if (!QFileInfo(path).isReadable())
+        return false;
+
+    QSettings settings(path, QSettings::IniFormat);
+    if (settings.status() != QSettings::NoError)
+        return false;
+
+    settings.beginGroup("VoiceSplitter");
+    const QString modeName = settings.value("Mode", mode == FrameMode ? "frame" : "sample").toString();
+    mode = modeName.compare("frame", Qt::CaseInsensitive) == 0 ? FrameMode : SampleMode;
+    fragmentMinLengthMs = settings.value("FragmentMinLengthMs", fragmentMinLengthMs).toUInt();
+    fragmentMarginBeforeMs = settings.value("FragmentMarginBeforeMs", fragmentMarginBeforeMs).toUInt();
+    fragmentMarginAfterMs = settings.value("FragmentMarginAfterMs", fragmentMarginAfterMs).toUInt();
+    fragmentMaxSilenceLengthMs = settings.value("FragmentMaxSilenceLengthMs", fragmentMaxSilenceLengthMs).toUInt();
+    silenceMaxValue = settings.value("SilenceMaxValue", silenceMaxValue).toUInt();
+    silenceMaxLengthMs = settings.value("SilenceMaxLengthMs", silenceMaxLengthMs).toUInt();
+    vadFrameLengthMs = settings.value("VadFrameLengthMs", vadFrameLengthMs).toUInt();
+    vadEnergyThresholdDb = settings.value("VadEnergyThresholdDb", vadEnergyThresholdDb).toInt();
+    vadMinEnergyDb = settings.value("VadMinEnergyDb", vadMinEnergyDb).toInt();
+    vadMaxZcr = settings.value("VadMaxZcr", vadMaxZcr).toInt();
+    vadFricativeZcr = settings.value("VadFricativeZcr", vadFricativeZcr).toInt();
+    vadStartFrames = settings.value("VadStartFrames", vadStartFrames).toInt();
+    vadNoiseAdaptRate = settings.value("VadNoiseAdaptRate", vadNoiseAdaptRate).toInt();
+    settings.endGroup();
+    return true;
+}
+
+bool VoiceSplitter::Params::save(const QString& path) const
+{
+    QSettings settings(path, QSettings::IniFormat);
+    settings.beginGroup("VoiceSplitter");
+    settings.setValue("Mode", mode == FrameMode ? "frame" : "sample");
+    settings.setValue("FragmentMinLengthMs", fragmentMinLengthMs);
+    settings.setValue("FragmentMarginBeforeMs", fragmentMarginBeforeMs);
+    settings.setValue("FragmentMarginAfterMs", fragmentMarginAfterMs);
+    settings.setValue("FragmentMaxSilenceLengthMs", fragmentMaxSilenceLengthMs);
+    settings.setValue("SilenceMaxValue", silenceMaxValue);
+    settings.setValue("SilenceMaxLengthMs", silenceMaxLengthMs);
+    settings.setValue("VadFrameLengthMs", vadFrameLengthMs);
+    settings.setValue("VadEnergyThresholdDb", vadEnergyThresholdDb);
+    settings.setValue("VadMinEnergyDb", vadMinEnergyDb);
+    settings.setValue("VadMaxZcr", vadMaxZcr);
+    settings.setValue("VadFricativeZcr", vadFricativeZcr);
+    settings.setValue("VadStartFrames", vadStartFrames);
+    settings.setValue("VadNoiseAdaptRate", vadNoiseAdaptRate);
+    settings.endGroup();
+    settings.sync();
+    return settings.status() == QSettings::NoError;
+}
+
+VoiceSplitter::VoiceSplitter(const AudioFormat& format, const Params& params):
+    d_ptr(new VoiceSplitterPrivate(format, params))
 {
     d_ptr->self = this;
 }
@@ -150,5 +589,52 @@ VoiceSplitter::~VoiceSplitter()
 
 void VoiceSplitter::addBlock(const QByteArray& block)
 {
+    static LatencyHistogram *const addBlockLatency = Metrics::instance().histogram("splitter.addBlock");
+    LatencyTimer timer(addBlockLatency);
     d_ptr->addBlock(block);
 }
+
+void VoiceSplitter::addBlock(qint64 position, const QByteArray& block)
+{
+    static LatencyHistogram *const addBlockLatency = Metrics::instance().histogram("splitter.addBlock");
+    LatencyTimer timer(addBlockLatency);
+    d_ptr->skipTo(position);
+    d_ptr->addBlock(block);
+}
+
+void VoiceSplitter::setParams(const Params& params)
+{
+    QMutexLocker locker(&d_ptr->mutex);
+    d_ptr->requested = params;
+    d_ptr->changed.storeRelease(1);
+}
+
+VoiceSplitter::Params VoiceSplitter::params() const
+{
+    QMutexLocker locker(&d_ptr->mutex);
+    return d_ptr->requested;
+}
+
+void VoiceSplitter::setMode(Mode mode)
+{
+    QMutexLocker locker(&d_ptr->mutex);
+    d_ptr->requested.mode = mode;
+    d_ptr->changed.storeRelease(1);
+}
+
+VoiceSplitter::Mode VoiceSplitter::mode() const
+{
+    return params().mode;
+}
+
+void VoiceSplitter::setStreaming(bool streaming)
+{
+    d_ptr->streaming = streaming;
+    if (!streaming)
+        d_ptr->closeStream(d_ptr->totalReaded, false);
+}
+
+bool VoiceSplitter::isStreaming() const
+{
+    return d_ptr->streaming;
+}
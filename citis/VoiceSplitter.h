@@ -14,13 +14,80 @@ class VoiceSplitter : public QObject
     Q_DECLARE_PRIVATE(VoiceSplitter)
 
 public:
-    VoiceSplitter(const AudioFormat& format);
+    // режим выделения фрагментов
+    enum Mode
+    {
+        SampleMode, // по превышению порога отдельными семплами
+        FrameMode   // по энергии и частоте пересечений нуля кадров длиной vadFrameLengthMs
+    };
+
+    // параметры выделения фрагментов
+    struct Params
+    {
+        Mode mode; // режим выделения фрагментов
+        quint32 fragmentMinLengthMs; // минимальная длина фрагмента (слова) в мс
+        quint32 fragmentMarginBeforeMs; // "запас" тишины до слова в мс
+        quint32 fragmentMarginAfterMs; // "запас" тишины после слова в мс
+        quint32 fragmentMaxSilenceLengthMs; // максимальная продолжительность "тишины" внутри фрагмента
+        quint32 silenceMaxValue; // уровень при котором звук будет восприниматься как тишина, %
+        quint32 silenceMaxLengthMs; // длительность тишины, при которой будет происходить очистка буфера от переполнения, мс
+
+        // покадровый режим
+        quint32 vadFrameLengthMs; // длина кадра, мс
+        int vadEnergyThresholdDb; // превышение энергии кадра над уровнем шума, при котором кадр считается речью, дБ
+        int vadMinEnergyDb; // минимальная энергия речевого кадра, дБ (относительно единицы младшего разряда)
+        int vadMaxZcr; // частота пересечений нуля, выше которой громкий кадр считается шумом, %
+        int vadFricativeZcr; // частота пересечений нуля, с которой тихий кадр внутри фрагмента считается глухим согласным, %
+        int vadStartFrames; // количество речевых кадров подряд, с которого начинается фрагмент
+        int vadNoiseAdaptRate; // скорость подстройки уровня шума на неречевых кадрах, %
+
+        Params();
+
+        // загрузить из ini-файла (группа [VoiceSplitter]); отсутствующие ключи не меняются
+        bool load(const QString& path);
+        // сохранить в ini-файл
+        bool save(const QString& path) const;
+    };
+
+    VoiceSplitter(const AudioFormat& format, const Params& params = Params());
     ~VoiceSplitter();
 
+
+    // Задать параметры. Можно вызывать из любого потока во время работы:
+    // параметры целиком вступают в силу перед обработкой следующего блока
+    void setParams(const Params& params);
+    Params params() const;
+
+    void setMode(Mode mode);
+    Mode mode() const;
+
+    // Потоковая выдача: данные фрагмента передаются сигналами
+    // fragmentStarted/fragmentData/fragmentFinished сразу по мере
+    // поступления, не дожидаясь тишины после фрагмента.
+    // Вызывать из потока, в котором вызывается addBlock()
+    void setStreaming(bool streaming);
+    bool isStreaming() const;
+
+public slots:
+    // Очередной блок звука (моно); можно вызывать очередью из другого потока
     void addBlock(const QByteArray& block);
-    
+    // Блок, начинающийся с семпла position. Если он не продолжает
+    // полученные данные (пропуск), открытый фрагмент отбрасывается и
+    // выделение начинается заново с position
+    void addBlock(qint64 position, const QByteArray& block);
+
 signals:
     void voiceFragment(const QByteArray& fragment);
+    // фрагмент и абсолютный номер его первого семпла с начала потока
+    void voiceFragmentAt(qint64 position, const QByteArray& fragment);
+
+    // потоковая выдача: начался фрагмент с семпла position
+    void fragmentStarted(qint64 position);
+    // очередные данные открытого фрагмента
+    void fragmentData(const QByteArray& data);
+    // фрагмент закончился на семпле end; accepted == false - фрагмент короче
+    // минимального и voiceFragment для него не выдаётся, результат не нужен
+    void fragmentFinished(qint64 end, bool accepted);
     
 private:
     VoiceSplitterPrivate* d_ptr;
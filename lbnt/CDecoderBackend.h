@@ -0,0 +1,76 @@
+/**
+ * @brief   Интерфейс декодера речи и фабрики декодеров (бэкенда)
+ * @file    CDecoderBackend.h
+ *
+ * CSpeechRecog и всё, что построено на нём (VoiceRecognizer, очередь
+ * распознавания, потоковое распознавание, пакетная обработка), работают
+ * с декодерами только через этот интерфейс. Бэкенды:
+ *   CPocketSphinxBackend - CMUSphinx (pocketsphinx) с кэшем моделей;
+ *   CMockBackend         - детерминированная имитация без моделей для
+ *                          нагрузочной проверки выделения фрагментов и очередей.
+ */
+
+#ifndef CDECODERBACKEND_H
+#define CDECODERBACKEND_H
+
+#include <QByteArray>
+#include <QString>
+#include "CRecognitionResult.h"
+
+// Модели и параметры декодера
+struct CDecoderConfig
+{
+    QString pathHmm;   // каталог акустической модели
+    QString pathLm;    // языковая модель (пусто - нет)
+    QString pathDict;  // словарь
+    QString pathGram;  // грамматика JSGF (пусто - нет; имеет приоритет над pathLm)
+    int sampleRate;    // частота дискретизации, Гц
+
+    CDecoderConfig() : sampleRate(8000) {}
+};
+
+// Декодер: одна фраза за раз, вызовы из одного потока в каждый момент
+class CDecoder
+{
+public:
+
+    // Тип именованного поиска
+    enum SearchType { GrammarSearch, KeywordsSearch, KeyphraseSearch, LanguageModelSearch };
+
+    virtual ~CDecoder() {}
+
+    // Начать фразу
+    virtual bool startUtt() = 0;
+    // Передать семплы (16 бит, моно); возвращает количество принятых, -1 - ошибка
+    virtual qint64 processRaw(const qint16 *samples, qint64 count) = 0;
+    // Закончить фразу
+    virtual bool endUtt() = 0;
+    // Гипотеза (частичная - до endUtt); пустая строка - гипотезы нет
+    virtual QString hypothesis(int *score = nullptr) = 0;
+    // Результат с уверенностью, словами и не более nbestSize альтернатив (после endUtt)
+    virtual CRecognitionResult result(int nbestSize) = 0;
+
+    // Загрузить именованный поиск; value - путь к файлу или ключевая фраза
+    virtual bool addSearch(SearchType type, const QString &name, const QString &value) = 0;
+    // Сделать поиск активным; пустое имя - поиск из конфигурации
+    virtual bool setSearch(const QByteArray &name) = 0;
+    // Декодер взят готовым (без загрузки акустической модели)
+    virtual bool isReused() const { return false; }
+};
+
+// Фабрика декодеров
+class CDecoderBackend
+{
+public:
+    virtual ~CDecoderBackend() {}
+
+    // Название бэкенда
+    virtual QString name() const = 0;
+    // Создать декодер (долго: вызывается в потоке инициализации);
+    // nullptr - ошибка, описание в error
+    virtual CDecoder *createDecoder(const CDecoderConfig &config, QString &error) = 0;
+    // Освободить декодер (бэкенд может сохранить его для следующего createDecoder)
+    virtual void releaseDecoder(CDecoder *decoder) { delete decoder; }
+};
+
+#endif // CDECODERBACKEND_H
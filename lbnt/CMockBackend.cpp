@@ -0,0 +1,183 @@
+#include <QFile>
+#include <QSet>
+#include <QTextStream>
+#include <QThread>
+#include "CMockBackend.h"
+
+namespace {
+
+// Длительность одного слова гипотезы, мс
+const int WordLengthMs = 400;
+
+// Словарь по умолчанию
+QStringList defaultWords()
+{
+    return QString("ноль один два три четыре пять шесть семь восемь девять").split(' ');
+}
+
+// Первые слова строк словаря
+QStringList readWords(const QString &path)
+{
+    QStringList words;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return words;
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    QSet<QString> seen;
+    while (!stream.atEnd()) {
+        QString word = stream.readLine().section(' ', 0, 0).section('\t', 0, 0);
+        // варианты произношения: слово(2)
+        word = word.section('(', 0, 0);
+        if (word.isEmpty() || seen.contains(word)) continue;
+        seen.insert(word);
+        words.append(word);
+    }
+    return words;
+}
+
+// Декодер-имитация
+class CMockDecoder : public CDecoder
+{
+public:
+    CMockDecoder(const QStringList &words, int sampleRate, double realTimeFactor) :
+        _words(words),
+        _sampleRate(sampleRate),
+        _realTimeFactor(realTimeFactor),
+        _hash(0),
+        _samples(0)
+    {
+    }
+
+    bool startUtt()
+    {
+        _hash = 2166136261u;
+        _samples = 0;
+        return true;
+    }
+
+    qint64 processRaw(const qint16 *samples, qint64 count)
+    {
+        // FNV-1a по семплам
+        for (qint64 i = 0; i < count; ++i) {
+            _hash ^= quint16(samples[i]);
+            _hash *= 16777619u;
+        }
+        _samples += count;
+        if (_realTimeFactor > 0.0)
+            QThread::usleep(quint64(_realTimeFactor * count * 1000000 / _sampleRate));
+        return count;
+    }
+
+    bool endUtt()
+    {
+        return true;
+    }
+
+    QString hypothesis(int *score)
+    {
+        if (score) *score = this->score();
+        return words(_hash).join(' ');
+    }
+
+    CRecognitionResult result(int nbestSize)
+    {
+        CRecognitionResult result;
+        const QStringList hypothesis = words(_hash);
+        result.hypothesis = hypothesis.join(' ');
+        result.score = score();
+        result.confidence = 0.5 + (_hash % 501) / 1000.0;
+        for (int i = 0; i < hypothesis.size(); ++i) {
+            CRecognitionResult::Word word;
+            word.word = hypothesis.at(i);
+            word.startMs = qint64(i) * WordLengthMs;
+            word.endMs = qint64(i + 1) * WordLengthMs;
+            word.confidence = result.confidence;
+            word.acousticScore = result.score / hypothesis.size();
+            word.languageScore = 0;
+            result.words.append(word);
+        }
+        // альтернативы - гипотезы соседних значений хэша
+        for (int i = 0; i < nbestSize && !hypothesis.isEmpty(); ++i) {
+            CRecognitionResult::Alternative alternative;
+            alternative.hypothesis = i ? words(_hash + quint32(i)).join(' ') : result.hypothesis;
+            alternative.score = result.score - i;
+            bool duplicate = false;
+            foreach (const CRecognitionResult::Alternative &other, result.nbest)
+                duplicate = duplicate || other.hypothesis == alternative.hypothesis;
+            if (!duplicate)
+                result.nbest.append(alternative);
+        }
+        return result;
+    }
+
+    bool addSearch(SearchType type, const QString &name, const QString &value)
+    {
+        if (type != KeyphraseSearch && !QFile::exists(value))
+            return false;
+        _searches.insert(name);
+        return true;
+    }
+
+    bool setSearch(const QByteArray &name)
+    {
+        return name.isEmpty() || _searches.contains(QString::fromUtf8(name));
+    }
+
+private:
+    // Слова гипотезы для значения хэша
+    QStringList words(quint32 hash) const
+    {
+        QStringList result;
+        const qint64 count = _samples * 1000 / (qint64(_sampleRate) * WordLengthMs);
+        quint32 state = hash;
+        for (qint64 i = 0; i < count && !_words.isEmpty(); ++i) {
+            state = state * 1664525u + 1013904223u;
+            result.append(_words.at(int((state >> 8) % quint32(_words.size()))));
+        }
+        return result;
+    }
+
+    // Оценка: чем длиннее фраза, тем меньше
+    int score() const
+    {
+        return -int(qMin(_samples, qint64(1) << 24)) - int(_hash % 1000);
+    }
+
+    QStringList _words;
+    int _sampleRate;
+    double _realTimeFactor;
+    quint32 _hash;
+    qint64 _samples;
+    QSet<QString> _searches;
+};
+
+}
+
+// Конструктор
+CMockBackend::CMockBackend(double realTimeFactor, int initDelayMs) :
+    _realTimeFactor(realTimeFactor),
+    _initDelayMs(initDelayMs)
+{
+}
+
+// Название бэкенда
+QString CMockBackend::name() const
+{
+    return "mock";
+}
+
+// Создать декодер
+CDecoder *CMockBackend::createDecoder(const CDecoderConfig &config, QString &error)
+{
+    if (config.sampleRate <= 0) {
+        error = "Invalid sample rate";
+        return nullptr;
+    }
+    if (_initDelayMs > 0)
+        QThread::msleep(_initDelayMs);
+    QStringList words = readWords(config.pathDict);
+    if (words.isEmpty())
+        words = defaultWords();
+    return new CMockDecoder(words, config.sampleRate, _realTimeFactor);
+}
@@ -0,0 +1,36 @@
+/**
+ * @brief   Детерминированная имитация декодера без моделей
+ * @file    CMockBackend.h
+ *
+ * Гипотеза строится из слов словаря (первое слово каждой строки
+ * config.pathDict; если файла нет - цифры) по хэшу переданных семплов:
+ * одни и те же данные всегда дают один и тот же результат, длина
+ * гипотезы растёт с длительностью фразы. Время декодирования имитируется
+ * задержкой, пропорциональной длительности звука (realTimeFactor), время
+ * загрузки модели - задержкой createDecoder (initDelayMs). Позволяет
+ * нагрузочно проверять выделение фрагментов, очереди и пакетную
+ * обработку без акустической модели.
+ */
+
+#ifndef CMOCKBACKEND_H
+#define CMOCKBACKEND_H
+
+#include <QStringList>
+#include "CDecoderBackend.h"
+
+class CMockBackend : public CDecoderBackend
+{
+public:
+
+    // Конструктор; realTimeFactor - время декодирования / длительность звука
+    explicit CMockBackend(double realTimeFactor = 0.0, int initDelayMs = 0);
+
+    QString name() const;
+    CDecoder *createDecoder(const CDecoderConfig &config, QString &error);
+
+private:
+    double _realTimeFactor;
+    int _initDelayMs;
+};
+
+#endif // CMOCKBACKEND_H
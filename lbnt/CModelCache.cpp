@@ -0,0 +1,84 @@
+#include "CModelCache.h"
+
+CModelCache::CModelCache() :
+    _maxIdle(32),
+    _hits(0),
+    _misses(0)
+{
+}
+
+CModelCache::~CModelCache()
+{
+    clear();
+}
+
+// Кэш процесса
+CModelCache &CModelCache::instance()
+{
+    static CModelCache cache;
+    return cache;
+}
+
+// Ключ кэша
+QString CModelCache::key(const QString &pathHmm, int sampleRate)
+{
+    return QString("%1|%2").arg(pathHmm).arg(sampleRate);
+}
+
+// Взять свободный декодер
+CModelCache::Entry CModelCache::take(const QString &key)
+{
+    QMutexLocker locker(&_mutex);
+    QMultiHash<QString, Entry>::iterator it = _idle.find(key);
+    if (it == _idle.end()) {
+        ++_misses;
+        return Entry();
+    }
+    const Entry entry = it.value();
+    _idle.erase(it);
+    ++_hits;
+    return entry;
+}
+
+// Вернуть декодер в кэш
+void CModelCache::put(const QString &key, const Entry &entry)
+{
+    if (!entry.ps) return;
+    QMutexLocker locker(&_mutex);
+    if (_idle.size() >= _maxIdle) {
+        ps_free(entry.ps);
+        return;
+    }
+    _idle.insert(key, entry);
+}
+
+// Освободить все декодеры кэша
+void CModelCache::clear()
+{
+    QMutexLocker locker(&_mutex);
+    foreach (const Entry &entry, _idle) ps_free(entry.ps);
+    _idle.clear();
+}
+
+// Установить наибольшее количество декодеров в кэше
+void CModelCache::setMaxIdle(int count)
+{
+    QMutexLocker locker(&_mutex);
+    _maxIdle = qMax(count, 0);
+    while (_idle.size() > _maxIdle) {
+        QMultiHash<QString, Entry>::iterator it = _idle.begin();
+        ps_free(it.value().ps);
+        _idle.erase(it);
+    }
+}
+
+// Получить счётчики
+CModelCache::Stats CModelCache::stats() const
+{
+    QMutexLocker locker(&_mutex);
+    Stats stats;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.idle = _idle.size();
+    return stats;
+}
@@ -0,0 +1,74 @@
+/**
+ * @brief   Кэш загруженных декодеров CMUSphinx на время работы процесса
+ * @file    CModelCache.h
+ *
+ * Загрузка акустической модели - самая долгая часть инициализации
+ * декодера. Освобождаемые декодеры CPocketSphinxBackend (CSpeechRecog::free,
+ * updateModel, удаление CSpeechRecog) не уничтожаются, а возвращаются
+ * в кэш вместе с путями загруженных в них словаря, языковой модели и
+ * грамматики.
+ * Следующая инициализация с той же акустической моделью и частотой
+ * берёт их из кэша и перезагружает только изменившиеся словарь,
+ * языковую модель или грамматику; поиск из конфигурации (_default)
+ * приводится к новой конфигурации (убирается, если в ней нет ни
+ * языковой модели, ни грамматики) и становится активным.
+ */
+
+#ifndef CMODELCACHE_H
+#define CMODELCACHE_H
+
+#include <QMultiHash>
+#include <QMutex>
+#include <QString>
+#include <pocketsphinx.h>
+
+class CModelCache
+{
+public:
+
+    // Декодер и загруженные в него модели
+    struct Entry {
+        ps_decoder_t *ps;
+        QString pathDict;
+        QString pathLm;
+        QString pathGram;
+
+        Entry() : ps(nullptr) {}
+    };
+
+    // Счётчики кэша
+    struct Stats {
+        quint64 hits;    // декодеров взято из кэша
+        quint64 misses;  // декодеров пришлось создать
+        int idle;        // декодеров в кэше сейчас
+    };
+
+    // Кэш процесса
+    static CModelCache &instance();
+    // Ключ: акустическая модель и частота дискретизации
+    static QString key(const QString &pathHmm, int sampleRate);
+
+    // Взять свободный декодер; ps == nullptr - в кэше нет
+    Entry take(const QString &key);
+    // Вернуть декодер в кэш (сверх лимита декодер освобождается)
+    void put(const QString &key, const Entry &entry);
+    // Освободить все декодеры кэша
+    void clear();
+    // Установить наибольшее количество декодеров в кэше
+    void setMaxIdle(int count);
+    // Получить счётчики
+    Stats stats() const;
+
+private:
+    CModelCache();
+    ~CModelCache();
+    Q_DISABLE_COPY(CModelCache)
+
+    mutable QMutex _mutex;
+    QMultiHash<QString, Entry> _idle;
+    int _maxIdle;
+    quint64 _hits;
+    quint64 _misses;
+};
+
+#endif // CMODELCACHE_H
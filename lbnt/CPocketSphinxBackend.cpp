@@ -0,0 +1,323 @@
+#include <string.h>
+#include <QDebug>
+#include "../audio/metrics.h"
+#include "CPocketSphinxBackend.h"
+
+namespace {
+
+// Имя поиска, который pocketsphinx создаёт из -lm/-jsgf конфигурации
+const char *DefaultSearch = "_default";
+
+// Извлечь результат из декодера после ps_end_utt()
+CRecognitionResult resultFromDecoder(ps_decoder_t *ps, int nbestSize)
+{
+    CRecognitionResult result;
+    if (!ps) return result;
+
+    int32 score = 0;
+    const char *hyp = ps_get_hyp(ps, &score);
+    if (!hyp) return result;
+    result.hypothesis = QString::fromUtf8(hyp);
+    result.score = score;
+
+    logmath_t *lmath = ps_get_logmath(ps);
+    result.confidence = logmath_exp(lmath, ps_get_prob(ps));
+
+    // границы слов в кадрах признаков
+    const int frameRate = cmd_ln_int32_r(ps_get_config(ps), "-frate");
+    for (ps_seg_t *seg = ps_seg_iter(ps); seg; seg = ps_seg_next(seg)) {
+        int startFrame = 0, endFrame = 0;
+        int32 ascr = 0, lscr = 0, lback = 0;
+        ps_seg_frames(seg, &startFrame, &endFrame);
+        const int32 prob = ps_seg_prob(seg, &ascr, &lscr, &lback);
+        CRecognitionResult::Word word;
+        word.word = QString::fromUtf8(ps_seg_word(seg));
+        word.startMs = qint64(startFrame) * 1000 / frameRate;
+        word.endMs = qint64(endFrame + 1) * 1000 / frameRate;
+        word.confidence = logmath_exp(lmath, prob);
+        word.acousticScore = ascr;
+        word.languageScore = lscr;
+        result.words.append(word);
+    }
+
+    // список N лучших содержит гипотезы, различающиеся только паузами
+    // и шумами, - оставляем различные по тексту. ps_nbest() уже стоит
+    // на первой (лучшей) гипотезе, поэтому сдвиг - в конце итерации
+    if (nbestSize > 0) {
+        ps_nbest_t *nbest = ps_nbest(ps);
+        while (nbest && result.nbest.size() < nbestSize) {
+            int32 nbestScore = 0;
+            const char *text = ps_nbest_hyp(nbest, &nbestScore);
+            if (text) {
+                CRecognitionResult::Alternative alternative;
+                alternative.hypothesis = QString::fromUtf8(text);
+                alternative.score = nbestScore;
+                bool duplicate = false;
+                foreach (const CRecognitionResult::Alternative &other, result.nbest)
+                    duplicate = duplicate || other.hypothesis == alternative.hypothesis;
+                if (!duplicate)
+                    result.nbest.append(alternative);
+            }
+            nbest = ps_nbest_next(nbest);
+        }
+        // ps_nbest_next() освобождает итератор сам только в конце списка
+        if (nbest) ps_nbest_free(nbest);
+    }
+    return result;
+}
+
+// Убрать именованные поиски прежнего владельца (addSearch), оставив
+// поиск из конфигурации: иначе, например, поиск ключевой фразы детектора
+// достался бы вместе с декодером очереди распознавания
+bool unsetNamedSearches(ps_decoder_t *ps)
+{
+    QList<QByteArray> names;
+    // ps_search_iter_next() освобождает итератор сам в конце списка
+    for (ps_search_iter_t *it = ps_search_iter(ps); it; it = ps_search_iter_next(it)) {
+        const char *name = ps_search_iter_val(it);
+        if (strcmp(name, DefaultSearch) != 0) names.append(QByteArray(name));
+    }
+    foreach (const QByteArray &name, names)
+        if (ps_unset_search(ps, name.constData()) < 0) return false;
+    return true;
+}
+
+}
+
+// CPocketSphinxDecoder
+
+// Конструктор
+CPocketSphinxDecoder::CPocketSphinxDecoder(const CModelCache::Entry &entry, const QString &cacheKey, bool reused) :
+    _entry(entry),
+    _cacheKey(cacheKey),
+    _reused(reused)
+{
+}
+
+CPocketSphinxDecoder::~CPocketSphinxDecoder()
+{
+    if (_entry.ps) ps_free(_entry.ps);
+}
+
+// Начать фразу
+bool CPocketSphinxDecoder::startUtt()
+{
+    return ps_start_utt(_entry.ps) >= 0;
+}
+
+// Передать семплы
+qint64 CPocketSphinxDecoder::processRaw(const qint16 *samples, qint64 count)
+{
+    static LatencyHistogram *const processLatency = Metrics::instance().histogram("decoder.processRaw");
+    LatencyTimer timer(processLatency);
+    if (ps_process_raw(_entry.ps, samples, size_t(count), FALSE, FALSE) < 0)
+        return -1;
+    return count;
+}
+
+// Закончить фразу
+bool CPocketSphinxDecoder::endUtt()
+{
+    // поиск лучшего пути по решётке - основная часть задержки после конца речи
+    static LatencyHistogram *const endLatency = Metrics::instance().histogram("decoder.endUtt");
+    LatencyTimer timer(endLatency);
+    return ps_end_utt(_entry.ps) >= 0;
+}
+
+// Гипотеза
+QString CPocketSphinxDecoder::hypothesis(int *score)
+{
+    int32 hypScore = 0;
+    const char *hyp = ps_get_hyp(_entry.ps, &hypScore);
+    if (score) *score = hypScore;
+    return QString::fromUtf8(hyp);
+}
+
+// Результат с уверенностью, словами и альтернативами
+CRecognitionResult CPocketSphinxDecoder::result(int nbestSize)
+{
+    return resultFromDecoder(_entry.ps, nbestSize);
+}
+
+// Загрузить именованный поиск
+bool CPocketSphinxDecoder::addSearch(SearchType type, const QString &name, const QString &value)
+{
+    const QByteArray searchName = name.toUtf8();
+    const QByteArray path = value.toLocal8Bit();
+    switch (type) {
+    case GrammarSearch:
+        return ps_set_jsgf_file(_entry.ps, searchName.constData(), path.constData()) >= 0;
+    case KeywordsSearch:
+        return ps_set_kws(_entry.ps, searchName.constData(), path.constData()) >= 0;
+    case KeyphraseSearch:
+        return ps_set_keyphrase(_entry.ps, searchName.constData(), value.toUtf8().constData()) >= 0;
+    case LanguageModelSearch:
+        return ps_set_lm_file(_entry.ps, searchName.constData(), path.constData()) >= 0;
+    }
+    return false;
+}
+
+// Сделать поиск активным
+bool CPocketSphinxDecoder::setSearch(const QByteArray &name)
+{
+    // переключение поиска между фразами: только смена указателя в декодере
+    const char *current = ps_get_search(_entry.ps);
+    const char *active = name.isEmpty() ? DefaultSearch : name.constData();
+    if (current && strcmp(current, active) == 0)
+        return true;
+    return ps_set_search(_entry.ps, active) >= 0;
+}
+
+// Декодер взят из кэша моделей
+bool CPocketSphinxDecoder::isReused() const
+{
+    return _reused;
+}
+
+// Декодер pocketsphinx
+ps_decoder_t *CPocketSphinxDecoder::handle() const
+{
+    return _entry.ps;
+}
+
+// Отдать декодер и пути его моделей
+CModelCache::Entry CPocketSphinxDecoder::take()
+{
+    const CModelCache::Entry entry = _entry;
+    _entry.ps = nullptr;
+    return entry;
+}
+
+// Ключ в кэше моделей
+QString CPocketSphinxDecoder::cacheKey() const
+{
+    return _cacheKey;
+}
+
+// CPocketSphinxBackend
+
+// Название бэкенда
+QString CPocketSphinxBackend::name() const
+{
+    return "pocketsphinx";
+}
+
+// Создать декодер
+CDecoder *CPocketSphinxBackend::createDecoder(const CDecoderConfig &config, QString &error)
+{
+    CModelCache &cache = CModelCache::instance();
+    const QString key = CModelCache::key(config.pathHmm, config.sampleRate);
+
+    // декодер из кэша: перезагружаются только изменившиеся словарь,
+    // языковая модель и грамматика
+    CModelCache::Entry entry = cache.take(key);
+    if (entry.ps) {
+        if (!reloadModels(entry, config, error)) {
+            // модели перезагружены частично - пути в entry уже неверны
+            ps_free(entry.ps);
+            return nullptr;
+        }
+        entry.pathDict = config.pathDict;
+        entry.pathLm = config.pathLm;
+        entry.pathGram = config.pathGram;
+        return new CPocketSphinxDecoder(entry, key, true);
+    }
+
+    cmd_ln_t *psConfig = createConfig(config);
+    if (!psConfig) {
+        error = "Failed to create config object, see log for details";
+        return nullptr;
+    }
+    entry.ps = ps_init(psConfig);
+    // декодер хранит свою ссылку на конфигурацию
+    cmd_ln_free_r(psConfig);
+    if (!entry.ps) {
+        error = "Failed to create recognizer, see log for details";
+        return nullptr;
+    }
+    entry.pathDict = config.pathDict;
+    entry.pathLm = config.pathLm;
+    entry.pathGram = config.pathGram;
+    return new CPocketSphinxDecoder(entry, key, false);
+}
+
+// Вернуть декодер в кэш моделей
+void CPocketSphinxBackend::releaseDecoder(CDecoder *decoder)
+{
+    CPocketSphinxDecoder *psDecoder = dynamic_cast<CPocketSphinxDecoder*>(decoder);
+    // декодер, из которого не удалось убрать поиски, не кэшируется
+    if (psDecoder && unsetNamedSearches(psDecoder->handle()))
+        CModelCache::instance().put(psDecoder->cacheKey(), psDecoder->take());
+    delete decoder;
+}
+
+// Создать конфигурацию pocketsphinx
+cmd_ln_t *CPocketSphinxBackend::createConfig(const CDecoderConfig &config)
+{
+    const QByteArray hmm = config.pathHmm.toLocal8Bit();
+    const QByteArray dict = config.pathDict.toLocal8Bit();
+    const QByteArray samprate = QByteArray::number(config.sampleRate);
+
+    if (!config.pathGram.isEmpty())
+        return cmd_ln_init(nullptr, ps_args(), TRUE,
+                           "-hmm", hmm.constData(),
+                           "-dict", dict.constData(),
+                           "-jsgf", config.pathGram.toLocal8Bit().constData(),
+                           "-samprate", samprate.constData(),
+                           nullptr);
+    else if (!config.pathLm.isEmpty())
+        return cmd_ln_init(nullptr, ps_args(), TRUE,
+                           "-hmm", hmm.constData(),
+                           "-lm", config.pathLm.toLocal8Bit().constData(),
+                           "-dict", dict.constData(),
+                           "-samprate", samprate.constData(),
+                           nullptr);
+    else
+        // без языковой модели и грамматики - только именованные поиски
+        return cmd_ln_init(nullptr, ps_args(), TRUE,
+                           "-hmm", hmm.constData(),
+                           "-dict", dict.constData(),
+                           "-samprate", samprate.constData(),
+                           nullptr);
+}
+
+// Перезагрузить в декодер из кэша изменившиеся модели
+bool CPocketSphinxBackend::reloadModels(const CModelCache::Entry &entry, const CDecoderConfig &config, QString &error)
+{
+    // после смены словаря поиски пересоздаются, грамматика остаётся прежней
+    if (entry.pathDict != config.pathDict
+            && ps_load_dict(entry.ps, config.pathDict.toLocal8Bit().data(), nullptr, nullptr) < 0) {
+        error = "Failed to load dictionary, see log for details";
+        return false;
+    }
+
+    if (config.pathGram.isEmpty()) {
+        if (!config.pathLm.isEmpty() && (!entry.pathGram.isEmpty() || entry.pathLm != config.pathLm)) {
+            if (ps_set_lm_file(entry.ps, DefaultSearch, config.pathLm.toLocal8Bit().data()) < 0) {
+                error = "Failed to load language model, see log for details";
+                return false;
+            }
+        } else if (config.pathLm.isEmpty() && (!entry.pathGram.isEmpty() || !entry.pathLm.isEmpty())) {
+            // без языковой модели и грамматики поиска из конфигурации нет,
+            // как у нового декодера - поиск прежней конфигурации убирается
+            if (ps_unset_search(entry.ps, DefaultSearch) < 0) {
+                error = "Failed to unset default search, see log for details";
+                return false;
+            }
+        }
+    } else if (entry.pathGram != config.pathGram) {
+        if (ps_set_jsgf_file(entry.ps, DefaultSearch, config.pathGram.toLocal8Bit().data()) < 0) {
+            error = "Failed to load grammar, see log for details";
+            return false;
+        }
+    }
+
+    // именованные поиски прежнего владельца сняты в releaseDecoder(),
+    // активного поиска может не быть
+    if ((!config.pathGram.isEmpty() || !config.pathLm.isEmpty())
+            && ps_set_search(entry.ps, DefaultSearch) < 0) {
+        error = "Failed to set default search, see log for details";
+        return false;
+    }
+    return true;
+}
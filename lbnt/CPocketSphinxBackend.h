@@ -0,0 +1,68 @@
+/**
+ * @brief   Декодеры CMUSphinx (pocketsphinx)
+ * @file    CPocketSphinxBackend.h
+ *
+ * Освобождаемые декодеры возвращаются в CModelCache вместе с путями
+ * загруженных моделей; createDecoder с той же акустической моделью и
+ * частотой берёт их оттуда и перезагружает только изменившиеся словарь,
+ * языковую модель или грамматику. Именованные поиски (addSearch) при
+ * возврате в кэш снимаются - новый владелец получает декодер только с
+ * поиском из конфигурации.
+ */
+
+#ifndef CPOCKETSPHINXBACKEND_H
+#define CPOCKETSPHINXBACKEND_H
+
+#include <pocketsphinx.h>
+#include "CDecoderBackend.h"
+#include "CModelCache.h"
+
+// Декодер pocketsphinx
+class CPocketSphinxDecoder : public CDecoder
+{
+public:
+
+    // Конструктор; entry.ps переходит во владение декодера
+    CPocketSphinxDecoder(const CModelCache::Entry &entry, const QString &cacheKey, bool reused);
+    ~CPocketSphinxDecoder();
+
+    bool startUtt();
+    qint64 processRaw(const qint16 *samples, qint64 count);
+    bool endUtt();
+    QString hypothesis(int *score = nullptr);
+    CRecognitionResult result(int nbestSize);
+    bool addSearch(SearchType type, const QString &name, const QString &value);
+    bool setSearch(const QByteArray &name);
+    bool isReused() const;
+
+    // Декодер pocketsphinx
+    ps_decoder_t *handle() const;
+    // Отдать декодер и пути его моделей (декодер больше не владеет ими)
+    CModelCache::Entry take();
+    // Ключ в кэше моделей
+    QString cacheKey() const;
+
+private:
+    CModelCache::Entry _entry;  // декодер и загруженные в него модели
+    QString _cacheKey;
+    bool _reused;
+};
+
+// Бэкенд pocketsphinx
+class CPocketSphinxBackend : public CDecoderBackend
+{
+public:
+    QString name() const;
+    CDecoder *createDecoder(const CDecoderConfig &config, QString &error);
+    // Декодер возвращается в кэш моделей
+    void releaseDecoder(CDecoder *decoder);
+
+    // Создать конфигурацию pocketsphinx
+    static cmd_ln_t *createConfig(const CDecoderConfig &config);
+
+private:
+    // Перезагрузить в декодер из кэша изменившиеся модели
+    static bool reloadModels(const CModelCache::Entry &entry, const CDecoderConfig &config, QString &error);
+};
+
+#endif // CPOCKETSPHINXBACKEND_H
@@ -0,0 +1,14 @@
+#include "CRecognitionResult.h"
+
+// Слова гипотезы без пауз и шумов
+QList<CRecognitionResult::Word> CRecognitionResult::spokenWords() const
+{
+    QList<Word> result;
+    foreach (const Word &word, words) {
+        // <s>, </s>, <sil> и шумы [...] в словаре служебные
+        if (word.word.startsWith('<') || word.word.startsWith('['))
+            continue;
+        result.append(word);
+    }
+    return result;
+}
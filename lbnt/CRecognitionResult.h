@@ -0,0 +1,56 @@
+/**
+ * @brief   Результат распознавания фразы: гипотеза, уверенность,
+ *          слова с границами и альтернативные гипотезы
+ * @file    CRecognitionResult.h
+ *
+ * Заполняется декодером (CDecoder::result) после конца фразы, до
+ * следующей фразы. В pocketsphinx уверенность - апостериорная
+ * вероятность по решётке гипотез (ps_get_prob), слова - сегменты
+ * лучшего пути (ps_seg_iter), альтернативы - список N лучших по той же
+ * решётке (ps_nbest; для поиска ключевых фраз решётки нет, и список пуст).
+ * По результату вызывающий может отвергнуть неуверенную фразу или
+ * выбрать подходящую альтернативу без повторного декодирования.
+ */
+
+#ifndef CRECOGNITIONRESULT_H
+#define CRECOGNITIONRESULT_H
+
+#include <QList>
+#include <QMetaType>
+#include <QString>
+
+struct CRecognitionResult
+{
+    // Слово лучшей гипотезы (включая паузы и шумы: <s>, </s>, <sil>, [...])
+    struct Word {
+        QString word;
+        qint64 startMs;     // начало от начала фразы
+        qint64 endMs;       // конец от начала фразы
+        double confidence;  // апостериорная вероятность слова, 0..1
+        int acousticScore;
+        int languageScore;
+    };
+
+    // Альтернативная гипотеза
+    struct Alternative {
+        QString hypothesis;
+        int score;
+    };
+
+    QString hypothesis;        // лучшая гипотеза
+    int score;                 // оценка лучшей гипотезы (ps_get_hyp)
+    double confidence;         // апостериорная вероятность гипотезы, 0..1
+    QList<Word> words;         // слова лучшей гипотезы по порядку
+    QList<Alternative> nbest;  // различные гипотезы от лучшей, не более заданного
+
+    CRecognitionResult() : score(0), confidence(0.0) {}
+
+    // Гипотеза пуста
+    bool isEmpty() const { return hypothesis.isEmpty(); }
+    // Слова гипотезы без пауз и шумов
+    QList<Word> spokenWords() const;
+};
+
+Q_DECLARE_METATYPE(CRecognitionResult)
+
+#endif // CRECOGNITIONRESULT_H
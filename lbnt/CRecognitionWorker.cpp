@@ -0,0 +1,224 @@
+#include "../audio/metrics.h"
+#include "CSpeechRecog.h"
+#include "CRecognitionWorker.h"
+
+CRecognitionWorker::Stats::Stats() :
+    depth(0),
+    maxDepth(0),
+    enqueued(0),
+    decoded(0),
+    dropped(0),
+    coalesced(0),
+    totalWaitMs(0),
+    maxWaitMs(0),
+    totalDecodeMs(0)
+{
+}
+
+// Конструктор
+CRecognitionWorker::CRecognitionWorker(CSpeechRecog *speech, int capacity,
+                                       OverflowPolicy policy, int threads, QObject *parent) :
+    QObject(parent),
+    _speech(speech),
+    _nextEmitId(0),
+    _capacity(qMax(capacity, 1)),
+    _policy(policy),
+    _stop(false),
+    _nextId(0)
+{
+    for (int i = 0; i < qMax(threads, 1); ++i)
+        _threads.append(new DecodeThread(this));
+}
+
+CRecognitionWorker::~CRecognitionWorker()
+{
+    stop();
+    qDeleteAll(_threads);
+}
+
+// Поставить фрагмент в очередь
+quint64 CRecognitionWorker::enqueue(const QByteArray &fragment)
+{
+    quint64 id;
+    quint64 droppedId = 0;
+    quint64 coalescedInto = 0;
+    bool wasDropped = false;
+    bool wasCoalesced = false;
+    int depth;
+    {
+        QMutexLocker locker(&_mutex);
+        id = _nextId++;
+        ++_stats.enqueued;
+
+        if (_queue.size() >= _capacity) {
+            if (_policy == Coalesce) {
+                // соседние по времени фрагменты декодируются одним вызовом
+                Job &last = _queue.last();
+                last.data.append(fragment);
+                coalescedInto = last.id;
+                wasCoalesced = true;
+                ++_stats.coalesced;
+            } else {
+                droppedId = _queue.dequeue().id;
+                wasDropped = true;
+                ++_stats.dropped;
+            }
+        }
+
+        if (!wasCoalesced) {
+            Job job;
+            job.id = id;
+            job.data = fragment;
+            job.queued.start();
+            _queue.enqueue(job);
+        }
+
+        depth = _stats.depth = _queue.size();
+        _stats.maxDepth = qMax(_stats.maxDepth, depth);
+        _condition.wakeOne();
+    }
+
+    if (wasDropped)
+        emit dropped(droppedId);
+    if (wasCoalesced)
+        emit coalesced(id, coalescedInto);
+    emit queueDepthChanged(depth);
+
+    // номера отброшенных фрагментов не должны задерживать следующие результаты
+    if (wasDropped || wasCoalesced) {
+        {
+            QMutexLocker locker(&_mutex);
+            Result result;
+            result.skip = true;
+            _finished.insert(wasDropped ? droppedId : id, result);
+        }
+        emitFinished();
+    }
+
+    foreach (DecodeThread *thread, _threads)
+        if (!thread->isRunning())
+            thread->start();
+    return id;
+}
+
+// Остановить потоки
+void CRecognitionWorker::stop()
+{
+    {
+        QMutexLocker locker(&_mutex);
+        _stop = true;
+        _queue.clear();
+        _stats.depth = 0;
+        _condition.wakeAll();
+    }
+    foreach (DecodeThread *thread, _threads)
+        thread->wait();
+
+    QMutexLocker locker(&_mutex);
+    _stop = false;
+    _finished.clear();
+    _nextEmitId = _nextId;
+}
+
+// Установить размер очереди
+void CRecognitionWorker::setCapacity(int capacity)
+{
+    QMutexLocker locker(&_mutex);
+    _capacity = qMax(capacity, 1);
+}
+
+// Получить размер очереди
+int CRecognitionWorker::capacity() const
+{
+    QMutexLocker locker(&_mutex);
+    return _capacity;
+}
+
+// Установить поведение при переполнении
+void CRecognitionWorker::setOverflowPolicy(OverflowPolicy policy)
+{
+    QMutexLocker locker(&_mutex);
+    _policy = policy;
+}
+
+// Получить поведение при переполнении
+CRecognitionWorker::OverflowPolicy CRecognitionWorker::overflowPolicy() const
+{
+    QMutexLocker locker(&_mutex);
+    return _policy;
+}
+
+// Получить счётчики очереди
+CRecognitionWorker::Stats CRecognitionWorker::stats() const
+{
+    QMutexLocker locker(&_mutex);
+    return _stats;
+}
+
+// Выдать готовые результаты по порядку номеров
+void CRecognitionWorker::emitFinished()
+{
+    QMutexLocker emitLocker(&_emitMutex);
+    forever {
+        quint64 id;
+        Result result;
+        {
+            QMutexLocker locker(&_mutex);
+            QMap<quint64, Result>::iterator it = _finished.find(_nextEmitId);
+            if (it == _finished.end())
+                return;
+            id = it.key();
+            result = it.value();
+            _finished.erase(it);
+            ++_nextEmitId;
+        }
+        if (!result.skip)
+            emit recognized(id, result.result);
+    }
+}
+
+// Обработка очереди в потоке распознавания
+void CRecognitionWorker::process()
+{
+    LatencyHistogram *const waitLatency = Metrics::instance().histogram("recognizer.queueWait");
+    LatencyHistogram *const decodeLatency = Metrics::instance().histogram("recognizer.decode");
+    forever {
+        Job job;
+        int depth;
+        {
+            QMutexLocker locker(&_mutex);
+            while (_queue.isEmpty() && !_stop)
+                _condition.wait(&_mutex);
+            if (_stop)
+                return;
+            job = _queue.dequeue();
+            depth = _stats.depth = _queue.size();
+            waitLatency->record(job.queued.nsecsElapsed());
+            const qint64 waited = job.queued.elapsed();
+            _stats.totalWaitMs += waited;
+            _stats.maxWaitMs = qMax(_stats.maxWaitMs, waited);
+        }
+        emit queueDepthChanged(depth);
+
+        QElapsedTimer timer;
+        timer.start();
+        Result result;
+        result.skip = false;
+        _speech->decodeRaw(job.data, result.result);
+        decodeLatency->record(timer.nsecsElapsed());
+        const qint64 elapsed = timer.elapsed();
+
+        {
+            QMutexLocker locker(&_mutex);
+            ++_stats.decoded;
+            _stats.totalDecodeMs += elapsed;
+            _finished.insert(job.id, result);
+        }
+        emitFinished();
+    }
+}
+
+void CRecognitionWorker::DecodeThread::run()
+{
+    _self->process();
+}
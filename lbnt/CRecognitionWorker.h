@@ -0,0 +1,131 @@
+/**
+ * @brief   Асинхронное распознавание фрагментов речи в отдельном потоке
+ * @file    CRecognitionWorker.h
+ *
+ * Фрагменты от VoiceSplitter ставятся в ограниченную очередь и
+ * декодируются в потоках распознавания (по одному на декодер пула
+ * CSpeechRecog), поэтому поток интерфейса (и обработка звука в нём) не
+ * ждёт декодера. Результаты возвращаются сигналами с номером фрагмента,
+ * выданным enqueue(), строго в порядке номеров.
+ */
+
+#ifndef CRECOGNITIONWORKER_H
+#define CRECOGNITIONWORKER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include "CRecognitionResult.h"
+
+class CSpeechRecog;
+
+class CRecognitionWorker : public QObject
+{
+    Q_OBJECT
+public:
+
+    // Поведение при заполненной очереди
+    enum OverflowPolicy {
+        DropOldest, // отбросить самый старый фрагмент
+        Coalesce    // объединить новый фрагмент с последним в очереди
+    };
+
+    // Счётчики очереди
+    struct Stats {
+        int depth;          // фрагментов в очереди сейчас
+        int maxDepth;       // наибольшая глубина очереди
+        quint64 enqueued;   // поставлено в очередь
+        quint64 decoded;    // распознано
+        quint64 dropped;    // отброшено при переполнении
+        quint64 coalesced;  // объединено с предыдущим фрагментом
+        qint64 totalWaitMs; // суммарное время ожидания в очереди
+        qint64 maxWaitMs;   // наибольшее время ожидания в очереди
+        qint64 totalDecodeMs; // суммарное время декодирования
+
+        Stats();
+    };
+
+    // Конструктор
+    explicit CRecognitionWorker(CSpeechRecog *speech, int capacity = 8,
+                                OverflowPolicy policy = DropOldest, int threads = 1,
+                                QObject *parent = 0);
+    ~CRecognitionWorker();
+
+    // Поставить фрагмент в очередь; возвращает номер фрагмента
+    quint64 enqueue(const QByteArray &fragment);
+    // Остановить потоки (фрагменты в очереди отбрасываются)
+    void stop();
+
+    // Установить размер очереди
+    void setCapacity(int capacity);
+    // Получить размер очереди
+    int capacity() const;
+    // Установить поведение при переполнении
+    void setOverflowPolicy(OverflowPolicy policy);
+    // Получить поведение при переполнении
+    OverflowPolicy overflowPolicy() const;
+    // Получить счётчики очереди
+    Stats stats() const;
+
+signals:
+    // Фрагмент распознан (гипотеза с уверенностью, словами и альтернативами)
+    void recognized(quint64 id, const CRecognitionResult &result);
+    // Фрагмент отброшен при переполнении очереди
+    void dropped(quint64 id);
+    // Фрагмент id объединён с фрагментом intoId (результат придёт для intoId)
+    void coalesced(quint64 id, quint64 intoId);
+    // Изменилась глубина очереди
+    void queueDepthChanged(int depth);
+
+protected:
+
+    // Поток распознавания
+    class DecodeThread: public QThread
+    {
+    public:
+        DecodeThread(CRecognitionWorker *worker) : _self(worker) {}
+        void run();
+    protected:
+        CRecognitionWorker *_self;
+    };
+
+    // Обработка очереди в потоке распознавания
+    void process();
+    // Выдать готовые результаты по порядку номеров
+    void emitFinished();
+
+private:
+    // Фрагмент в очереди
+    struct Job {
+        quint64 id;
+        QByteArray data;
+        QElapsedTimer queued;
+    };
+
+    // Результат, ожидающий своей очереди на выдачу
+    struct Result {
+        bool skip;  // фрагмент отброшен или объединён - сигнал не нужен
+        CRecognitionResult result;
+    };
+
+    CSpeechRecog *_speech;
+    QVector<DecodeThread*> _threads;
+    QMutex _emitMutex;  // сохраняет порядок сигналов из разных потоков
+    QMap<quint64, Result> _finished;  // готовые, но ещё не выданные результаты
+    quint64 _nextEmitId;  // номер следующего выдаваемого результата
+    mutable QMutex _mutex;
+    QWaitCondition _condition;
+    QQueue<Job> _queue;
+    int _capacity;
+    OverflowPolicy _policy;
+    bool _stop;
+    quint64 _nextId;
+    Stats _stats;
+};
+
+#endif // CRECOGNITIONWORKER_H
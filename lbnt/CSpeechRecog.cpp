@@ -1,18 +1,82 @@
+#include <QAtomicInt>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+#include <QBuffer>
+#include "../audio/metrics.h"
+#include "../audio/utils.h"
+#include "../audio/wavfileio.h"
+#include "CPocketSphinxBackend.h"
 #include "CSpeechRecog.h"
 
+namespace {
+
+// Имя поиска, который pocketsphinx создаёт из -lm/-jsgf конфигурации
+const char *DefaultSearch = "_default";
+
+// Результат декодирования одной фразы набора
+struct BatchResult
+{
+    QString str;
+    int score;
+};
+
+// Декодирование одной фразы набора в потоке QtConcurrent
+struct BatchDecode
+{
+    typedef BatchResult result_type;
+
+    explicit BatchDecode(const CSpeechRecog *speech) : _speech(speech) {}
+
+    BatchResult operator()(const QByteArray &raw) const
+    {
+        BatchResult result;
+        result.score = 0;
+        _speech->decodeRaw(raw, result.str, result.score);
+        return result;
+    }
+
+    const CSpeechRecog *_speech;
+};
+
+// Декодирование одной фразы набора с уверенностью, словами и альтернативами
+struct BatchDecodeResult
+{
+    typedef CRecognitionResult result_type;
+
+    explicit BatchDecodeResult(const CSpeechRecog *speech) : _speech(speech) {}
+
+    CRecognitionResult operator()(const QByteArray &raw) const
+    {
+        CRecognitionResult result;
+        _speech->decodeRaw(raw, result);
+        return result;
+    }
+
+    const CSpeechRecog *_speech;
+};
+
+}
+
 // Конструктор
 CSpeechRecog::CSpeechRecog(const QString &pathHmm, const QString &pathLm,
                            const QString &pathDict, const QString &pathGram, QObject *parent) :
     QObject(parent),
     _thread(nullptr),
-    _config(nullptr),
-    _ps(nullptr),
+    _backend(new CPocketSphinxBackend),
+    _decoderCount(1),
+    _nbestSize(5),
+    _searchVersion(0),
+    _initTime(0),
+    _warmStart(false),
     _pathHmm(pathHmm),
     _pathLm(pathLm),
     _pathDict(pathDict),
     _pathGram(pathGram),
     _sampleRate(8000)
 {
+    // результаты передаются сигналами между потоками
+    qRegisterMetaType<CRecognitionResult>();
 
 #ifdef __linux__
     if (_pathLm.isEmpty() && _pathHmm.isEmpty() && _pathDict.isEmpty()) {
@@ -26,7 +90,6 @@ CSpeechRecog::CSpeechRecog(const QString &pathHmm, const QString &pathLm,
 
 CSpeechRecog::~CSpeechRecog()
 {
-    this->free();
     if (_thread) {
         if (_thread->isRunning()){
             _thread->wait();
@@ -34,6 +97,8 @@ CSpeechRecog::~CSpeechRecog()
         delete _thread;
         _thread = nullptr;
     }
+    this->free();
+    delete _backend;
 }
 
 // Инициализировать
@@ -51,10 +116,18 @@ void CSpeechRecog::init()
 
 }
 
+// Дождаться окончания инициализации
+bool CSpeechRecog::waitForInit()
+{
+    if (_thread) _thread->wait();
+    return isInit();
+}
+
 // Проверить инициализирован ли
 bool CSpeechRecog::isInit() const
 {
-    if (_config != nullptr && _ps != nullptr)
+    QMutexLocker locker(&_poolMutex);
+    if (!_decoders.isEmpty())
         return true;
     else return false;
 }
@@ -62,10 +135,18 @@ bool CSpeechRecog::isInit() const
 // Сбросить
 void CSpeechRecog::free()
 {
-    if (_ps != nullptr) ps_free(_ps);
-    _ps = nullptr;
-    if (_config != nullptr) cmd_ln_free_r(_config);
-   _config = nullptr;
+    QMutexLocker locker(&_poolMutex);
+    // дождаться окончания начатых декодирований
+    while (_freeDecoders.size() < _decoders.size())
+        _poolCondition.wait(&_poolMutex);
+    // бэкенд может сохранить декодеры для следующей инициализации
+    foreach (CDecoder *decoder, _decoders)
+        _backend->releaseDecoder(decoder);
+    _decoders.clear();
+    _freeDecoders.clear();
+    _decoderVersions.clear();
+    // ждущие в acquireDecoder() получат nullptr
+    _poolCondition.wakeAll();
 }
 
 // Установить языковую модель
@@ -93,12 +174,123 @@ void CSpeechRecog::setGram(const QString &path)
     _pathGram = path;
 }
 
+// Добавить грамматику JSGF
+bool CSpeechRecog::addGrammar(const QString &name, const QString &path)
+{
+    return addSearch(CDecoder::GrammarSearch, name, path);
+}
+
+// Добавить список ключевых фраз
+bool CSpeechRecog::addKeywords(const QString &name, const QString &path)
+{
+    return addSearch(CDecoder::KeywordsSearch, name, path);
+}
+
+// Добавить ключевую фразу
+bool CSpeechRecog::addKeyphrase(const QString &name, const QString &phrase)
+{
+    return addSearch(CDecoder::KeyphraseSearch, name, phrase);
+}
+
+// Добавить языковую модель
+bool CSpeechRecog::addLanguageModel(const QString &name, const QString &path)
+{
+    return addSearch(CDecoder::LanguageModelSearch, name, path);
+}
+
+// Добавить поиск во все декодеры пула
+bool CSpeechRecog::addSearch(CDecoder::SearchType type, const QString &name, const QString &value)
+{
+    if (name.isEmpty() || name == DefaultSearch) return false;
+
+    Search search;
+    search.type = type;
+    search.name = name;
+    search.value = value;
+
+    QMutexLocker locker(&_poolMutex);
+    // Проверка загрузкой в свободный декодер, если он есть; в остальные
+    // декодеры поиск загружается перед их следующей фразой (acquireDecoder),
+    // поэтому вызов не ждёт окончания начатых фраз
+    CDecoder *decoder = nullptr;
+    if (!_freeDecoders.isEmpty()) {
+        decoder = _freeDecoders.takeLast();
+        locker.unlock();
+        const bool loaded = decoder->addSearch(type, name, value);
+        locker.relock();
+        _freeDecoders.append(decoder);
+        _poolCondition.wakeAll();
+        if (!loaded) return false;
+    }
+
+    for (int i = 0; i < _searches.size(); ++i)
+        if (_searches.at(i).name == name) _searches.removeAt(i--);
+    // проверочный декодер без других отложенных поисков повторно не загружает
+    const bool upToDate = decoder && _decoderVersions.value(decoder) == _searchVersion;
+    search.version = ++_searchVersion;
+    _searches.append(search);
+    if (upToDate && _decoderVersions.contains(decoder))
+        _decoderVersions.insert(decoder, search.version);
+    return true;
+}
+
+// Сделать поиск активным
+bool CSpeechRecog::setSearch(const QString &name)
+{
+    QMutexLocker locker(&_poolMutex);
+    if (!name.isEmpty()) {
+        bool found = false;
+        foreach (const Search &search, _searches) found = found || search.name == name;
+        if (!found) return false;
+    }
+    _activeSearch = name.toUtf8();
+    return true;
+}
+
+// Получить активный поиск
+QString CSpeechRecog::search() const
+{
+    QMutexLocker locker(&_poolMutex);
+    return QString::fromUtf8(_activeSearch);
+}
+
+// Получить имена добавленных поисков
+QStringList CSpeechRecog::searches() const
+{
+    QMutexLocker locker(&_poolMutex);
+    QStringList names;
+    foreach (const Search &search, _searches) names << search.name;
+    return names;
+}
+
+// Установить бэкенд декодеров
+void CSpeechRecog::setBackend(CDecoderBackend *backend)
+{
+    if (!backend || backend == _backend) return;
+    if (_thread && _thread->isRunning()) _thread->wait();
+    free();
+    delete _backend;
+    _backend = backend;
+}
+
+// Получить бэкенд декодеров
+CDecoderBackend *CSpeechRecog::backend() const
+{
+    return _backend;
+}
+
 // Установить частоту дискретизации
 void CSpeechRecog::setSampleRate(int samplerate)
 {
     _sampleRate = samplerate;
 }
 
+// Установить количество декодеров
+void CSpeechRecog::setDecoderCount(int count)
+{
+    _decoderCount = qMax(count, 1);
+}
+
 // Получить языковую модель
 QString CSpeechRecog::getLM() const
 {
@@ -129,61 +321,206 @@ int CSpeechRecog::getSampleRate() const
     return _sampleRate;
 }
 
-// Считать звук из ByteArray
-void CSpeechRecog::readBA(const QByteArray &ba, ps_decoder_t *ps) const
+// Установить наибольшее количество альтернатив
+void CSpeechRecog::setNBestSize(int size)
+{
+    _nbestSize = qMax(0, size);
+}
+
+// Получить наибольшее количество альтернатив
+int CSpeechRecog::nbestSize() const
 {
+    return _nbestSize;
+}
 
-    int rv = ps_start_utt(ps);
-    if (rv < 0) runtime_error("Failed to start utt, see log for details");
+// Получить количество декодеров
+int CSpeechRecog::decoderCount() const
+{
+    return _decoderCount;
+}
 
-    QDataStream stream(ba);
-    int16 buff[512];
+// Время последней инициализации
+qint64 CSpeechRecog::initTime() const
+{
+    return _initTime;
+}
 
-    int counter = 0;
-    int counter1 = 0;
-    while (!stream.atEnd()){
-        int nsamp = stream.readRawData((char*)buff,sizeof(int16)*512);
-        if (!(nsamp%2)) {
-            rv = ps_process_raw(ps, buff, nsamp/2, FALSE, FALSE);
-        }
-        else {
-            rv = ps_process_raw(ps, buff, (nsamp-1)/2, FALSE, FALSE);
+// Последняя инициализация использовала декодеры из кэша моделей
+bool CSpeechRecog::isWarmStart() const
+{
+    return _warmStart;
+}
+
+// Занять свободный декодер
+CDecoder *CSpeechRecog::acquireDecoder(bool wait) const
+{
+    // ожидание свободного декодера при занятом пуле
+    static LatencyHistogram *const acquireLatency = Metrics::instance().histogram("decoder.acquire");
+    LatencyTimer timer(acquireLatency);
+    QMutexLocker locker(&_poolMutex);
+    // пул может быть сброшен (free(), updateModel()) во время ожидания
+    while (_freeDecoders.isEmpty()) {
+        if (_decoders.isEmpty() || !wait) return nullptr;
+        _poolCondition.wait(&_poolMutex);
+    }
+    CDecoder *decoder = _freeDecoders.takeLast();
+
+    // поиски, добавленные после прошлой фразы декодера; загрузка - без
+    // блокировки пула, free() дождётся возврата декодера
+    const int version = _decoderVersions.value(decoder);
+    if (version < _searchVersion) {
+        QList<Search> pending;
+        foreach (const Search &search, _searches)
+            if (search.version > version) pending.append(search);
+        const int current = _searchVersion;
+        locker.unlock();
+        QList<Search> failed;
+        foreach (const Search &search, pending)
+            if (!decoder->addSearch(search.type, search.name, search.value)) failed.append(search);
+        locker.relock();
+        _decoderVersions.insert(decoder, current);
+        // поиск, не загрузившийся в декодер, убирается из пула целиком,
+        // чтобы setSearch() не выбирал его
+        foreach (const Search &search, failed) {
+            qDebug() << "CSpeechRecog: failed to load search" << search.name;
+            bool removed = false;
+            for (int i = 0; i < _searches.size(); ++i)
+                if (_searches.at(i).version == search.version) {
+                    _searches.removeAt(i--);
+                    removed = true;
+                }
+            if (removed && _activeSearch == search.name.toUtf8()) _activeSearch.clear();
         }
-        counter++;
-        counter1 += nsamp;
     }
 
-//    rv = ps_process_raw(ps, (const int16*) ba.constData(), ba.size()/2, FALSE, TRUE);
+    // переключение поиска между фразами
+    if (!decoder->setSearch(_activeSearch)) {
+        qDebug() << "CSpeechRecog: failed to set search" << _activeSearch;
+        _freeDecoders.append(decoder);
+        _poolCondition.wakeAll();
+        return nullptr;
+    }
+    return decoder;
+}
+
+// Вернуть декодер в пул
+void CSpeechRecog::releaseDecoder(CDecoder *decoder) const
+{
+    QMutexLocker locker(&_poolMutex);
+    _freeDecoders.append(decoder);
+    _poolCondition.wakeAll();
+}
 
+// Считать звук из ByteArray
+qint64 CSpeechRecog::readBA(const QByteArray &ba, CDecoder *decoder) const
+{
+    if (!decoder->startUtt()) throw runtime_error("Failed to start utt, see log for details");
 
-    rv = ps_end_utt(ps);
+    const qint64 nsamp = feedRaw(decoder, ba.constData(), ba.size());
 
+    decoder->endUtt();
+    return nsamp;
+}
+
+// Передать raw декодеру без промежуточного копирования
+qint64 CSpeechRecog::feedRaw(CDecoder *decoder, const char *data, qint64 length)
+{
+    // Данные QByteArray уже непрерывны, поэтому передаются декодеру
+    // как есть большими порциями; порция ограничена только типом size_t
+    // аргумента на 32-битных платформах
+    static const qint64 MaxSliceSamples = 1 << 24;
+
+    const qint64 nsamp = length / qint64(sizeof(qint16));
+    // путь декодирования: сообщается только первый такой фрагмент
+    static QAtomicInt oddReported(0);
+    if ((length % qint64(sizeof(qint16))) && oddReported.testAndSetRelaxed(0, 1))
+        qDebug() << "CSpeechRecog: odd raw length" << length << ", last byte ignored (reported once)";
+
+    // невыровненные данные (например, срез QByteArray::fromRawData) копируются
+    QByteArray aligned;
+    if (reinterpret_cast<quintptr>(data) % sizeof(qint16)) {
+        aligned = QByteArray(data, nsamp * qint64(sizeof(qint16)));
+        data = aligned.constData();
+    }
+
+    const qint16 *samples = reinterpret_cast<const qint16*>(data);
+    for (qint64 fed = 0; fed < nsamp; ) {
+        const qint64 count = qMin(nsamp - fed, MaxSliceSamples);
+        if (decoder->processRaw(samples + fed, count) < 0)
+            return fed;
+        fed += count;
+    }
+    return nsamp;
 }
 
 // Считать звук из файла
-void CSpeechRecog::readFile(const QString &path, ps_decoder_t *ps) const
+void CSpeechRecog::readFile(const QString &path, CDecoder *decoder) const
 {
     FILE *fh = nullptr;
     fh = fopen(path.toLocal8Bit().data(), "rb");
 
     if (!fh) throw runtime_error("Unable to open input file");
 
-    int rv = ps_start_utt(ps);
-    if (rv < 0) runtime_error("Failed to start utt, see log for details");
+    if (!decoder->startUtt()) {
+        fclose(fh);
+        throw runtime_error("Failed to start utt, see log for details");
+    }
 
-    int16 buff[512];
+    qint16 buff[512];
     while (!feof(fh)) {
         size_t nsamp;
         nsamp = fread(buff, 2, 512, fh);
-        rv = ps_process_raw(ps, buff, nsamp, FALSE, FALSE);
+        decoder->processRaw(buff, nsamp);
     }
 
-    rv = ps_end_utt(ps);
+    decoder->endUtt();
 
     fclose(fh);
 
 }
 
+// Считать звук из wav-файла
+qint64 CSpeechRecog::readWav(const QString &path, CDecoder *decoder) const
+{
+    // Окно отображения: файл любого размера декодируется без чтения
+    // в память целиком, занятая память не зависит от длины записи
+    static const qint64 MapWindowLength = 4 << 20;
+
+    WavFileReader file;
+    if (!file.open(path)) throw runtime_error("Unable to open input file");
+    if (!isDecodable(file.audioFormat())) throw runtime_error("Unsupported WAV format, 16-bit mono at decoder sample rate expected");
+
+    if (!decoder->startUtt()) throw runtime_error("Failed to start utt, see log for details");
+
+    qint64 nsamp = 0;
+    for (qint64 offset = 0; offset < file.dataLength(); ) {
+        qint64 length = MapWindowLength;
+        uchar *data = file.mapData(offset, &length);
+        if (data) {
+            nsamp += feedRaw(decoder, reinterpret_cast<const char*>(data), length);
+            file.unmap(data);
+        } else {
+            // файл не отображается (например, в ресурсах) - читаем окно
+            length = qMin(MapWindowLength, file.dataLength() - offset);
+            file.seek(file.headerLength() + offset);
+            const QByteArray window = file.read(length);
+            if (window.isEmpty()) break;
+            length = window.size();
+            nsamp += feedRaw(decoder, window.constData(), length);
+        }
+        offset += length;
+    }
+
+    decoder->endUtt();
+    return nsamp;
+}
+
+// Подходит ли формат wav декодеру
+bool CSpeechRecog::isDecodable(const QAudioFormat &format) const
+{
+    return isPCMS16LE(format) && format.channelCount() == 1 && format.sampleRate() == _sampleRate;
+}
+
 // Обновить языковую модель
 void CSpeechRecog::updateModel(){
     free();
@@ -191,32 +528,142 @@ void CSpeechRecog::updateModel(){
 }
 
 // Декодировать данные
-void CSpeechRecog::decode(ps_decoder_t *ps, QString &str, int &score) const
+void CSpeechRecog::decode(CDecoder *decoder, QString &str, int &score) const
+{
+    str.append(decoder->hypothesis(&score));
+}
+
+// Декодировать данные с уверенностью, словами и альтернативами
+void CSpeechRecog::decode(CDecoder *decoder, CRecognitionResult &result) const
 {
-    const char *hyp = ps_get_hyp(ps, &score);
-    str.append(hyp);
+    result = decoder->result(_nbestSize);
 }
 
 // Декодировать raw
 void CSpeechRecog::decodeRaw(const QByteArray &raw, QString &str, int &score) const
 {
     if (!raw.isEmpty() && isInit()) {
-        readBA(raw,_ps);
-        decode(_ps,str, score);
+        CDecoder *decoder = acquireDecoder();
+        if (!decoder) return;
+        try {
+            readBA(raw,decoder);
+        } catch (const runtime_error &err) {
+            qDebug() << "CSpeechRecog:" << err.what();
+            releaseDecoder(decoder);
+            return;
+        }
+        decode(decoder,str, score);
+        releaseDecoder(decoder);
+    }
+}
+
+// Декодировать raw с уверенностью, словами и альтернативами
+void CSpeechRecog::decodeRaw(const QByteArray &raw, CRecognitionResult &result) const
+{
+    if (!raw.isEmpty() && isInit()) {
+        CDecoder *decoder = acquireDecoder();
+        if (!decoder) return;
+        try {
+            readBA(raw, decoder);
+        } catch (const runtime_error &err) {
+            qDebug() << "CSpeechRecog:" << err.what();
+            releaseDecoder(decoder);
+            return;
+        }
+        decode(decoder, result);
+        releaseDecoder(decoder);
+    }
+}
+
+// Начать потоковое декодирование фразы
+CDecoder *CSpeechRecog::startStream(bool wait) const
+{
+    if (!isInit()) return nullptr;
+    CDecoder *decoder = acquireDecoder(wait);
+    if (!decoder) return nullptr;
+    if (!decoder->startUtt()) {
+        releaseDecoder(decoder);
+        return nullptr;
     }
+    return decoder;
+}
+
+// Передать очередную порцию raw
+QString CSpeechRecog::processStream(CDecoder *decoder, const QByteArray &raw) const
+{
+    if (!decoder) return QString();
+    feedRaw(decoder, raw.constData(), raw.size());
+    return decoder->hypothesis();
+}
+
+// Закончить фразу
+void CSpeechRecog::endStream(CDecoder *decoder, QString &str, int &score, bool cancel) const
+{
+    if (!decoder) return;
+    decoder->endUtt();
+    if (!cancel) decode(decoder, str, score);
+    releaseDecoder(decoder);
+}
+
+// Закончить фразу с уверенностью, словами и альтернативами
+void CSpeechRecog::endStream(CDecoder *decoder, CRecognitionResult &result, bool cancel) const
+{
+    if (!decoder) return;
+    decoder->endUtt();
+    if (!cancel) decode(decoder, result);
+    releaseDecoder(decoder);
+}
+
+// Декодировать набор фраз параллельно
+void CSpeechRecog::decodeBatch(const QList<QByteArray> &raws, QStringList &strs, QList<int> &scores) const
+{
+    // потоки сверх количества декодеров ждут свободный декодер в acquireDecoder();
+    // mapped() возвращает результаты в порядке входных данных
+    QFuture<BatchResult> future = QtConcurrent::mapped(raws, BatchDecode(this));
+    future.waitForFinished();
+
+    foreach (const BatchResult &result, future.results()) {
+        strs.append(result.str);
+        scores.append(result.score);
+    }
+}
+
+// Декодировать набор фраз параллельно с уверенностью, словами и альтернативами
+void CSpeechRecog::decodeBatch(const QList<QByteArray> &raws, QList<CRecognitionResult> &results) const
+{
+    QFuture<CRecognitionResult> future = QtConcurrent::mapped(raws, BatchDecodeResult(this));
+    future.waitForFinished();
+    results.append(future.results());
+}
+
+// Найти данные wav
+QByteArray CSpeechRecog::wavData(const QByteArray &wav) const
+{
+    // Данные ищутся по chunk-ам заголовка и передаются без копирования
+    QBuffer buffer;
+    buffer.setData(wav);
+    buffer.open(QIODevice::ReadOnly);
+    QAudioFormat format;
+    qint64 dataLength = 0;
+    if (!WavFileReader::readHeader(buffer, format, dataLength) || !isDecodable(format)) {
+        qDebug() << "CSpeechRecog: unsupported WAV" << format;
+        return QByteArray();
+    }
+    return QByteArray::fromRawData(wav.constData() + buffer.pos(), int(dataLength));
 }
 
 // Декодировать wav
 void CSpeechRecog::decodeWav(const QByteArray &wav, QString &str, int &score) const
 {
-    if (!wav.isEmpty() && isInit()) {
-        // Смещение 44 байта звголовка
-        char *data =  (char *)wav.data();
-        data += 44;
-        QByteArray raw(data, wav.size()-44);
-        decodeRaw(raw,str,score);
-    }
+    if (!wav.isEmpty() && isInit())
+        decodeRaw(wavData(wav),str,score);
+}
 
+// Декодировать wav с уверенностью, словами и альтернативами
+void CSpeechRecog::decodeWav(const QByteArray &wav, CRecognitionResult &result) const
+{
+    if (!wav.isEmpty() && isInit())
+        decodeRaw(wavData(wav), result);
 }
 
 // Преобразовать фразу формата raw в текст
@@ -224,10 +671,9 @@ QString CSpeechRecog::rawToString(const QByteArray &raw) const
 {
     if (raw.isEmpty()) return QString();
     if (!isInit()) return QString();
-    readBA(raw,_ps);
     QString str;
     int score = 0;
-    decode(_ps,str, score);
+    decodeRaw(raw, str, score);
     return str;
 }
 
@@ -235,54 +681,91 @@ QString CSpeechRecog::rawToString(const QByteArray &raw) const
 QString CSpeechRecog::rawToString(const QString &path) const
 {
     if (!isInit()) return QString();
+    CDecoder *decoder = acquireDecoder();
+    if (!decoder) return QString();
     QString str;
-    readFile(path,_ps);
     int score = 0;
-    decode(_ps,str, score);
+    try {
+        readFile(path,decoder);
+    } catch (...) {
+        releaseDecoder(decoder);
+        throw;
+    }
+    decode(decoder,str, score);
+    releaseDecoder(decoder);
     return str;
 }
 
 // Преобразовать wav в строку
 QString CSpeechRecog::wavToString(const QString &path) const
 {
-    if (!isInit()) return QString();
-    QFile file(path);
-    if (!file.open(QIODevice::ReadOnly)) throw runtime_error("Unable to open input file");
-    QByteArray wav = file.readAll();
-    file.close();
-    int score = 0;
+    CDecoder *decoder = acquireDecoder();
+    if (!decoder) return QString();
     QString str;
-    decodeWav(wav,str,score);
+    int score = 0;
+    try {
+        readWav(path,decoder);
+    } catch (...) {
+        releaseDecoder(decoder);
+        throw;
+    }
+    decode(decoder,str, score);
+    releaseDecoder(decoder);
     return str;
 }
 
 void CSpeechRecog::InitThread::run()
 {
+    QElapsedTimer timer;
+    timer.start();
+
+    CDecoderConfig config;
+    config.pathHmm = _self->_pathHmm;
+    config.pathLm = _self->_pathLm;
+    config.pathDict = _self->_pathDict;
+    config.pathGram = _self->_pathGram;
+    config.sampleRate = _self->_sampleRate;
+
+    QVector<CDecoder*> decoders;
+    int warm = 0;
+    int version = 0;  // загруженные поиски; добавленные позже - в acquireDecoder()
     try {
-        if (_self->_pathGram.isEmpty())
-            _self->_config = cmd_ln_init(nullptr, ps_args(), TRUE,
-                                     "-hmm", _self->_pathHmm.toLocal8Bit().data(),
-                                     "-lm", _self->_pathLm.toLocal8Bit().data(),
-                                     "-dict", _self->_pathDict.toLocal8Bit().data(),
-                                     "-samprate",  (QString("%1").arg(_self->_sampleRate)).toLocal8Bit().data(),
-                                     nullptr);
-        else
-            _self->_config = cmd_ln_init(nullptr, ps_args(), TRUE,
-                                         "-hmm", _self->_pathHmm.toLocal8Bit().data(),
-                                         /*"-lm", _self->_pathLm.toLocal8Bit().data(),*/
-                                         "-dict", _self->_pathDict.toLocal8Bit().data(),
-                                          "-jsgf", _self->_pathGram.toLocal8Bit().data(),
-                                         "-samprate",  (QString("%1").arg(_self->_sampleRate)).toLocal8Bit().data(),
-                                         nullptr);
-
-        if (!_self->_config) throw runtime_error("Failed to create config object, see log for details");
-
-        _self->_ps = ps_init(_self->_config);
-
-        if (!_self->_ps) throw runtime_error("Failed to create recognizer, see log for details");
+        // бэкенд создаёт декодеры или отдаёт готовые (кэш моделей pocketsphinx)
+        for (int i = 0; i < _self->_decoderCount; ++i) {
+            QString error;
+            CDecoder *decoder = _self->_backend->createDecoder(config, error);
+            if (!decoder) throw runtime_error(error.toLocal8Bit().data());
+            decoders.append(decoder);
+            if (decoder->isReused()) ++warm;
+        }
+
+        // именованные поиски, добавленные до повторной инициализации
+        QList<Search> searches;
+        {
+            QMutexLocker locker(&_self->_poolMutex);
+            searches = _self->_searches;
+            version = _self->_searchVersion;
+        }
+        foreach (CDecoder *decoder, decoders)
+            foreach (const Search &search, searches)
+                if (!decoder->addSearch(search.type, search.name, search.value))
+                    throw runtime_error(QString("Failed to load search %1, see log for details")
+                                        .arg(search.name).toLocal8Bit().data());
     } catch (std::runtime_error err) {
+        foreach (CDecoder *decoder, decoders) _self->_backend->releaseDecoder(decoder);
         emit _self->initError(QString(err.what()));
         return;
     }
+
+    {
+        QMutexLocker locker(&_self->_poolMutex);
+        _self->_decoders = decoders;
+        _self->_freeDecoders = decoders;
+        foreach (CDecoder *decoder, decoders) _self->_decoderVersions.insert(decoder, version);
+        _self->_initTime = timer.elapsed();
+        _self->_warmStart = warm == decoders.size();
+    }
+    qDebug() << "CSpeechRecog:" << _self->_backend->name() << "initialized in" << _self->_initTime << "ms,"
+             << warm << "of" << decoders.size() << "decoders reused";
     emit _self->initFinished();
 }
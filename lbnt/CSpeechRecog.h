@@ -15,8 +15,14 @@
 #include <stdexcept>
 #include <QDataStream>
 #include <QFile>
+#include <QHash>
+#include <QAudioFormat>
+#include <QMutex>
+#include <QStringList>
 #include <QThread>
-#include <pocketsphinx.h>
+#include <QVector>
+#include <QWaitCondition>
+#include "CDecoderBackend.h"
 
 #ifdef __linux__
 #define MODELDIR "/usr/local/share/pocketsphinx/model"
@@ -38,16 +44,38 @@ public:
 
     // Инициализировать
     void init();
+    // Дождаться окончания init(); true - инициализирован
+    bool waitForInit();
     // Проверить инициализирован ли
     bool isInit() const;
     // Сбросить
     void free();
     // Обновить модель
     void updateModel();
-    // Декодировать raw
+    // Декодировать raw (можно вызывать из нескольких потоков одновременно,
+    // каждый вызов занимает свободный декодер из пула)
     void decodeRaw(const QByteArray &raw, QString &str, int &score) const;
+    // Декодировать raw с уверенностью, словами и альтернативами
+    void decodeRaw(const QByteArray &raw, CRecognitionResult &result) const;
+    // Декодировать набор фраз параллельно на всех декодерах пула;
+    // результаты в порядке фраз
+    void decodeBatch(const QList<QByteArray> &raws, QStringList &strs, QList<int> &scores) const;
+    void decodeBatch(const QList<QByteArray> &raws, QList<CRecognitionResult> &results) const;
     // Декодировать wav
     void decodeWav(const QByteArray &wav, QString &str, int &score) const;
+    void decodeWav(const QByteArray &wav, CRecognitionResult &result) const;
+    // Начать потоковое декодирование фразы: занимает декодер пула
+    // до endStream(); nullptr - не инициализирован, ошибка или (wait ==
+    // false) нет свободного декодера
+    CDecoder *startStream(bool wait = true) const;
+    // Передать очередную порцию raw, получить частичную гипотезу
+    QString processStream(CDecoder *decoder, const QByteArray &raw) const;
+    // Закончить фразу и вернуть декодер в пул; str пуста, если cancel
+    void endStream(CDecoder *decoder, QString &str, int &score, bool cancel = false) const;
+    void endStream(CDecoder *decoder, CRecognitionResult &result, bool cancel = false) const;
+    // Передать raw декодеру без промежуточного копирования (в начатую фразу);
+    // возвращает количество переданных семплов (неполный семпл отбрасывается)
+    static qint64 feedRaw(CDecoder *decoder, const char *data, qint64 length);
     // Преобразовать фразу формата raw в текст
     QString rawToString(const QByteArray &raw) const;
     // Преобразовать фразу формата raw в строку
@@ -62,8 +90,38 @@ public:
     void setDict(const QString &path);
     // Установить грамматику
     void setGram(const QString &path);
+
+    // Именованные поиски: проверяются загрузкой в свободный декодер, в
+    // остальные декодеры пула загружаются перед их следующей фразой
+    // (и при следующих init()), переключаются setSearch()
+    // Добавить грамматику JSGF
+    bool addGrammar(const QString &name, const QString &path);
+    // Добавить список ключевых фраз (файл kws: фраза /порог/ в строке)
+    bool addKeywords(const QString &name, const QString &path);
+    // Добавить ключевую фразу
+    bool addKeyphrase(const QString &name, const QString &phrase);
+    // Добавить языковую модель
+    bool addLanguageModel(const QString &name, const QString &path);
+    // Сделать поиск активным; декодеры переключаются между фразами,
+    // начатые фразы дораспознаются прежним поиском. Пустое имя - поиск
+    // из -lm/-jsgf конфигурации
+    bool setSearch(const QString &name);
+    // Получить активный поиск
+    QString search() const;
+    // Получить имена добавленных поисков
+    QStringList searches() const;
+    // Установить бэкенд декодеров (CSpeechRecog становится владельцем;
+    // текущие декодеры освобождаются, новые создаются при init()).
+    // По умолчанию - CPocketSphinxBackend
+    void setBackend(CDecoderBackend *backend);
+    // Получить бэкенд декодеров
+    CDecoderBackend *backend() const;
     // Установить частоту дискретизации
     void setSampleRate(int samplerate);
+    // Установить количество декодеров (применяется при init())
+    void setDecoderCount(int count);
+    // Установить наибольшее количество альтернатив в CRecognitionResult
+    void setNBestSize(int size);
     // Получить языковую модель
     QString getLM() const;
     // Получить акустическую модель
@@ -74,6 +132,14 @@ public:
     QString getGram() const;
     // Получить частоту дискретизации
     int getSampleRate() const;
+    // Получить количество декодеров
+    int decoderCount() const;
+    // Получить наибольшее количество альтернатив
+    int nbestSize() const;
+    // Время последней инициализации, мс
+    qint64 initTime() const;
+    // Последняя инициализация использовала декодеры из кэша моделей
+    bool isWarmStart() const;
 
 signals:
     void initError(const QString &err);
@@ -91,17 +157,51 @@ protected:
         CSpeechRecog *_self;
     };
 
-    // Считать звук из ByteArray
-    void readBA(const QByteArray &ba, ps_decoder_t *ps) const;
+    // Считать звук из ByteArray; возвращает количество переданных семплов
+    qint64 readBA(const QByteArray &ba, CDecoder *decoder) const;
     // Считать звук из файла
-    void readFile(const QString &path, ps_decoder_t *ps) const;
+    void readFile(const QString &path, CDecoder *decoder) const;
+    // Считать звук из wav-файла, отображая данные в память окнами
+    qint64 readWav(const QString &path, CDecoder *decoder) const;
+    // Найти данные wav (без копирования); пусто - формат не подходит
+    QByteArray wavData(const QByteArray &wav) const;
+    // Подходит ли формат wav декодеру (16 бит, моно, частота декодера)
+    bool isDecodable(const QAudioFormat &format) const;
     // Декодировать данные
-    void decode(ps_decoder_t *ps, QString &str, int &score) const;
+    void decode(CDecoder *decoder, QString &str, int &score) const;
+    // Декодировать данные с уверенностью, словами и альтернативами
+    void decode(CDecoder *decoder, CRecognitionResult &result) const;
+    // Занять свободный декодер (при wait ждёт, пока он появится); nullptr -
+    // пул сброшен, не удалось переключить поиск или свободного нет
+    CDecoder *acquireDecoder(bool wait = true) const;
+    // Вернуть декодер в пул
+    void releaseDecoder(CDecoder *decoder) const;
+
+    // Именованный поиск
+    struct Search {
+        CDecoder::SearchType type;
+        QString name;
+        QString value;  // путь к файлу или ключевая фраза
+        int version;    // порядковый номер добавления
+    };
+    // Добавить поиск во все декодеры пула (загрузка в занятые - отложенная)
+    bool addSearch(CDecoder::SearchType type, const QString &name, const QString &value);
 
 private:
     InitThread *_thread;
-    cmd_ln_t *_config;  // Конфигурация
-    ps_decoder_t *_ps;  // Декодер CMUSpinx
+    CDecoderBackend *_backend;  // Фабрика декодеров
+    QVector<CDecoder*> _decoders;  // Пул декодеров
+    mutable QVector<CDecoder*> _freeDecoders;  // Свободные декодеры
+    mutable QMutex _poolMutex;
+    mutable QWaitCondition _poolCondition;
+    int _decoderCount;  // Количество декодеров
+    int _nbestSize;     // Наибольшее количество альтернатив
+    mutable QList<Search> _searches;  // Именованные поиски (под _poolMutex)
+    int _searchVersion;       // Номер последнего добавленного поиска (под _poolMutex)
+    mutable QHash<CDecoder*, int> _decoderVersions;  // Номер последнего поиска, загруженного в декодер (под _poolMutex)
+    mutable QByteArray _activeSearch; // Активный поиск, пусто - из конфигурации (под _poolMutex)
+    qint64 _initTime;   // Время последней инициализации, мс
+    bool _warmStart;    // Все декодеры взяты готовыми
     QString _pathHmm;   // Путь к папке акустической модели
     QString _pathLm;    // Путь к файлу языковой модели
     QString _pathDict;  // Путь файлу словаря
@@ -0,0 +1,136 @@
+#include <QDebug>
+#include "../audio/metrics.h"
+#include "CSpeechRecog.h"
+#include "CStreamingRecognizer.h"
+
+// Конструктор
+CStreamingRecognizer::CStreamingRecognizer(CSpeechRecog *speech, QThread *thread) :
+    QObject(nullptr),
+    _speech(speech),
+    _open(false),
+    _ps(nullptr),
+    _position(-1),
+    _armingRequired(false),
+    _armedFrom(-1),
+    _armUsed(false)
+{
+    if (thread) {
+        moveToThread(thread);
+    } else {
+        moveToThread(&_thread);
+        _thread.start();
+    }
+}
+
+CStreamingRecognizer::~CStreamingRecognizer()
+{
+    _thread.quit();
+    _thread.wait();
+    if (_ps) {
+        QString str;
+        int score = 0;
+        _speech->endStream(_ps, str, score, true);
+    }
+}
+
+// Подключить к потоковым сигналам VoiceSplitter
+void CStreamingRecognizer::connectSource(QObject *splitter)
+{
+    connect(splitter, SIGNAL(fragmentStarted(qint64)), this, SLOT(fragmentStarted(qint64)), Qt::QueuedConnection);
+    connect(splitter, SIGNAL(fragmentData(QByteArray)), this, SLOT(fragmentData(QByteArray)), Qt::QueuedConnection);
+    connect(splitter, SIGNAL(fragmentFinished(qint64,bool)), this, SLOT(fragmentFinished(qint64,bool)), Qt::QueuedConnection);
+}
+
+// Декодировать только фрагменты после armFrom()
+void CStreamingRecognizer::setArmingRequired(bool required)
+{
+    _armingRequired = required;
+}
+
+// Взвести декодирование следующего фрагмента
+void CStreamingRecognizer::armFrom(qint64 position)
+{
+    _armedFrom = position;
+}
+
+// Начался фрагмент
+void CStreamingRecognizer::fragmentStarted(qint64 position)
+{
+    if (_ps) {
+        // предыдущий фрагмент не был закрыт
+        QString str;
+        int score = 0;
+        _speech->endStream(_ps, str, score, true);
+        _ps = nullptr;
+    }
+    _open = false;
+    _pending.clear();
+    _armUsed = false;
+    _partial.clear();
+    _position = position;
+    if (_armingRequired) {
+        // фрагмент без активации не декодируется
+        if (_armedFrom < 0 || position < _armedFrom) return;
+        _armedFrom = -1;
+        _armUsed = true;
+    }
+    _open = true;
+    _ps = _speech->startStream(false);
+}
+
+// Очередные данные фрагмента
+void CStreamingRecognizer::fragmentData(const QByteArray &data)
+{
+    if (!_open) return;
+    QString partial;
+    if (_ps) {
+        partial = _speech->processStream(_ps, data);
+    } else {
+        // свободного декодера не было: данные копятся до его появления
+        _pending.append(data);
+        _ps = _speech->startStream(false);
+        if (!_ps) return;
+        partial = _speech->processStream(_ps, _pending);
+        _pending.clear();
+    }
+    if (partial != _partial) {
+        _partial = partial;
+        emit partialHypothesis(partial);
+    }
+}
+
+// Фрагмент закончился
+void CStreamingRecognizer::fragmentFinished(qint64 end, bool accepted)
+{
+    if (!_open) return;
+    _open = false;
+
+    QElapsedTimer timer;
+    timer.start();
+    if (!_ps && accepted) {
+        // последняя попытка получить декодер
+        _ps = _speech->startStream(false);
+        if (_ps)
+            _speech->processStream(_ps, _pending);
+        else
+            qDebug() << "CStreamingRecognizer: no free decoder, fragment at" << _position << "not recognized";
+    }
+    _pending.clear();
+
+    const bool decoded = _ps && accepted;
+    CRecognitionResult result;
+    if (_ps) {
+        _speech->endStream(_ps, result, !accepted);
+        _ps = nullptr;
+    }
+    if (decoded) {
+        static LatencyHistogram *const hypothesisLatency = Metrics::instance().histogram("stream.endToHypothesis");
+        hypothesisLatency->record(timer.nsecsElapsed());
+    }
+    // короткий (щелчок) или не распознанный фрагмент не расходует активацию
+    if (_armUsed && !decoded && _armedFrom < 0)
+        _armedFrom = end;
+    _armUsed = false;
+    if (decoded)
+        emit recognized(_position, result, timer.elapsed());
+}
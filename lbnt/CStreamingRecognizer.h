@@ -0,0 +1,81 @@
+/**
+ * @brief   Потоковое распознавание фрагментов речи по мере их записи
+ * @file    CStreamingRecognizer.h
+ *
+ * Подключается к потоковым сигналам VoiceSplitter (fragmentStarted,
+ * fragmentData, fragmentFinished). Фраза открывается в декодере в начале
+ * фрагмента, каждая порция звука сразу передаётся в ps_process_raw,
+ * поэтому к концу фрагмента остаётся только ps_end_utt. Работает в
+ * собственном потоке; сигналы приходят в поток получателя очередью.
+ *
+ * При setArmingRequired(true) декодируются только фрагменты, начавшиеся
+ * после armFrom() (например, по сигналу CWakeWordDetector::detected),
+ * по одному на каждый вызов.
+ *
+ * Вместо собственного потока можно передать общий поток (несколько
+ * распознавателей на одном потоке); его владелец должен остановить поток
+ * до удаления распознавателя.
+ *
+ * Декодер пула занимается без ожидания, поэтому поток не блокируется,
+ * когда декодеры заняты другими распознавателями: данные фрагмента
+ * копятся, пока декодер не освободится. Фрагмент, для которого декодер
+ * так и не освободился до его конца, не распознаётся.
+ */
+
+#ifndef CSTREAMINGRECOGNIZER_H
+#define CSTREAMINGRECOGNIZER_H
+
+#include <QObject>
+#include <QThread>
+#include <QElapsedTimer>
+#include "CRecognitionResult.h"
+
+class CSpeechRecog;
+class CDecoder;
+
+class CStreamingRecognizer : public QObject
+{
+    Q_OBJECT
+public:
+
+    // Конструктор; thread - общий поток, nullptr - собственный
+    explicit CStreamingRecognizer(CSpeechRecog *speech, QThread *thread = nullptr);
+    ~CStreamingRecognizer();
+
+    // Подключить к потоковым сигналам VoiceSplitter (или совместимого источника)
+    void connectSource(QObject *splitter);
+    // Декодировать только фрагменты после armFrom() (до init/start)
+    void setArmingRequired(bool required);
+
+public slots:
+    // Декодировать следующий фрагмент, начавшийся не раньше семпла position
+    void armFrom(qint64 position);
+    // Начался фрагмент
+    void fragmentStarted(qint64 position);
+    // Очередные данные фрагмента
+    void fragmentData(const QByteArray &data);
+    // Фрагмент закончился
+    void fragmentFinished(qint64 end, bool accepted);
+
+signals:
+    // Частичная гипотеза открытого фрагмента (выдаётся при изменении)
+    void partialHypothesis(const QString &hypothesis);
+    // Фрагмент распознан; position - начало фрагмента (то же, что в
+    // voiceFragmentAt источника, по нему получатель находит свой номер
+    // фрагмента), endLatencyMs - время от получения конца фрагмента до результата
+    void recognized(qint64 position, const CRecognitionResult &result, qint64 endLatencyMs);
+
+private:
+    CSpeechRecog *_speech;
+    QThread _thread;     // собственный поток (не запускается при общем)
+    bool _open;          // открытый фрагмент декодируется
+    CDecoder *_ps;       // декодер открытой фразы; nullptr - ещё не получен
+    QByteArray _pending; // данные открытого фрагмента до получения декодера
+    QString _partial;    // последняя выданная частичная гипотеза
+    qint64 _position;    // начало открытого фрагмента
+    bool _armingRequired;
+    qint64 _armedFrom;   // -1 - не взведён
+    bool _armUsed;       // открытый фрагмент декодируется по активации
+};
+
+#endif // CSTREAMINGRECOGNIZER_H
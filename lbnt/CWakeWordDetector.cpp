@@ -0,0 +1,131 @@
+#include <cmath>
+#include "../audio/metrics.h"
+#include "../audio/samplekernels.h"
+#include "CSpeechRecog.h"
+#include "CWakeWordDetector.h"
+
+// Поиск ключевой фразы в декодере детектора
+static const char *WakeSearch = "wake";
+
+// Сколько тишины слушать после громкого блока, мс
+static const int HangoverMs = 1000;
+
+// Порог не ниже этого уровня (около -50 дБ от максимума): шум
+// оцифровки в полной тишине не открывает декодер
+static const int MinGateLevel = 100;
+
+// Уровень шума следует за тихими блоками быстро, за громкими - медленно,
+// чтобы постоянный громкий шум со временем перестал открывать декодер
+static const int QuietAdaptShift = 3;
+static const int LoudAdaptShift = 8;
+
+// Конструктор
+CWakeWordDetector::CWakeWordDetector(const QString &pathHmm, const QString &pathDict,
+                                     const QString &keyphrase, int sampleRate) :
+    QObject(nullptr),
+    _speech(new CSpeechRecog(pathHmm, QString(), pathDict)),
+    _keyphrase(keyphrase),
+    _sampleRate(sampleRate),
+    _gateMarginDb(10),
+    _noiseFloor(-1),
+    _ps(nullptr),
+    _lastLoud(-1),
+    _busyNs(0),
+    _audioNs(0)
+{
+    _speech->setSampleRate(sampleRate);
+    _speech->setDecoderCount(1);
+    _speech->addKeyphrase(WakeSearch, keyphrase);
+    _speech->setSearch(WakeSearch);
+    connect(_speech, SIGNAL(initError(QString)), this, SIGNAL(initError(QString)));
+    connect(_speech, SIGNAL(initFinished()), this, SIGNAL(initFinished()));
+    _speech->moveToThread(&_thread);
+    moveToThread(&_thread);
+    _thread.start();
+}
+
+CWakeWordDetector::~CWakeWordDetector()
+{
+    _thread.quit();
+    _thread.wait();
+    close();
+    delete _speech;
+}
+
+// Инициализировать
+void CWakeWordDetector::init()
+{
+    _speech->init();
+}
+
+// Порог открытия фразы над уровнем шума
+void CWakeWordDetector::setGateMargin(int marginDb)
+{
+    _gateMarginDb.storeRelease(qBound(0, marginDb, 60));
+}
+
+// Процессорное время потока детектора, % от длительности звука
+double CWakeWordDetector::cpuLoad() const
+{
+    const qint64 audioNs = _audioNs.loadAcquire();
+    return audioNs ? 100.0 * _busyNs.loadAcquire() / audioNs : 0.0;
+}
+
+// Открыть фразу в декодере
+void CWakeWordDetector::open()
+{
+    if (!_ps) _ps = _speech->startStream();
+}
+
+// Закрыть фразу
+void CWakeWordDetector::close()
+{
+    if (!_ps) return;
+    QString str;
+    int score = 0;
+    _speech->endStream(_ps, str, score, true);
+    _ps = nullptr;
+}
+
+// Очередной блок звука
+void CWakeWordDetector::addBlock(const AudioBlock &block)
+{
+    const qint64 started = Metrics::threadCpuTime();
+
+    const int count = block.data.size() / int(sizeof(qint16));
+    const qint64 end = block.position + count;
+    _audioNs.fetchAndAddRelaxed(qint64(count) * 1000000000 / _sampleRate);
+
+    const int peak = measureLevel(reinterpret_cast<const qint16*>(block.data.constData()), count).peak;
+    if (_noiseFloor < 0) _noiseFloor = peak;
+    const double margin = std::pow(10.0, _gateMarginDb.loadAcquire() / 20.0);
+    const int gate = qBound(MinGateLevel, int(_noiseFloor * margin), 32767);
+    const bool loud = peak > gate;
+    _noiseFloor += (peak - _noiseFloor) / (1 << (loud ? LoudAdaptShift : QuietAdaptShift));
+    if (loud) _lastLoud = end;
+
+    // тишина: декодер не работает, блок запоминается как начало следующей фразы
+    const bool listening = _lastLoud >= 0 && end - _lastLoud <= qint64(_sampleRate) * HangoverMs / 1000;
+    if (!listening) {
+        close();
+        _preroll = block.data;
+        _busyNs.fetchAndAddRelaxed(Metrics::threadCpuTime() - started);
+        return;
+    }
+
+    if (!_ps) {
+        open();
+        if (_ps && !_preroll.isEmpty())
+            _speech->processStream(_ps, _preroll);
+        _preroll.clear();
+    }
+    if (_ps) {
+        const QString hypothesis = _speech->processStream(_ps, block.data);
+        if (!hypothesis.isEmpty()) {
+            // поиск ключевой фразы перезапускается с новой фразы декодера
+            close();
+            emit detected(end, hypothesis);
+        }
+    }
+    _busyNs.fetchAndAddRelaxed(Metrics::threadCpuTime() - started);
+}
@@ -0,0 +1,76 @@
+/**
+ * @brief   Обнаружение фразы активации в непрерывном потоке звука
+ * @file    CWakeWordDetector.h
+ *
+ * Отдельный декодер с поиском ключевой фразы (keyphrase spotting)
+ * слушает блоки Engine. Чтобы в тишине не тратить процессор, блоки без
+ * семплов громче порога декодеру не передаются: фраза открывается с
+ * первым громким блоком (вместе с предыдущим блоком) и закрывается
+ * после секунды тишины. Порог отсчитывается от уровня шума (пика тихих
+ * блоков), поэтому тихо сказанная фраза в тихой комнате тоже открывает
+ * декодер. Обнаружив фразу, детектор выдаёт detected() с позицией;
+ * полное распознавание включается только для фрагмента, начинающегося
+ * после неё.
+ */
+
+#ifndef CWAKEWORDDETECTOR_H
+#define CWAKEWORDDETECTOR_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QObject>
+#include <QThread>
+#include "../audio/audioblock.h"
+
+class CSpeechRecog;
+class CDecoder;
+
+class CWakeWordDetector : public QObject
+{
+    Q_OBJECT
+public:
+
+    // Конструктор; модели - те же, что у основного распознавателя
+    CWakeWordDetector(const QString &pathHmm, const QString &pathDict,
+                      const QString &keyphrase, int sampleRate);
+    ~CWakeWordDetector();
+
+    // Инициализировать (асинхронно, результат - initFinished/initError)
+    void init();
+    // Порог открытия фразы: на marginDb выше уровня шума (по умолчанию 10 дБ);
+    // можно вызывать из любого потока
+    void setGateMargin(int marginDb);
+    // Процессорное время потока детектора в % от длительности полученного
+    // звука (100% - одно ядро занято полностью); можно вызывать из любого потока
+    double cpuLoad() const;
+
+public slots:
+    // Очередной блок звука (16 бит, моно)
+    void addBlock(const AudioBlock &block);
+
+signals:
+    // Фраза активации закончилась не позже семпла position
+    void detected(qint64 position, const QString &keyphrase);
+    void initError(const QString &err);
+    void initFinished();
+
+private:
+    // Открыть фразу в декодере
+    void open();
+    // Закрыть фразу
+    void close();
+
+    CSpeechRecog *_speech;  // декодер с поиском ключевой фразы
+    QThread _thread;
+    QString _keyphrase;
+    int _sampleRate;
+    QAtomicInt _gateMarginDb;          // порог над уровнем шума
+    int _noiseFloor;                   // пик тихих блоков, -1 - ещё не измерен
+    CDecoder *_ps;                     // открытая фраза, nullptr - декодер не слушает
+    QByteArray _preroll;               // предыдущий блок тишины
+    qint64 _lastLoud;                  // конец последнего громкого блока, семплы
+    QAtomicInteger<qint64> _busyNs;    // процессорное время потока детектора
+    QAtomicInteger<qint64> _audioNs;   // длительность полученного звука
+};
+
+#endif // CWAKEWORDDETECTOR_H
@@ -0,0 +1,40 @@
+# Распознавание речи средствами CMUSphinx (pocketsphinx, sphinxbase).
+# Зависит от audio/wavfileio.cpp, audio/utils.cpp, audio/samplekernels.cpp и
+# audio/metrics.cpp, которые подключаются через audio/audio.pri или перечисляются в проекте.
+
+QT += concurrent
+
+SOURCES += \
+    $$PWD/CSpeechRecog.cpp \
+    $$PWD/CModelCache.cpp \
+    $$PWD/CPocketSphinxBackend.cpp \
+    $$PWD/CMockBackend.cpp \
+    $$PWD/CRecognitionResult.cpp \
+    $$PWD/CRecognitionWorker.cpp \
+    $$PWD/CStreamingRecognizer.cpp \
+    $$PWD/CWakeWordDetector.cpp
+
+HEADERS += \
+    $$PWD/CSpeechRecog.h \
+    $$PWD/CModelCache.h \
+    $$PWD/CDecoderBackend.h \
+    $$PWD/CPocketSphinxBackend.h \
+    $$PWD/CMockBackend.h \
+    $$PWD/CRecognitionResult.h \
+    $$PWD/CRecognitionWorker.h \
+    $$PWD/CStreamingRecognizer.h \
+    $$PWD/CWakeWordDetector.h
+
+win32 {
+    INCLUDEPATH += C:\QtProjects\CMUSphinx\sphinxbase-5prealpha\sphinxbase-5prealpha\include\
+    INCLUDEPATH += C:\QtProjects\CMUSphinx\pocketsphinx-5prealpha\pocketsphinx-5prealpha\include\
+
+    LIBS += C:\QtProjects\CMUSphinx\pocketsphinx-5prealpha\pocketsphinx-5prealpha\bin\Release\Win32\pocketsphinx.lib
+    LIBS += C:\QtProjects\CMUSphinx\sphinxbase-5prealpha\sphinxbase-5prealpha\bin\Release\Win32\sphinxbase.lib
+}
+
+# Серверы обработки архивов: библиотеки установлены в систему
+unix {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += pocketsphinx sphinxbase
+}
@@ -1,8 +1,26 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include <QDebug>
+#include <QSettings>
+#include "audio/metrics.h"
+#include "audio/waveform.h"
 
 #define TIMEOUT_VALUE 2000
+// Распознавать фрагменты по мере записи (частичные гипотезы,
+// результат сразу после конца фрагмента); 0 - распознавать готовые
+// фрагменты в CRecognitionWorker
+#define STREAMING_RECOGNITION 1
+// Устройства записи через ";" (имена из списка доступных).
+// Пусто - устройство по умолчанию
+#define CAPTURE_DEVICES ""
+// Каналов записи с каждого устройства (сколько поддерживает устройство,
+// но не больше); каждый канал выделяется и распознаётся отдельно
+#define CAPTURE_CHANNELS 1
+// Сохранять фрагменты и гипотезы в test/ (переключается кнопкой "Архив")
+#define ARCHIVE_FRAGMENTS true
+// Гипотезы с меньшей уверенностью (0..1) не принимаются как команды и
+// показываются серым, как частичные
+#define MIN_CONFIDENCE 0.3
 
 MainWindow::MainWindow(QWidget *parent) :
   QMainWindow(parent),
@@ -10,7 +28,16 @@ MainWindow::MainWindow(QWidget *parent) :
 {
   ui->setupUi(this);
 
-  _voiceSplitter = new VoiceSplitter(_audioFormat);
+  // Параметры выделения фрагментов: splitter.ini рядом с программой,
+  // изменения файла применяются на лету
+  QString pathSplitterConfig(QString(QCoreApplication::applicationDirPath()).append("/splitter.ini"));
+  VoiceSplitter::Params splitterParams;
+  if (splitterParams.load(pathSplitterConfig))
+    qDebug() << "VoiceSplitter parameters loaded from" << pathSplitterConfig;
+  if (QFile::exists(pathSplitterConfig)) {
+    _splitterConfigWatcher.addPath(pathSplitterConfig);
+    connect(&_splitterConfigWatcher, SIGNAL(fileChanged(QString)), this, SLOT(splitterConfigChanged(QString)));
+  }
   // Русская модель
   QString pathHmm(QString(QCoreApplication::applicationDirPath()).append("/model2/2000"));
   QString pathLM(QString(QCoreApplication::applicationDirPath()).append("/model2/ru.lm"));
@@ -19,29 +46,118 @@ MainWindow::MainWindow(QWidget *parent) :
   _speech = new CSpeechRecog(pathHmm, pathLM, pathDict, pathGram, this);
   _speech->setSampleRate(_audioFormat.samplingRate);
 
+  // задержки этапов дописываются в metrics.txt рядом с программой
+  Metrics::instance().startDump(QString(QCoreApplication::applicationDirPath()).append("/metrics.txt"), 10000);
+
   ui->label_2->setText(QString("<font size=20 color=#FF0000><b>%1</b></font>").arg("Инициализация"));
-  if (!initAudio()) msgError("Ошибка инициализации записи");
+  const bool audioReady = initAudio();
+
+#ifdef ENABLE_WAVEFORM
+  // Осциллограмма первого устройства: читает кольцевой буфер записи
+  // собственным курсором, плитки рисуются в отдельном потоке
+  if (!_engines.isEmpty()) {
+    Engine *engine = _engines.first();
+    Waveform *waveform = new Waveform(ui->centralWidget);
+    ui->verticalLayout->addWidget(waveform);
+    waveform->initialize(engine->format(), WaveformTileLength, WaveformWindowDuration);
+    waveform->setReader(engine->ringBuffer().reader());
+    // окно следует за последними записанными данными
+    connect(engine, SIGNAL(dataAvailable(qint64)), waveform, SLOT(dataAvailable(qint64)));
+    connect(engine, SIGNAL(dataAvailable(qint64)), waveform, SLOT(audioPositionChanged(qint64)));
+  }
+#endif
+
+  // Полоса (выделение фрагментов и потоковое распознавание) на каждый
+  // канал каждого устройства; полосы работают на общих рабочих потоках,
+  // звук приводится к частоте декодера
+  QList<QAudioFormat> sources;
+  foreach (Engine *engine, _engines)
+    sources << engine->format();
+#if STREAMING_RECOGNITION
+  _lanes = new ChannelLanes(sources, _audioFormat, splitterParams, _speech, 0, this);
+#else
+  _lanes = new ChannelLanes(sources, _audioFormat, splitterParams, nullptr, 0, this);
+#endif
+  connect(_lanes, SIGNAL(voiceFragment(int,quint64,qint64,QByteArray,qint64)),
+          this, SLOT(voiceFragment(int,quint64,qint64,QByteArray,qint64)));
+  connect(_lanes, SIGNAL(partialHypothesis(int,QString)), this, SLOT(partialHypothesis(int,QString)));
+  connect(_lanes, SIGNAL(recognized(int,quint64,CRecognitionResult)), this, SLOT(laneRecognized(int,quint64,CRecognitionResult)));
+  foreach (Engine *engine, _engines)
+    connect(engine, SIGNAL(blockCaptured(AudioBlock)), this, SLOT(blockCaptured(AudioBlock)));
+
+  // Распознавание готовых фрагментов в отдельных потоках (по одному на
+  // декодер): при отставании декодеров старые фрагменты отбрасываются.
+  // В потоковом режиме фрагменты декодируют полосы; полоса не ждёт
+  // декодер, занятый другими полосами, а копит данные фрагмента
+  _speech->setDecoderCount(2);
+  _recognizer = nullptr;
+#if !STREAMING_RECOGNITION
+  _recognizer = new CRecognitionWorker(_speech, 4, CRecognitionWorker::DropOldest, _speech->decoderCount(), this);
+  connect(_recognizer, SIGNAL(recognized(quint64,CRecognitionResult)), this, SLOT(fragmentRecognized(quint64,CRecognitionResult)));
+  connect(_recognizer, SIGNAL(dropped(quint64)), this, SLOT(fragmentDropped(quint64)));
+#endif
+
+  // Фраза активации ([WakeWord] Phrase в splitter.ini): распознаётся только
+  // фрагмент, следующий за ней. Нет фразы - распознаются все фрагменты.
+  // Отслеживается на первой полосе и управляет только ею
+  _wakeDetector = nullptr;
+  _armedFrom = -1;
+  QSettings config(pathSplitterConfig, QSettings::IniFormat);
+  const QString wakePhrase = config.value("WakeWord/Phrase").toString().trimmed();
+  if (!wakePhrase.isEmpty() && _lanes->laneCount() > 0) {
+    _wakeDetector = new CWakeWordDetector(pathHmm, pathDict, wakePhrase, _audioFormat.samplingRate);
+    _wakeDetector->setGateMargin(config.value("WakeWord/GateMarginDb", 10).toInt());
+    connect(_wakeDetector, SIGNAL(detected(qint64,QString)), this, SLOT(wakeWordDetected(qint64,QString)));
+    connect(_wakeDetector, SIGNAL(initError(QString)), this, SLOT(msgError(QString)));
+    _lanes->connectLane(0, _wakeDetector, SLOT(addBlock(AudioBlock)));
+    if (CStreamingRecognizer *streaming = _lanes->streamingRecognizer(0)) {
+      streaming->setArmingRequired(true);
+      connect(_wakeDetector, SIGNAL(detected(qint64,QString)), streaming, SLOT(armFrom(qint64)));
+    }
+  }
+
+  if (!audioReady) msgError("Ошибка инициализации записи");
   else initSpeechRecognizer();
+
+  // Архив фрагментов пишется в фоновом потоке; фрагменты полос - моно
+  // с частотой декодера
+  QAudioFormat archiveFormat = _engines.isEmpty() ? QAudioFormat() : _engines.first()->format();
+  archiveFormat.setChannelCount(1);
+  archiveFormat.setSampleRate(_audioFormat.samplingRate);
+  _archive = new ArchiveWriter("test", archiveFormat);
+  _archive->setEnabled(ARCHIVE_FRAGMENTS);
+  QAction *archiveAction = ui->mainToolBar->addAction("Архив");
+  archiveAction->setCheckable(true);
+  archiveAction->setChecked(ARCHIVE_FRAGMENTS);
+  connect(archiveAction, SIGNAL(toggled(bool)), this, SLOT(archiveToggled(bool)));
 }
 
 MainWindow::~MainWindow()
 {
   delete ui;
   //    _timer.stop();
-  _engine.stop();
+  foreach (Engine *engine, _engines) {
+    engine->stop();
+    disconnect(engine, SIGNAL(blockCaptured(AudioBlock)), this, SLOT(blockCaptured(AudioBlock)));
+  }
   //    disconnect(&_timer, SIGNAL(timeout()), this, SLOT(stopRecord()));
-  disconnect(_voiceSplitter, SIGNAL(voiceFragment(QByteArray)), this, SLOT(voiceFragment(QByteArray)));
-  disconnect(&_engine, SIGNAL(completeRecord(QByteArray)), this, SLOT(completeRecord(QByteArray)));
-  disconnect(&_engine, SIGNAL(bufferChanged(qint64,QByteArray)), this, SLOT(bufferChanged(qint64,QByteArray)));
-  delete _voiceSplitter;
+  // полосы останавливаются до удаления декодеров
+  delete _lanes;
+  delete _wakeDetector;
+  if (_recognizer) {
+    _recognizer->stop();
+    delete _recognizer;
+  }
   delete _speech;
+  delete _archive;
+  Metrics::instance().stopDump();
 }
 
 bool MainWindow::initAudio()
 {
-  QList<QAudioDeviceInfo> listAudioInputInfo = _engine.availableAudioInputDevices();
+  QList<QAudioDeviceInfo> listAudioInputInfo = QAudioDeviceInfo::availableDevices(QAudio::AudioInput);
 
-  QList<QAudioDeviceInfo> listAudioOutputInfo = _engine.availableAudioOutputDevices();
+  QList<QAudioDeviceInfo> listAudioOutputInfo = QAudioDeviceInfo::availableDevices(QAudio::AudioOutput);
 
   qDebug() << "Available audio input devices:";
   foreach (QAudioDeviceInfo device, listAudioInputInfo) {
@@ -53,55 +169,83 @@ bool MainWindow::initAudio()
     qDebug() << device.deviceName();
   }
 
-  // Select default input device
-  QAudioDeviceInfo device = QAudioDeviceInfo::defaultInputDevice();
+  // Устройства записи по именам; по умолчанию - устройство системы
+  QList<QAudioDeviceInfo> devices;
+  foreach (const QString &name, QString(CAPTURE_DEVICES).split(';', QString::SkipEmptyParts)) {
+    foreach (QAudioDeviceInfo device, listAudioInputInfo) {
+      if (device.deviceName() == name.trimmed()) {
+        devices << device;
+        break;
+      }
+    }
+  }
+  if (devices.isEmpty())
+    devices << QAudioDeviceInfo::defaultInputDevice();
 
-  qDebug() << "Default audio input devices:";
-  qDebug() << device.deviceName();
+  foreach (QAudioDeviceInfo device, devices) {
+    qDebug() << "Audio input device:";
+    qDebug() << device.deviceName();
 
-  qDebug() << "Codecs:";
-  QStringList listCodecs = device.supportedCodecs();
-  foreach (QString codec, listCodecs) {
-    qDebug() << codec;
-  }
+    qDebug() << "Codecs:";
+    QStringList listCodecs = device.supportedCodecs();
+    foreach (QString codec, listCodecs) {
+      qDebug() << codec;
+    }
 
-  qDebug() << "Sample rate:";
-  QList<int> listSampleRates = device.supportedSampleRates();
-  foreach (int sampleRate, listSampleRates) {
-    qDebug() << sampleRate;
-  }
+    qDebug() << "Sample rate:";
+    QList<int> listSampleRates = device.supportedSampleRates();
+    foreach (int sampleRate, listSampleRates) {
+      qDebug() << sampleRate;
+    }
 
-  qDebug() << "Sample size:";
-  QList<int> listSampleSizes = device.supportedSampleSizes();
-  foreach (int sampleSize, listSampleSizes) {
-    qDebug() << sampleSize;
-  }
+    qDebug() << "Sample size:";
+    QList<int> listSampleSizes = device.supportedSampleSizes();
+    foreach (int sampleSize, listSampleSizes) {
+      qDebug() << sampleSize;
+    }
 
-  if (!_engine.initializeRecord()) return false;
+    // наибольшее поддерживаемое количество каналов, не больше CAPTURE_CHANNELS
+    int channels = 1;
+    foreach (int channelCount, device.supportedChannelCounts()) {
+      if (channelCount <= CAPTURE_CHANNELS)
+        channels = qMax(channels, channelCount);
+    }
 
-  QAudioFormat audioFormat;
-  audioFormat.setByteOrder(QAudioFormat::LittleEndian);
-  audioFormat.setCodec(listCodecs[0]);
-  audioFormat.setSampleSize(16);
-  audioFormat.setSampleType(QAudioFormat::SignedInt);
-  audioFormat.setSampleRate(8000);
-  audioFormat.setChannelCount(1);
+    // частота декодера, если устройство её поддерживает, иначе ближайшая
+    // большая (если больших нет - наибольшая); полосы приводят звук к
+    // частоте декодера
+    int sampleRate = 0;
+    foreach (int rate, listSampleRates) {
+      if (rate >= _audioFormat.samplingRate && (sampleRate < _audioFormat.samplingRate || rate < sampleRate))
+        sampleRate = rate;
+      else if (sampleRate < _audioFormat.samplingRate && rate > sampleRate)
+        sampleRate = rate;
+    }
+    if (sampleRate <= 0)
+      sampleRate = _audioFormat.samplingRate;
 
-  qDebug() << "Audio format: " << audioFormat;
+    QAudioFormat audioFormat;
+    audioFormat.setByteOrder(QAudioFormat::LittleEndian);
+    audioFormat.setCodec(listCodecs.value(0, "audio/pcm"));
+    audioFormat.setSampleSize(16);
+    audioFormat.setSampleType(QAudioFormat::SignedInt);
+    audioFormat.setSampleRate(sampleRate);
+    audioFormat.setChannelCount(channels);
 
-  connect(&_engine, SIGNAL(completeRecord(QByteArray)), this, SLOT(completeRecord(QByteArray)));
-  connect(&_engine, SIGNAL(bufferChanged(qint64,QByteArray)), this, SLOT(bufferChanged(qint64,QByteArray)));
+    qDebug() << "Audio format: " << audioFormat;
 
-  //    connect(&_timer, SIGNAL(timeout()), this, SLOT(stopRecord()));
-  connect(_voiceSplitter, SIGNAL(voiceFragment(QByteArray)), this, SLOT(voiceFragment(QByteArray)));
+    Engine *engine = new Engine(this);
+    if (!engine->initializeRecord(device, audioFormat)) {
+      qDebug() << "Audio format is not supported by" << device.deviceName();
+      delete engine;
+      continue;
+    }
+    _engines << engine;
+  }
 
-  _engine.setAudioInputDevice(device);
-  if (device.isFormatSupported(audioFormat)) {
-    _engine.setAudioFormat(audioFormat);
-  } else
-    return false;
+  //    connect(&_timer, SIGNAL(timeout()), this, SLOT(stopRecord()));
 
-  return true;
+  return !_engines.isEmpty();
 }
 
 bool MainWindow::initSpeechRecognizer()
@@ -109,59 +253,147 @@ bool MainWindow::initSpeechRecognizer()
   connect(_speech, SIGNAL(initFinished()), this, SLOT(startRecord()));
   connect(_speech, SIGNAL(initError(QString)), this, SLOT(msgError(QString)));
   _speech->init();
+  if (_wakeDetector) _wakeDetector->init();
   return true;
 }
 
-void MainWindow::completeRecord(const QByteArray &record)
+void MainWindow::voiceFragment(int lane, quint64 id, qint64 position, const QByteArray &fragment, qint64 captureNs)
+{
+#if !STREAMING_RECOGNITION
+  // с фразой активации распознаётся только первый фрагмент после неё
+  // (потоковая полоса взводится детектором сама)
+  if (_wakeDetector && lane == 0) {
+    if (_armedFrom < 0 || position < _armedFrom)
+      return;
+    _armedFrom = -1;
+  }
+#endif
+  // в потоковом режиме фрагмент уже декодируется полосой по мере записи
+  if (_recognizer)
+    _workerIds.insert(_recognizer->enqueue(fragment), id);
+  FragmentTimes times;
+  times.captureNs = captureNs;
+  times.emitNs = Metrics::now();
+  _fragmentTimes.insert(id, times);
+  _archive->writeFragment(id, position, fragment);
+}
+
+void MainWindow::fragmentRecognized(quint64 id, const CRecognitionResult &result)
+{
+  if (!_workerIds.contains(id))
+    return;
+  const quint64 laneId = _workerIds.take(id);
+  laneRecognized(ChannelLanes::laneOf(laneId), laneId, result);
+}
+
+void MainWindow::laneRecognized(int lane, quint64 id, const CRecognitionResult &result)
+{
+  // от выделения фрагмента до гипотезы (очередь, декодирование, доставка
+  // в GUI) и от записи конца фрагмента до гипотезы (вся задержка: ещё
+  // доставка звука, преобразование частоты и обнаружение конца фрагмента)
+  static LatencyHistogram *const hypothesisLatency = Metrics::instance().histogram("pipeline.fragmentToHypothesis");
+  static LatencyHistogram *const captureLatency = Metrics::instance().histogram("pipeline.captureToHypothesis");
+  if (_fragmentTimes.contains(id)) {
+    const FragmentTimes times = _fragmentTimes.value(id);
+    const qint64 nowNs = Metrics::now();
+    hypothesisLatency->record(nowNs - times.emitNs);
+    if (times.captureNs)
+      captureLatency->record(nowNs - times.captureNs);
+  }
+  // вместе с фрагментом забываются и более ранние фрагменты его полосы
+  // (отброшенные или без гипотезы)
+  QHash<quint64, FragmentTimes>::iterator it = _fragmentTimes.begin();
+  while (it != _fragmentTimes.end()) {
+    if (ChannelLanes::laneOf(it.key()) == lane && it.key() <= id)
+      it = _fragmentTimes.erase(it);
+    else
+      ++it;
+  }
+  _archive->writeHypothesis(id, result.hypothesis, result.score);
+  // неуверенная гипотеза показывается серым вместе со следующей
+  // альтернативой (nbest начинается с самой гипотезы)
+  const bool accepted = !result.isEmpty() && result.confidence >= MIN_CONFIDENCE;
+  QString hypothesis = result.hypothesis;
+  if (!accepted && result.nbest.size() > 1)
+    hypothesis.append(QString(" (%1?)").arg(result.nbest.at(1).hypothesis));
+  const QString text = _lanes->laneCount() > 1 ? QString("%1: %2").arg(lane + 1).arg(hypothesis) : hypothesis;
+  ui->label->setText(QString("<font size=16 color=%1><b>%2</b></font>")
+                     .arg(accepted ? "#000000" : "#808080").arg(text));
+  ui->statusBar->showMessage(QString("Уверенность %1%").arg(qRound(result.confidence * 100)), TIMEOUT_VALUE);
+}
+
+void MainWindow::wakeWordDetected(qint64 position, const QString &keyphrase)
 {
-  _engine.startRecording();
+  _armedFrom = position;
+  ui->statusBar->showMessage(QString("Фраза активации \"%1\", нагрузка детектора %2%")
+                             .arg(keyphrase).arg(_wakeDetector->cpuLoad(), 0, 'f', 1), TIMEOUT_VALUE);
+  ui->label_2->setText(QString("<font size=20 color=#FF0000><b>%1</b></font>").arg("Говорите"));
 }
 
-void MainWindow::voiceFragment(const QByteArray &fragment)
+void MainWindow::partialHypothesis(int lane, const QString &hypothesis)
 {
-  QString str1;
-  str1 = _speech->rawToString(fragment);
-  _engine.dumpData(QString("test/%1.wav").arg(_counterFragment),fragment);
-  writeTxt(QString("test/%1.txt").arg(_counterFragment), str1);
-  ui->label->setText(QString("<font size=16 color=#000000><b>%1</b></font>").arg(str1));
-  _counterFragment++;
+  const QString text = _lanes->laneCount() > 1 ? QString("%1: %2").arg(lane + 1).arg(hypothesis) : hypothesis;
+  ui->label->setText(QString("<font size=16 color=#808080><b>%1</b></font>").arg(text));
 }
 
-void MainWindow::bufferChanged(qint64 length, const QByteArray &buffer)
+void MainWindow::fragmentDropped(quint64 id)
 {
-  QByteArray ba(buffer.constData(),length);
-  //    qDebug() << "Length: " << ba.length();
-  QByteArray block = ba.remove(0,_buffer.length());
-  _voiceSplitter->addBlock(block);
+  const quint64 laneId = _workerIds.take(id);
+  const CRecognitionWorker::Stats stats = _recognizer->stats();
+  qDebug() << "Lane" << ChannelLanes::laneOf(laneId) << "fragment" << laneId
+           << "dropped: recognition queue full, dropped" << stats.dropped
+           << "of" << stats.enqueued << ", max depth" << stats.maxDepth;
+}
+
+void MainWindow::splitterConfigChanged(const QString &path)
+{
+  // редакторы часто заменяют файл целиком - следим за новым
+  if (!_splitterConfigWatcher.files().contains(path) && QFile::exists(path))
+    _splitterConfigWatcher.addPath(path);
+
+  VoiceSplitter::Params params;
+  if (params.load(path)) {
+    _lanes->setParams(params);
+    qDebug() << "VoiceSplitter parameters reloaded from" << path;
+  }
+  // фраза активации меняется только с перезапуском, порог - на лету
+  if (_wakeDetector) {
+    QSettings config(path, QSettings::IniFormat);
+    _wakeDetector->setGateMargin(config.value("WakeWord/GateMarginDb", 10).toInt());
+  }
+}
+
+void MainWindow::blockCaptured(const AudioBlock &block)
+{
+  // блок копируется сразу: данные действительны только до выхода из
+  // слота; разделение каналов - в потоках полос
+  _lanes->addBlock(_engines.indexOf(static_cast<Engine *>(sender())), block);
   _counterBlock++;
   //    qDebug() << "Add Block " << _counterBlock << " size " << block.size();
-  _buffer = QByteArray(buffer.constData(),length);
-
 }
 
 void MainWindow::startRecord()
 {
-  _engine.startRecording();
-  _counterFragment = 0;
+  foreach (Engine *engine, _engines)
+    engine->startRecording();
   _counterBlock = 0;
   ui->label_2->setText(QString("<font size=20 color=#FF0000><b>%1</b></font>").arg("Слушаю"));
 }
 
 void MainWindow::stopRecord()
 {
-  _engine.stop();
+  foreach (Engine *engine, _engines)
+    engine->stop();
 }
 
-void MainWindow::writeTxt(const QString &path, const QString &txt)
+void MainWindow::archiveToggled(bool enabled)
 {
-  QTextStream stream;
-  QFile file(path);
-  if (file.open(QIODevice::WriteOnly)){
-    stream.setDevice(&file);
-    stream << txt;
-    file.flush();
-    file.close();
-  }
+  _archive->setEnabled(enabled);
+  // fsync - в потоке записи, интерфейс его не ждёт
+  if (!enabled)
+    _archive->requestFlush();
+  qDebug() << "Fragment archive" << (enabled ? "enabled" : "disabled")
+           << ", dropped" << _archive->dropped();
 }
 
 void MainWindow::msgError(const QString &err)
@@ -11,11 +11,19 @@
 
 #include <QMainWindow>
 #include "audio/engine.h"
+#include "audio/archivewriter.h"
 #include <QTimer>
 #include <QTextStream>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QList>
+#include "channellanes.h"
 #include "citis/VoiceSplitter.h"
 #include "citis/AudioFormat.h"
 #include "lbnt/CSpeechRecog.h"
+#include "lbnt/CRecognitionWorker.h"
+#include "lbnt/CStreamingRecognizer.h"
+#include "lbnt/CWakeWordDetector.h"
 
 namespace Ui {
 class MainWindow;
@@ -32,28 +40,45 @@ public:
 protected slots:
     void startRecord();
     void stopRecord();
-    void completeRecord(const QByteArray &record);
-    void voiceFragment(const QByteArray &fragment);
-    void bufferChanged(qint64 length, const QByteArray &buffer);
+    void voiceFragment(int lane, quint64 id, qint64 position, const QByteArray &fragment, qint64 captureNs);
+    void wakeWordDetected(qint64 position, const QString &keyphrase);
+    void fragmentRecognized(quint64 id, const CRecognitionResult &result);
+    void fragmentDropped(quint64 id);
+    void laneRecognized(int lane, quint64 id, const CRecognitionResult &result);
+    void partialHypothesis(int lane, const QString &hypothesis);
+    void blockCaptured(const AudioBlock &block);
+    void splitterConfigChanged(const QString &path);
     void msgError(const QString &err);
+    void archiveToggled(bool enabled);
 
 protected:
     bool initAudio();
     bool initSpeechRecognizer();
-    void writeTxt(const QString &path, const QString &txt);
 
 private:
+    // Моменты (Metrics::now()) фрагмента, ожидающего гипотезы
+    struct FragmentTimes
+    {
+        qint64 captureNs;   // запись последнего семпла; 0 - неизвестно
+        qint64 emitNs;      // выделение фрагмента
+    };
+
     Ui::MainWindow *ui;
-    Engine _engine;
+    QList<Engine *> _engines;     // по одному на устройство записи
     QTimer _timer;
-    VoiceSplitter *_voiceSplitter;
+    ChannelLanes *_lanes;
+    QFileSystemWatcher _splitterConfigWatcher;
     AudioFormat _audioFormat;
     CSpeechRecog  *_speech;
+    CRecognitionWorker *_recognizer;        // nullptr - потоковый режим
+    QHash<quint64, quint64> _workerIds;     // номер в _recognizer -> номер фрагмента полосы
+    CWakeWordDetector *_wakeDetector;
+    qint64 _armedFrom;
+    ArchiveWriter *_archive;
+    QHash<quint64, FragmentTimes> _fragmentTimes;
     QDataStream _stream;
     QFile _file;
-    int _counterFragment;
     int _counterBlock;
-    QByteArray _buffer;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,158 @@
+/**
+ * @brief   Размеченный корпус для оценки VoiceSplitter
+ * @file    corpus.cpp
+ */
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QTextStream>
+#include "audio/utils.h"
+#include "audio/wavfileio.h"
+#include "citis/AudioFormat.h"
+#include "corpus.h"
+
+// Длина блока, которыми данные подаются в VoiceSplitter (как при записи)
+static const quint32 BlockLengthMs = 100;
+
+// Тишина, добавляемая в конец файла, чтобы завершить последний фрагмент
+static const quint32 TrailingSilenceMs = 2000;
+
+static bool overlaps(const Interval &a, const Interval &b)
+{
+    return a.start < b.end && b.start < a.end;
+}
+
+Score& Score::operator+=(const Score& other)
+{
+    fragments += other.fragments;
+    falseFragments += other.falseFragments;
+    utterances += other.utterances;
+    detected += other.detected;
+    return *this;
+}
+
+bool readLabels(const QString &path, int sampleRate, QVector<Interval> &labels)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+        const QStringList fields = stream.readLine().split('\t');
+        if (fields.size() < 2)
+            continue;
+        bool okStart = false, okEnd = false;
+        const double start = fields[0].toDouble(&okStart);
+        const double end = fields[1].toDouble(&okEnd);
+        if (!okStart || !okEnd || end <= start)
+            continue;
+        Interval label = { qint64(start * sampleRate), qint64(end * sampleRate) };
+        labels.append(label);
+    }
+    return true;
+}
+
+bool readWav(const QString &path, QByteArray &pcm, int &sampleRate)
+{
+    WavFileReader file;
+    if (!file.open(path))
+        return false;
+    const QAudioFormat &format = file.audioFormat();
+    if (!isPCMS16LE(format) || format.channelCount() != 1)
+        return false;
+    sampleRate = format.sampleRate();
+    pcm = file.readAll();
+    return true;
+}
+
+QStringList collectFiles(const QStringList &arguments)
+{
+    QStringList files;
+    foreach (const QString &argument, arguments) {
+        const QFileInfo info(argument);
+        if (info.isDir()) {
+            const QDir dir(argument);
+            foreach (const QString &name, dir.entryList(QStringList() << "*.wav" << "*.WAV", QDir::Files, QDir::Name))
+                files << dir.filePath(name);
+        } else {
+            files << argument;
+        }
+    }
+    return files;
+}
+
+QVector<CorpusFile> loadCorpus(const QStringList &files, QStringList *skipped)
+{
+    QVector<CorpusFile> corpus;
+    foreach (const QString &path, files) {
+        const QFileInfo info(path);
+        const QString labelPath = info.dir().filePath(info.completeBaseName() + ".lab");
+
+        CorpusFile file;
+        file.path = path;
+        file.sampleRate = 0;
+        if (!readWav(path, file.pcm, file.sampleRate)) {
+            if (skipped)
+                *skipped << path + " (not a 16-bit mono WAV)";
+            continue;
+        }
+        if (!readLabels(labelPath, file.sampleRate, file.labels)) {
+            if (skipped)
+                *skipped << path + " (no labels)";
+            continue;
+        }
+        corpus.append(file);
+    }
+    return corpus;
+}
+
+Score evaluate(const CorpusFile &file, const VoiceSplitter::Params &params)
+{
+    AudioFormat format(1, file.sampleRate);
+    VoiceSplitter splitter(format, params);
+
+    QVector<Interval> fragments;
+    QObject::connect(&splitter, &VoiceSplitter::voiceFragmentAt,
+                     [&fragments](qint64 position, const QByteArray &fragment) {
+        Interval interval = { position, position + fragment.size() / AudioFormat::sampleSize };
+        fragments.append(interval);
+    });
+
+    const QByteArray &pcm = file.pcm;
+    const int blockLength = format.bytesInMilliseconds(BlockLengthMs);
+    for (int position = 0; position < pcm.size(); position += blockLength)
+        splitter.addBlock(QByteArray::fromRawData(pcm.constData() + position, qMin(blockLength, pcm.size() - position)));
+    splitter.addBlock(QByteArray(format.bytesInMilliseconds(TrailingSilenceMs), 0));
+
+    Score score;
+    score.fragments = fragments.size();
+    foreach (const Interval &fragment, fragments) {
+        bool hit = false;
+        foreach (const Interval &label, file.labels)
+            hit = hit || overlaps(fragment, label);
+        if (!hit)
+            ++score.falseFragments;
+    }
+
+    score.utterances = file.labels.size();
+    foreach (const Interval &label, file.labels) {
+        foreach (const Interval &fragment, fragments) {
+            if (overlaps(fragment, label)) {
+                ++score.detected;
+                break;
+            }
+        }
+    }
+    return score;
+}
+
+Score evaluate(const QVector<CorpusFile> &corpus, const VoiceSplitter::Params &params)
+{
+    Score score;
+    foreach (const CorpusFile &file, corpus)
+        score += evaluate(file, params);
+    return score;
+}
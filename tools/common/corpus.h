@@ -0,0 +1,73 @@
+/**
+ * @brief   Размеченный корпус для оценки VoiceSplitter
+ * @file    corpus.h
+ *
+ * Рядом с каждым WAV-файлом (16 бит, моно) должен лежать файл разметки
+ * с тем же именем и расширением .lab в формате меток Audacity:
+ * "начало<TAB>конец<TAB>текст" в секундах, по строке на высказывание.
+ *
+ * Каждый выделенный фрагмент - это один вызов декодера, поэтому
+ * считаются фрагменты, ложные фрагменты (не пересекающие ни одного
+ * высказывания) и полнота (доля высказываний, которые пересекает
+ * хотя бы один фрагмент).
+ */
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "citis/VoiceSplitter.h"
+
+// Участок записи в семплах
+struct Interval
+{
+    qint64 start;
+    qint64 end;
+};
+
+// Размеченная запись
+struct CorpusFile
+{
+    QString path;
+    QByteArray pcm;
+    int sampleRate;
+    QVector<Interval> labels;
+};
+
+// Результаты одного набора параметров
+struct Score
+{
+    int fragments;      // выделено фрагментов (вызовов декодера)
+    int falseFragments; // фрагментов вне высказываний
+    int utterances;     // размечено высказываний
+    int detected;       // высказываний, пересечённых фрагментами
+
+    Score(): fragments(0), falseFragments(0), utterances(0), detected(0) {}
+
+    double recall() const { return utterances ? 100.0 * detected / utterances : 0.0; }
+
+    Score& operator+=(const Score& other);
+};
+
+// Прочитать разметку в формате меток Audacity
+bool readLabels(const QString &path, int sampleRate, QVector<Interval> &labels);
+
+// Прочитать WAV-файл 16 бит моно
+bool readWav(const QString &path, QByteArray &pcm, int &sampleRate);
+
+// Список WAV-файлов из аргументов (файлы и каталоги)
+QStringList collectFiles(const QStringList &arguments);
+
+// Загрузить записи с разметкой; пропущенные файлы перечисляются в skipped
+QVector<CorpusFile> loadCorpus(const QStringList &files, QStringList *skipped = 0);
+
+// Прогнать запись через VoiceSplitter с заданными параметрами
+Score evaluate(const CorpusFile &file, const VoiceSplitter::Params &params);
+
+// Прогнать весь корпус
+Score evaluate(const QVector<CorpusFile> &corpus, const VoiceSplitter::Params &params);
+
+#endif // CORPUS_H
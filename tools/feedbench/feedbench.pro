@@ -0,0 +1,33 @@
+#-------------------------------------------------
+#
+# Сравнение способов передачи raw в декодер
+#
+#-------------------------------------------------
+
+QT       += core multimedia
+QT       -= gui
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+QMAKE_CXXFLAGS += -Wall -std=c++11
+
+TARGET = feedbench
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+include(../../lbnt/lbnt.pri)
+include(../../audio/buildid.pri)
+
+SOURCES += main.cpp \
+    ../../audio/samplekernels.cpp \
+    ../../audio/metrics.cpp \
+    ../../audio/wavfileio.cpp \
+    ../../audio/utils.cpp
+
+HEADERS += \
+    ../../audio/samplekernels.h \
+    ../../audio/metrics.h \
+    ../../audio/wavfileio.h \
+    ../../audio/utils.h
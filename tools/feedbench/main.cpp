@@ -0,0 +1,127 @@
+/**
+ * @brief   Накладные расходы передачи фрагмента в декодер
+ * @file    main.cpp
+ *
+ * Использование: feedbench [количество фрагментов]
+ *
+ * Сравнивает прежний способ CSpeechRecog::readBA (QDataStream и
+ * копирование порциями по 512 семплов в буфер на стеке) с передачей
+ * данных QByteArray без копирования - вызовом CSpeechRecog::feedRaw.
+ * Декодер - приёмник, который только читает семплы, поэтому измеряется
+ * именно стоимость подачи данных, без распознавания.
+ * Фрагменты 8 кГц длиной 0.4-3 с, часть - нечётной длины в байтах
+ * (неполный семпл отбрасывается и потерей не считается).
+ */
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+#include "lbnt/CSpeechRecog.h"
+
+typedef qint16 int16;
+
+// Приёмник вместо ps_process_raw
+class Sink : public CDecoder
+{
+public:
+    qint64 samples;  // получено семплов
+    qint64 calls;    // вызовов
+    qint64 checksum; // не даёт компилятору выбросить чтение
+
+    Sink(): samples(0), calls(0), checksum(0) {}
+
+    void process(const int16 *data, size_t count)
+    {
+        ++calls;
+        samples += count;
+        // декодер читает каждый семпл; здесь - каждый 64-й, чтобы
+        // приёмник не заслонял сравниваемые накладные расходы
+        for (size_t i = 0; i < count; i += 64)
+            checksum += data[i];
+    }
+
+    bool startUtt() { return true; }
+    qint64 processRaw(const qint16 *data, qint64 count) { process(data, size_t(count)); return count; }
+    bool endUtt() { return true; }
+    QString hypothesis(int *score) { if (score) *score = 0; return QString(); }
+    CRecognitionResult result(int) { return CRecognitionResult(); }
+    bool addSearch(SearchType, const QString &, const QString &) { return false; }
+    bool setSearch(const QByteArray &) { return true; }
+};
+
+// Прежний способ
+static void feedStream(const QByteArray &ba, Sink &sink)
+{
+    QDataStream stream(ba);
+    int16 buff[512];
+    while (!stream.atEnd()) {
+        int nsamp = stream.readRawData((char*)buff, sizeof(int16)*512);
+        if (!(nsamp%2))
+            sink.process(buff, nsamp/2);
+        else
+            sink.process(buff, (nsamp-1)/2);
+    }
+}
+
+// Без копирования
+static void feedDirect(const QByteArray &ba, Sink &sink)
+{
+    CSpeechRecog::feedRaw(&sink, ba.constData(), ba.size());
+}
+
+// Прогнать все фрагменты, вернуть время в нс
+static qint64 run(const QVector<QByteArray> &fragments, void (*feed)(const QByteArray&, Sink&), Sink &sink)
+{
+    QElapsedTimer timer;
+    timer.start();
+    foreach (const QByteArray &fragment, fragments)
+        feed(fragment, sink);
+    return timer.nsecsElapsed();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    const int count = app.arguments().size() > 1 ? app.arguments().at(1).toInt() : 2000;
+    const int sampleRate = 8000;
+
+    QVector<QByteArray> fragments;
+    qint64 expected = 0;  // целых семплов во всех фрагментах
+    quint32 seed = 1;
+    for (int i = 0; i < qMax(count, 1); ++i) {
+        seed = seed * 1103515245 + 12345;
+        const int samples = sampleRate * 4 / 10 + int((seed >> 8) % (sampleRate * 26 / 10));
+        QByteArray fragment(samples * int(sizeof(int16)) + (i % 4 == 0 ? 1 : 0), 0);
+        int16 *data = reinterpret_cast<int16*>(fragment.data());
+        for (int j = 0; j < samples; ++j)
+            data[j] = int16((j * 37 + i) & 0x0fff);
+        expected += fragment.size() / qint64(sizeof(int16));
+        fragments.append(fragment);
+    }
+
+    // прогрев
+    Sink warm;
+    run(fragments, feedStream, warm);
+    run(fragments, feedDirect, warm);
+
+    Sink streamSink, directSink;
+    const qint64 streamNs = run(fragments, feedStream, streamSink);
+    const qint64 directNs = run(fragments, feedDirect, directSink);
+
+    out << "Fragments: " << fragments.size() << ", samples: " << expected << endl;
+    out << "path\tns/fragment\tcalls/fragment\tsamples\tlost" << endl;
+    out << "stream\t" << streamNs / fragments.size() << '\t'
+        << QString::number(double(streamSink.calls) / fragments.size(), 'f', 1) << '\t'
+        << streamSink.samples << '\t' << expected - streamSink.samples << endl;
+    out << "direct\t" << directNs / fragments.size() << '\t'
+        << QString::number(double(directSink.calls) / fragments.size(), 'f', 1) << '\t'
+        << directSink.samples << '\t' << expected - directSink.samples << endl;
+    if (directNs)
+        out << "Speedup: " << QString::number(double(streamNs) / directNs, 'f', 1) << "x" << endl;
+    return streamSink.checksum == directSink.checksum ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+/**
+ * @brief   Подбор параметров VoiceSplitter на размеченном корпусе
+ * @file    main.cpp
+ *
+ * Использование:
+ *   splitsweep [--recall <%>] [--out <файл.ini>] <сетка.ini> <файл.wav | каталог> ...
+ *
+ * Сетка - ini-файл с группой [VoiceSplitter] в том же формате, что и
+ * файл параметров (см. VoiceSplitter::Params::load), но каждый ключ
+ * может содержать список значений через запятую:
+ *
+ *   [VoiceSplitter]
+ *   Mode=sample, frame
+ *   SilenceMaxValue=5, 10, 15
+ *   FragmentMaxSilenceLengthMs=200, 400, 600
+ *
+ * Перебираются все сочетания значений (не указанные ключи берутся по
+ * умолчанию), наборы параметров прогоняются по корпусу параллельно на
+ * всех ядрах. Из наборов с полнотой не ниже заданной (по умолчанию 95%)
+ * выбирается набор с наименьшим числом вызовов декодера; при равенстве
+ * - с меньшим числом ложных фрагментов. Лучший набор сохраняется в
+ * файл параметров, если указан --out.
+ */
+
+#include <algorithm>
+#include <QCoreApplication>
+#include <QSettings>
+#include <QTextStream>
+#include <QThread>
+#include <QtConcurrent>
+#include "tools/common/corpus.h"
+
+// Ключ сетки
+struct GridKey
+{
+    const char *name;
+    void (*set)(VoiceSplitter::Params &params, const QString &value);
+};
+
+static void setMode(VoiceSplitter::Params &p, const QString &v) { p.mode = v.compare("frame", Qt::CaseInsensitive) == 0 ? VoiceSplitter::FrameMode : VoiceSplitter::SampleMode; }
+static void setFragmentMinLengthMs(VoiceSplitter::Params &p, const QString &v) { p.fragmentMinLengthMs = v.toUInt(); }
+static void setFragmentMarginBeforeMs(VoiceSplitter::Params &p, const QString &v) { p.fragmentMarginBeforeMs = v.toUInt(); }
+static void setFragmentMarginAfterMs(VoiceSplitter::Params &p, const QString &v) { p.fragmentMarginAfterMs = v.toUInt(); }
+static void setFragmentMaxSilenceLengthMs(VoiceSplitter::Params &p, const QString &v) { p.fragmentMaxSilenceLengthMs = v.toUInt(); }
+static void setSilenceMaxValue(VoiceSplitter::Params &p, const QString &v) { p.silenceMaxValue = v.toUInt(); }
+static void setSilenceMaxLengthMs(VoiceSplitter::Params &p, const QString &v) { p.silenceMaxLengthMs = v.toUInt(); }
+static void setVadFrameLengthMs(VoiceSplitter::Params &p, const QString &v) { p.vadFrameLengthMs = v.toUInt(); }
+static void setVadEnergyThresholdDb(VoiceSplitter::Params &p, const QString &v) { p.vadEnergyThresholdDb = v.toInt(); }
+static void setVadMinEnergyDb(VoiceSplitter::Params &p, const QString &v) { p.vadMinEnergyDb = v.toInt(); }
+static void setVadMaxZcr(VoiceSplitter::Params &p, const QString &v) { p.vadMaxZcr = v.toInt(); }
+static void setVadFricativeZcr(VoiceSplitter::Params &p, const QString &v) { p.vadFricativeZcr = v.toInt(); }
+static void setVadStartFrames(VoiceSplitter::Params &p, const QString &v) { p.vadStartFrames = v.toInt(); }
+static void setVadNoiseAdaptRate(VoiceSplitter::Params &p, const QString &v) { p.vadNoiseAdaptRate = v.toInt(); }
+
+static const GridKey GridKeys[] = {
+    { "Mode", setMode },
+    { "FragmentMinLengthMs", setFragmentMinLengthMs },
+    { "FragmentMarginBeforeMs", setFragmentMarginBeforeMs },
+    { "FragmentMarginAfterMs", setFragmentMarginAfterMs },
+    { "FragmentMaxSilenceLengthMs", setFragmentMaxSilenceLengthMs },
+    { "SilenceMaxValue", setSilenceMaxValue },
+    { "SilenceMaxLengthMs", setSilenceMaxLengthMs },
+    { "VadFrameLengthMs", setVadFrameLengthMs },
+    { "VadEnergyThresholdDb", setVadEnergyThresholdDb },
+    { "VadMinEnergyDb", setVadMinEnergyDb },
+    { "VadMaxZcr", setVadMaxZcr },
+    { "VadFricativeZcr", setVadFricativeZcr },
+    { "VadStartFrames", setVadStartFrames },
+    { "VadNoiseAdaptRate", setVadNoiseAdaptRate }
+};
+
+// Набор параметров и его результат
+struct Candidate
+{
+    VoiceSplitter::Params params;
+    QString description; // значения перебираемых ключей
+    Score score;
+};
+
+// Развернуть сетку во все сочетания значений
+static bool expandGrid(const QString &path, QVector<Candidate> &candidates, QString &error)
+{
+    QSettings settings(path, QSettings::IniFormat);
+    if (settings.status() != QSettings::NoError) {
+        error = "cannot read " + path;
+        return false;
+    }
+    settings.beginGroup("VoiceSplitter");
+    foreach (const QString &key, settings.childKeys()) {
+        bool known = false;
+        for (size_t i = 0; i < sizeof(GridKeys) / sizeof(GridKeys[0]); ++i)
+            known = known || key == GridKeys[i].name;
+        if (!known) {
+            error = "unknown key " + key;
+            return false;
+        }
+    }
+
+    candidates.resize(1);
+    for (size_t i = 0; i < sizeof(GridKeys) / sizeof(GridKeys[0]); ++i) {
+        const GridKey &key = GridKeys[i];
+        if (!settings.contains(key.name))
+            continue;
+        const QStringList values = settings.value(key.name).toStringList();
+        if (values.isEmpty())
+            continue;
+
+        QVector<Candidate> expanded;
+        expanded.reserve(candidates.size() * values.size());
+        foreach (const Candidate &candidate, candidates) {
+            foreach (const QString &value, values) {
+                Candidate next = candidate;
+                key.set(next.params, value.trimmed());
+                next.description += QString("%1%2=%3").arg(next.description.isEmpty() ? "" : " ")
+                        .arg(key.name).arg(value.trimmed());
+                expanded.append(next);
+            }
+        }
+        candidates = expanded;
+    }
+    settings.endGroup();
+    return true;
+}
+
+static bool better(const Candidate &a, const Candidate &b)
+{
+    if (a.score.fragments != b.score.fragments)
+        return a.score.fragments < b.score.fragments;
+    return a.score.falseFragments < b.score.falseFragments;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QStringList arguments = app.arguments().mid(1);
+    double targetRecall = 95.0;
+    QString outPath;
+    while (!arguments.isEmpty() && arguments.first().startsWith("--")) {
+        const QString option = arguments.takeFirst();
+        if (option == "--recall" && !arguments.isEmpty())
+            targetRecall = arguments.takeFirst().toDouble();
+        else if (option == "--out" && !arguments.isEmpty())
+            outPath = arguments.takeFirst();
+        else
+            arguments.clear();
+    }
+    if (arguments.size() < 2) {
+        err << "Usage: splitsweep [--recall <percent>] [--out <best.ini>] <grid.ini> <file.wav | directory> ..." << endl;
+        return 1;
+    }
+
+    QVector<Candidate> candidates;
+    QString error;
+    if (!expandGrid(arguments.first(), candidates, error)) {
+        err << "Grid: " << error << endl;
+        return 1;
+    }
+
+    QStringList skipped;
+    const QVector<CorpusFile> corpus = loadCorpus(collectFiles(arguments.mid(1)), &skipped);
+    foreach (const QString &message, skipped)
+        err << "Skipped: " << message << endl;
+    if (corpus.isEmpty()) {
+        err << "No labelled files" << endl;
+        return 1;
+    }
+
+    err << "Evaluating " << candidates.size() << " parameter sets on " << corpus.size()
+        << " files using " << QThread::idealThreadCount() << " threads" << endl;
+
+    // каждый набор параметров прогоняется по корпусу в своём потоке;
+    // записи загружены один раз и только читаются
+    QtConcurrent::blockingMap(candidates, [&corpus](Candidate &candidate) {
+        candidate.score = evaluate(corpus, candidate.params);
+    });
+
+    std::sort(candidates.begin(), candidates.end(), better);
+
+    out << "decodes\tfalse\trecall,%\tparameters" << endl;
+    const Candidate *best = 0;
+    for (int i = 0; i < candidates.size(); ++i) {
+        const Candidate &candidate = candidates.at(i);
+        const bool accepted = candidate.score.recall() >= targetRecall;
+        if (accepted && !best)
+            best = &candidate;
+        out << candidate.score.fragments << '\t' << candidate.score.falseFragments << '\t'
+            << QString::number(candidate.score.recall(), 'f', 1) << (accepted ? "\t\t" : "*\t")
+            << (candidate.description.isEmpty() ? QString("(defaults)") : candidate.description) << endl;
+    }
+
+    if (!best) {
+        out << "No parameter set reaches recall " << targetRecall << "% (* - below target)" << endl;
+        return 2;
+    }
+
+    out << "Best at recall >= " << targetRecall << "%: " << best->score.fragments << " decodes, "
+        << (best->description.isEmpty() ? QString("(defaults)") : best->description) << endl;
+
+    if (!outPath.isEmpty() && !best->params.save(outPath)) {
+        err << "Cannot write " << outPath << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,429 @@
+/**
+ * @brief   Пакетное распознавание записей
+ * @file    main.cpp
+ *
+ * Использование:
+ *   transcribe [параметры] <файл.wav | файл.raw | сегмент.lba | каталог | @список> ...
+ *
+ *   --hmm <каталог>      акустическая модель (по умолчанию model2/2000 рядом с программой)
+ *   --lm <файл>          языковая модель (model2/ru.lm)
+ *   --dict <файл>        словарь (model2/ru.dic)
+ *   --jsgf <файл>        грамматика (model2/zitic.jsgf, если есть; "" - без грамматики)
+ *   --samprate <Гц>      частота декодера и raw-файлов (8000)
+ *   --splitter <файл>    параметры VoiceSplitter (ini, см. VoiceSplitter::Params::load)
+ *   --threads <N>        количество декодеров и потоков (по умолчанию - по числу ядер)
+ *   --nbest <N>          выводить до N альтернативных гипотез (0)
+ *   --mock <rtf>         вместо pocketsphinx - имитация декодера (CMockBackend)
+ *                        с временем декодирования rtf * длительность звука;
+ *                        модели не нужны, для нагрузочной проверки
+ *   --out <файл>         результаты (по умолчанию stdout)
+ *
+ * WAV-файлы должны быть 16 бит моно с частотой декодера; raw-файлы
+ * (.raw, .pcm) считаются 16 бит моно с частотой --samprate. @список -
+ * текстовый файл с путями по одному в строке.
+ *
+ * Сегменты архива фрагментов (.lba, см. audio/segmentarchive.h)
+ * отображаются в память, и их фрагменты декодируются как есть, без
+ * VoiceSplitter и без копирования звука; в строку JSON добавляются
+ * "id" и "archived" - гипотеза, записанная в архив при распознавании.
+ *
+ * Записи читаются блоками и делятся на фрагменты VoiceSplitter, как при
+ * записи с микрофона; фрагменты декодируются пачками на всех декодерах
+ * пула CSpeechRecog. Пачка декодируется в фоне, а записи тем временем
+ * делятся дальше и набирают следующую. На каждый фрагмент выводится
+ * строка JSON:
+ *   {"file": ..., "start": с, "end": с, "hypothesis": ..., "score": ...,
+ *    "confidence": 0..1, "words": [{"word": ..., "start": с, "end": с,
+ *    "confidence": 0..1}, ...], "nbest": [{"hypothesis": ..., "score": ...}, ...]}
+ * в порядке файлов и фрагментов; границы слов - от начала файла, паузы
+ * и шумы в words не выводятся, nbest - только при --nbest. В конце в stderr
+ * выводятся задержки этапов (Metrics). Программа не использует QtWidgets и
+ * звуковые устройства.
+ */
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QFuture>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include "audio/metrics.h"
+#include "audio/segmentarchive.h"
+#include "audio/utils.h"
+#include "audio/wavfileio.h"
+#include "citis/AudioFormat.h"
+#include "citis/VoiceSplitter.h"
+#include "lbnt/CMockBackend.h"
+#include "lbnt/CSpeechRecog.h"
+
+// Длина блока, которыми запись подаётся в VoiceSplitter
+static const quint32 BlockLengthMs = 1000;
+
+// Фрагмент, ожидающий декодирования
+struct Fragment
+{
+    QString file;
+    qint64 start;  // первый семпл
+    qint64 end;    // семпл за последним
+    QByteArray data;
+    qint64 id;     // номер фрагмента архива, -1 - не из архива
+    QString archived;
+};
+
+// Пачка фрагментов: декодируется в фоне, когда наберётся, пока набирается
+// следующая, и выводится по порядку
+class Batch
+{
+public:
+    Batch(const CSpeechRecog &speech, int sampleRate, int limit, QTextStream &out) :
+        _speech(speech), _sampleRate(sampleRate), _limit(limit), _out(out), _total(0)
+    {
+        // decodeBatch сам раздаёт фрагменты декодерам в общем пуле потоков;
+        // здесь только ожидание пачки
+        _decodePool.setMaxThreadCount(1);
+    }
+
+    void add(const Fragment &fragment)
+    {
+        _fragments.append(fragment);
+        if (_fragments.size() >= _limit)
+            submit();
+    }
+
+    // Начать декодирование набранной пачки; предыдущая сначала выводится
+    void submit()
+    {
+        if (_fragments.isEmpty())
+            return;
+        wait();
+
+        _decoding.swap(_fragments);
+        QList<QByteArray> raws;
+        foreach (const Fragment &fragment, _decoding)
+            raws.append(fragment.data);
+        _results.clear();
+        _future = QtConcurrent::run(&_decodePool, [this, raws]() {
+            _speech.decodeBatch(raws, _results);
+        });
+    }
+
+    // Декодировать и вывести всё набранное (звук фрагментов больше не нужен)
+    void finish()
+    {
+        submit();
+        wait();
+    }
+
+    int total() const { return _total; }
+
+private:
+    // Дождаться декодируемой пачки и вывести её
+    void wait()
+    {
+        if (_decoding.isEmpty())
+            return;
+        _future.waitForFinished();
+
+        for (int i = 0; i < _decoding.size(); ++i) {
+            const Fragment &fragment = _decoding.at(i);
+            const CRecognitionResult recognized = i < _results.size() ? _results.at(i) : CRecognitionResult();
+            const double start = double(fragment.start) / _sampleRate;
+            QJsonObject result;
+            result.insert("file", fragment.file);
+            result.insert("start", start);
+            result.insert("end", double(fragment.end) / _sampleRate);
+            if (fragment.id >= 0) {
+                result.insert("id", fragment.id);
+                result.insert("archived", fragment.archived);
+            }
+            result.insert("hypothesis", recognized.hypothesis);
+            result.insert("score", recognized.score);
+            result.insert("confidence", recognized.confidence);
+            QJsonArray words;
+            foreach (const CRecognitionResult::Word &word, recognized.spokenWords()) {
+                QJsonObject item;
+                item.insert("word", word.word);
+                item.insert("start", start + word.startMs / 1000.0);
+                item.insert("end", start + word.endMs / 1000.0);
+                item.insert("confidence", word.confidence);
+                words.append(item);
+            }
+            result.insert("words", words);
+            if (_speech.nbestSize() > 0) {
+                QJsonArray nbest;
+                foreach (const CRecognitionResult::Alternative &alternative, recognized.nbest) {
+                    QJsonObject item;
+                    item.insert("hypothesis", alternative.hypothesis);
+                    item.insert("score", alternative.score);
+                    nbest.append(item);
+                }
+                result.insert("nbest", nbest);
+            }
+            _out << QString::fromUtf8(QJsonDocument(result).toJson(QJsonDocument::Compact)) << '\n';
+        }
+        _out.flush();
+        _total += _decoding.size();
+        _decoding.clear();
+    }
+
+    const CSpeechRecog &_speech;
+    const int _sampleRate;
+    const int _limit;
+    QTextStream &_out;
+    QList<Fragment> _fragments;             // набираемая пачка
+    QList<Fragment> _decoding;              // декодируемая пачка
+    QList<CRecognitionResult> _results;     // результаты _decoding
+    QFuture<void> _future;
+    QThreadPool _decodePool;
+    int _total;
+};
+
+// Список файлов из аргументов (файлы, каталоги, @список)
+static QStringList collectFiles(const QStringList &arguments)
+{
+    QStringList files;
+    foreach (const QString &argument, arguments) {
+        if (argument.startsWith('@')) {
+            QFile list(argument.mid(1));
+            if (list.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                QTextStream stream(&list);
+                while (!stream.atEnd()) {
+                    const QString line = stream.readLine().trimmed();
+                    if (!line.isEmpty())
+                        files << line;
+                }
+            }
+            continue;
+        }
+        const QFileInfo info(argument);
+        if (info.isDir()) {
+            const QDir dir(argument);
+            foreach (const QString &name, dir.entryList(QStringList() << "*.wav" << "*.WAV" << "*.raw" << "*.pcm" << "*.lba",
+                                                        QDir::Files, QDir::Name))
+                files << dir.filePath(name);
+        } else {
+            files << argument;
+        }
+    }
+    return files;
+}
+
+// Разделить запись на фрагменты; false - файл не подходит
+static bool splitFile(const QString &path, int sampleRate, const VoiceSplitter::Params &params,
+                      Batch &batch, QString &error)
+{
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    const bool raw = suffix == "raw" || suffix == "pcm";
+
+    WavFileReader wav;
+    QFile rawFile(path);
+    QIODevice *device = &wav;
+    qint64 remaining = 0;
+    if (raw) {
+        if (!rawFile.open(QIODevice::ReadOnly)) {
+            error = "cannot open";
+            return false;
+        }
+        device = &rawFile;
+        remaining = rawFile.size();
+    } else {
+        if (!wav.open(path)) {
+            error = "not a WAV file";
+            return false;
+        }
+        const QAudioFormat &format = wav.audioFormat();
+        if (!isPCMS16LE(format) || format.channelCount() != 1 || format.sampleRate() != sampleRate) {
+            error = QString("unsupported format %1, 16-bit mono %2 Hz expected")
+                    .arg(formatToString(format)).arg(sampleRate);
+            return false;
+        }
+        remaining = wav.dataLength();
+    }
+
+    AudioFormat format(1, sampleRate);
+    VoiceSplitter splitter(format, params);
+    QObject::connect(&splitter, &VoiceSplitter::voiceFragmentAt,
+                     [&batch, &path](qint64 position, const QByteArray &data) {
+        Fragment fragment;
+        fragment.file = path;
+        fragment.start = position;
+        fragment.end = position + data.size() / AudioFormat::sampleSize;
+        fragment.data = data;
+        fragment.id = -1;
+        batch.add(fragment);
+    });
+
+    const qint64 blockLength = format.bytesInMilliseconds(BlockLengthMs);
+    while (remaining > 0) {
+        const QByteArray block = device->read(qMin(blockLength, remaining));
+        if (block.isEmpty())
+            break;
+        remaining -= block.size();
+        splitter.addBlock(block);
+    }
+
+    // тишина в конце завершает последний фрагмент
+    const quint32 trailingMs = params.fragmentMaxSilenceLengthMs + params.fragmentMarginAfterMs
+            + params.vadFrameLengthMs + BlockLengthMs;
+    splitter.addBlock(QByteArray(format.bytesInMilliseconds(trailingMs), 0));
+    return true;
+}
+
+// Декодировать фрагменты сегмента архива; false - файл не подходит
+static bool replaySegment(const QString &path, int sampleRate, Batch &batch, QString &error)
+{
+    SegmentReader segment;
+    if (!segment.open(path)) {
+        error = "not an archive segment";
+        return false;
+    }
+    const QAudioFormat &format = segment.format();
+    if (format.channelCount() != 1 || format.sampleSize() != 16 || format.sampleRate() != sampleRate) {
+        error = QString("unsupported format %1, 16-bit mono %2 Hz expected")
+                .arg(formatToString(format)).arg(sampleRate);
+        return false;
+    }
+
+    for (int i = 0; i < segment.count(); ++i) {
+        const SegmentReader::Record record = segment.record(i);
+        if (!record.samples)
+            continue;
+        Fragment fragment;
+        fragment.file = path;
+        fragment.start = record.position;
+        fragment.end = record.position + record.sampleCount;
+        fragment.data = record.pcm();
+        fragment.id = qint64(record.id);
+        fragment.archived = record.hypothesis;
+        batch.add(fragment);
+    }
+    // звук указывает в отображённый сегмент: декодировать до его закрытия
+    batch.finish();
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream err(stderr);
+
+    const QString modelDir = QCoreApplication::applicationDirPath() + "/model2";
+    QString pathHmm = modelDir + "/2000";
+    QString pathLm = modelDir + "/ru.lm";
+    QString pathDict = modelDir + "/ru.dic";
+    QString pathGram = QFile::exists(modelDir + "/zitic.jsgf") ? modelDir + "/zitic.jsgf" : QString();
+    QString pathSplitter;
+    QString pathOut;
+    int sampleRate = 8000;
+    int threads = QThread::idealThreadCount();
+    int nbest = 0;
+    double mockRealTimeFactor = -1.0;
+
+    QStringList arguments = app.arguments().mid(1);
+    QStringList inputs;
+    while (!arguments.isEmpty()) {
+        const QString argument = arguments.takeFirst();
+        if (!argument.startsWith("--")) {
+            inputs << argument;
+            continue;
+        }
+        if (arguments.isEmpty()) {
+            inputs.clear();
+            break;
+        }
+        const QString value = arguments.takeFirst();
+        if (argument == "--hmm") pathHmm = value;
+        else if (argument == "--lm") pathLm = value;
+        else if (argument == "--dict") pathDict = value;
+        else if (argument == "--jsgf") pathGram = value;
+        else if (argument == "--samprate") sampleRate = value.toInt();
+        else if (argument == "--splitter") pathSplitter = value;
+        else if (argument == "--threads") threads = value.toInt();
+        else if (argument == "--nbest") nbest = value.toInt();
+        else if (argument == "--mock") mockRealTimeFactor = qMax(0.0, value.toDouble());
+        else if (argument == "--out") pathOut = value;
+        else {
+            err << "Unknown option " << argument << endl;
+            return 1;
+        }
+    }
+
+    const QStringList files = collectFiles(inputs);
+    if (files.isEmpty() || sampleRate <= 0) {
+        err << "Usage: transcribe [--hmm dir] [--lm file] [--dict file] [--jsgf file] [--samprate Hz]"
+               " [--splitter ini] [--threads N] [--nbest N] [--mock rtf] [--out file.jsonl] <file.wav | file.raw | segment.lba | directory | @list> ..." << endl;
+        return 1;
+    }
+    threads = qMax(threads, 1);
+
+    VoiceSplitter::Params params;
+    if (!pathSplitter.isEmpty() && !params.load(pathSplitter)) {
+        err << "Cannot read " << pathSplitter << endl;
+        return 1;
+    }
+
+    QFile outFile;
+    if (pathOut.isEmpty()) {
+        outFile.open(stdout, QIODevice::WriteOnly);
+    } else {
+        outFile.setFileName(pathOut);
+        if (!outFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "Cannot write " << pathOut << endl;
+            return 1;
+        }
+    }
+    QTextStream out(&outFile);
+    out.setCodec("UTF-8");
+
+    // Декодеры пула: по одному на поток
+    QElapsedTimer timer;
+    timer.start();
+    CSpeechRecog speech(pathHmm, pathLm, pathDict, pathGram);
+    speech.setSampleRate(sampleRate);
+    speech.setDecoderCount(threads);
+    speech.setNBestSize(nbest);
+    if (mockRealTimeFactor >= 0.0)
+        speech.setBackend(new CMockBackend(mockRealTimeFactor));
+    QThreadPool::globalInstance()->setMaxThreadCount(threads);
+
+    QEventLoop loop;
+    QString initError;
+    QObject::connect(&speech, &CSpeechRecog::initFinished, &loop, &QEventLoop::quit);
+    QObject::connect(&speech, &CSpeechRecog::initError, &loop, [&loop, &initError](const QString &error) {
+        initError = error;
+        loop.quit();
+    });
+    speech.init();
+    loop.exec();
+    if (!speech.isInit()) {
+        err << "Recognizer initialization failed: " << initError << endl;
+        return 1;
+    }
+    err << threads << " decoders ready in " << timer.elapsed() << " ms" << endl;
+
+    timer.restart();
+    Batch batch(speech, sampleRate, threads * 4, out);
+    int failed = 0;
+    foreach (const QString &path, files) {
+        QString error;
+        const bool segment = QFileInfo(path).suffix().toLower() == "lba";
+        if (!(segment ? replaySegment(path, sampleRate, batch, error)
+                      : splitFile(path, sampleRate, params, batch, error))) {
+            err << "Skipped " << path << ": " << error << endl;
+            ++failed;
+        }
+    }
+    batch.finish();
+
+    err << files.size() - failed << " files, " << batch.total() << " fragments in "
+        << timer.elapsed() << " ms" << endl;
+    err << Metrics::instance().report();
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,39 @@
+#-------------------------------------------------
+#
+# Пакетное распознавание записей без интерфейса и звуковых устройств
+#
+#-------------------------------------------------
+
+QT       += core multimedia
+QT       -= gui
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+QMAKE_CXXFLAGS += -Wall -std=c++11
+
+TARGET = transcribe
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+include(../../lbnt/lbnt.pri)
+include(../../audio/buildid.pri)
+
+SOURCES += main.cpp \
+    ../../citis/VoiceSplitter.cpp \
+    ../../citis/AudioFormat.cpp \
+    ../../audio/samplekernels.cpp \
+    ../../audio/metrics.cpp \
+    ../../audio/segmentarchive.cpp \
+    ../../audio/wavfileio.cpp \
+    ../../audio/utils.cpp
+
+HEADERS += \
+    ../../citis/VoiceSplitter.h \
+    ../../citis/AudioFormat.h \
+    ../../audio/samplekernels.h \
+    ../../audio/metrics.h \
+    ../../audio/segmentarchive.h \
+    ../../audio/wavfileio.h \
+    ../../audio/utils.h
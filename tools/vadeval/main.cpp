@@ -0,0 +1,62 @@
+/**
+ * @brief   Оценка режимов выделения фрагментов VoiceSplitter на размеченном корпусе
+ * @file    main.cpp
+ *
+ * Использование: vadeval <файл.wav | каталог> ...
+ *
+ * Рядом с каждым WAV-файлом (16 бит, моно) должен лежать файл разметки
+ * с тем же именем и расширением .lab в формате меток Audacity:
+ * "начало<TAB>конец<TAB>текст" в секундах, по строке на высказывание.
+ * Файлы без разметки пропускаются.
+ *
+ * Каждый выделенный фрагмент - это один вызов декодера, поэтому для
+ * каждого режима считаются фрагменты, ложные фрагменты (не пересекающие
+ * ни одного высказывания) и полнота (доля высказываний, которые
+ * пересекает хотя бы один фрагмент).
+ */
+
+#include <QCoreApplication>
+#include <QTextStream>
+#include "tools/common/corpus.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    const QStringList files = collectFiles(app.arguments().mid(1));
+    if (files.isEmpty()) {
+        err << "Usage: vadeval <file.wav | directory> ..." << endl;
+        return 1;
+    }
+
+    QStringList skipped;
+    const QVector<CorpusFile> corpus = loadCorpus(files, &skipped);
+    foreach (const QString &message, skipped)
+        err << "Skipped: " << message << endl;
+
+    VoiceSplitter::Params sampleParams;
+    sampleParams.mode = VoiceSplitter::SampleMode;
+    VoiceSplitter::Params frameParams;
+    frameParams.mode = VoiceSplitter::FrameMode;
+
+    const Score sampleScore = evaluate(corpus, sampleParams);
+    const Score frameScore = evaluate(corpus, frameParams);
+    const int evaluated = corpus.size();
+
+    out << "Files: " << evaluated << ", utterances: " << sampleScore.utterances << endl;
+    out << "mode\tdecodes\tfalse\trecall,%" << endl;
+    out << "sample\t" << sampleScore.fragments << '\t' << sampleScore.falseFragments
+        << '\t' << QString::number(sampleScore.recall(), 'f', 1) << endl;
+    out << "frame\t" << frameScore.fragments << '\t' << frameScore.falseFragments
+        << '\t' << QString::number(frameScore.recall(), 'f', 1) << endl;
+
+    const int saved = sampleScore.fragments - frameScore.fragments;
+    out << "Decode calls saved by frame mode: " << saved;
+    if (sampleScore.fragments)
+        out << " (" << QString::number(100.0 * saved / sampleScore.fragments, 'f', 1) << "%)";
+    out << endl;
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+#-------------------------------------------------
+#
+# Оценка режимов VoiceSplitter на размеченном корпусе
+#
+#-------------------------------------------------
+
+QT       += core multimedia
+QT       -= gui
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+QMAKE_CXXFLAGS += -Wall -std=c++11
+
+TARGET = vadeval
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+include(../../audio/buildid.pri)
+
+SOURCES += main.cpp \
+    ../common/corpus.cpp \
+    ../../citis/VoiceSplitter.cpp \
+    ../../citis/AudioFormat.cpp \
+    ../../audio/samplekernels.cpp \
+    ../../audio/metrics.cpp \
+    ../../audio/wavfileio.cpp \
+    ../../audio/utils.cpp
+
+HEADERS += \
+    ../common/corpus.h \
+    ../../citis/VoiceSplitter.h \
+    ../../citis/AudioFormat.h \
+    ../../audio/samplekernels.h \
+    ../../audio/metrics.h \
+    ../../audio/wavfileio.h \
+    ../../audio/utils.h
@@ -0,0 +1,153 @@
+/**
+ * @brief   Нагрузка детектора фразы активации без речи
+ * @file    main.cpp
+ *
+ * Использование:
+ *   wakebench [параметры] [шум.wav]
+ *
+ *   --hmm <каталог>      акустическая модель (по умолчанию model2/2000 рядом с программой)
+ *   --dict <файл>        словарь (model2/ru.dic)
+ *   --phrase <фраза>     фраза активации ("окей компьютер")
+ *   --samprate <Гц>      частота сгенерированного шума (8000)
+ *   --seconds <с>        длительность сгенерированного шума (600)
+ *   --level <дБ>         пик сгенерированного шума от максимума (-50)
+ *   --block <мс>         длительность блока (20)
+ *   --margin <дБ>        порог над уровнем шума (10, см. CWakeWordDetector::setGateMargin)
+ *
+ * Через CWakeWordDetector прогоняется звук без речи: запись шума (WAV
+ * 16 бит моно) или, если файл не указан, белый шум уровня --level.
+ * Блоки подаются в поток детектора так же, как в программе, но без
+ * ожидания реального времени. Выводится процессорное время потока
+ * детектора (CLOCK_THREAD_CPUTIME_ID) в % от длительности звука -
+ * нагрузка на одно ядро в тишине; цель - меньше 5%. Если моделей нет,
+ * декодер не загружается и измеряется только путь тишины (порог).
+ * Код возврата 2 - нагрузка не меньше 5%.
+ */
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QTextStream>
+#include <cmath>
+#include "audio/audioblock.h"
+#include "audio/utils.h"
+#include "audio/wavfileio.h"
+#include "lbnt/CWakeWordDetector.h"
+
+// Цель нагрузки в тишине, % одного ядра
+static const double TargetLoad = 5.0;
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    qRegisterMetaType<AudioBlock>("AudioBlock");
+
+    const QString modelDir = QCoreApplication::applicationDirPath() + "/model2";
+    QString pathHmm = modelDir + "/2000";
+    QString pathDict = modelDir + "/ru.dic";
+    QString phrase = QString::fromUtf8("окей компьютер");
+    int sampleRate = 8000;
+    int seconds = 600;
+    int levelDb = -50;
+    int blockMs = 20;
+    int marginDb = 10;
+
+    QStringList arguments = app.arguments().mid(1);
+    QString pathWav;
+    bool usage = false;
+    while (!arguments.isEmpty()) {
+        const QString argument = arguments.takeFirst();
+        if (!argument.startsWith("--")) {
+            usage = usage || !pathWav.isEmpty();
+            pathWav = argument;
+            continue;
+        }
+        if (arguments.isEmpty()) {
+            usage = true;
+            break;
+        }
+        const QString value = arguments.takeFirst();
+        if (argument == "--hmm") pathHmm = value;
+        else if (argument == "--dict") pathDict = value;
+        else if (argument == "--phrase") phrase = value;
+        else if (argument == "--samprate") sampleRate = value.toInt();
+        else if (argument == "--seconds") seconds = value.toInt();
+        else if (argument == "--level") levelDb = value.toInt();
+        else if (argument == "--block") blockMs = value.toInt();
+        else if (argument == "--margin") marginDb = value.toInt();
+        else {
+            err << "Unknown option " << argument << endl;
+            return 1;
+        }
+    }
+    if (usage || sampleRate <= 0 || seconds <= 0 || blockMs <= 0) {
+        err << "Usage: wakebench [--hmm dir] [--dict file] [--phrase text] [--samprate Hz] [--seconds s]"
+               " [--level dBFS] [--block ms] [--margin dB] [noise.wav]" << endl;
+        return 1;
+    }
+
+    QByteArray pcm;
+    if (!pathWav.isEmpty()) {
+        WavFileReader file;
+        if (!file.open(pathWav) || !isPCMS16LE(file.audioFormat()) || file.audioFormat().channelCount() != 1) {
+            err << "Cannot read " << pathWav << " (16-bit mono WAV expected)" << endl;
+            return 1;
+        }
+        sampleRate = file.audioFormat().sampleRate();
+        pcm = file.readAll();
+    } else {
+        const int amplitude = qBound(1, int(32767 * std::pow(10.0, levelDb / 20.0)), 32767);
+        pcm.resize(int(qint64(sampleRate) * seconds * sizeof(qint16)));
+        qint16 *data = reinterpret_cast<qint16*>(pcm.data());
+        quint32 seed = 1;
+        for (int i = 0; i < pcm.size() / int(sizeof(qint16)); ++i) {
+            seed = seed * 1103515245 + 12345;
+            data[i] = qint16(int((seed >> 8) % (2 * amplitude + 1)) - amplitude);
+        }
+    }
+
+    CWakeWordDetector detector(pathHmm, pathDict, phrase, sampleRate);
+    detector.setGateMargin(marginDb);
+    int detections = 0;
+    QObject::connect(&detector, &CWakeWordDetector::detected, [&detections](qint64, const QString &) {
+        ++detections;
+    });
+
+    bool decoder = false;
+    if (QFileInfo(pathHmm).isDir()) {
+        QEventLoop loop;
+        QString initError;
+        QObject::connect(&detector, &CWakeWordDetector::initFinished, &loop, &QEventLoop::quit);
+        QObject::connect(&detector, &CWakeWordDetector::initError, &loop, [&loop, &initError](const QString &error) {
+            initError = error;
+            loop.quit();
+        });
+        detector.init();
+        loop.exec();
+        decoder = initError.isEmpty();
+        if (!decoder)
+            err << "Detector initialization failed: " << initError << endl;
+    }
+    if (!decoder)
+        err << "No decoder: measuring the silence path only" << endl;
+
+    // блоки подаются по одному, чтобы очередь потока детектора не росла
+    const int blockBytes = int(qint64(sampleRate) * blockMs / 1000) * int(sizeof(qint16));
+    for (int offset = 0; offset < pcm.size(); offset += blockBytes) {
+        const AudioBlock block(offset / int(sizeof(qint16)), int(sizeof(qint16)),
+                               pcm.mid(offset, qMin(blockBytes, pcm.size() - offset)));
+        QMetaObject::invokeMethod(&detector, "addBlock", Qt::BlockingQueuedConnection, Q_ARG(AudioBlock, block));
+    }
+    // сигналы detected из потока детектора
+    QCoreApplication::processEvents();
+
+    const double load = detector.cpuLoad();
+    out << "Audio: " << QString::number(double(pcm.size() / int(sizeof(qint16))) / sampleRate, 'f', 1)
+        << " s at " << sampleRate << " Hz, " << blockMs << " ms blocks" << endl;
+    out << "Decoder: " << (decoder ? "loaded" : "not loaded") << ", detections: " << detections << endl;
+    out << "Detector CPU: " << QString::number(load, 'f', 2) << "% of one core (target < "
+        << TargetLoad << "%)" << endl;
+    return load < TargetLoad ? 0 : 2;
+}
@@ -0,0 +1,34 @@
+#-------------------------------------------------
+#
+# Нагрузка детектора фразы активации без речи
+#
+#-------------------------------------------------
+
+QT       += core multimedia
+QT       -= gui
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+QMAKE_CXXFLAGS += -Wall -std=c++11
+
+TARGET = wakebench
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+include(../../lbnt/lbnt.pri)
+include(../../audio/buildid.pri)
+
+SOURCES += main.cpp \
+    ../../audio/samplekernels.cpp \
+    ../../audio/metrics.cpp \
+    ../../audio/wavfileio.cpp \
+    ../../audio/utils.cpp
+
+HEADERS += \
+    ../../audio/audioblock.h \
+    ../../audio/samplekernels.h \
+    ../../audio/metrics.h \
+    ../../audio/wavfileio.h \
+    ../../audio/utils.h
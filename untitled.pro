@@ -15,6 +15,7 @@ QT       += multimedia
 QMAKE_CXXFLAGS += -Wall -std=c++11
 
 include(audio/audio.pri)
+include(lbnt/lbnt.pri)
 
 TARGET = untitled
 TEMPLATE = app
@@ -22,21 +23,15 @@ TEMPLATE = app
 
 SOURCES += main.cpp\
         mainwindow.cpp \
+    channellanes.cpp \
     citis/VoiceSplitter.cpp \
     citis/AudioFormat.cpp \
-    citis/VoiceRecognizer.cpp \
-    lbnt/CSpeechRecog.cpp
+    citis/VoiceRecognizer.cpp
 
 HEADERS  += mainwindow.h \
+    channellanes.h \
     citis/VoiceSplitter.h \
     citis/AudioFormat.h \
-    citis/VoiceRecognizer.h \
-    lbnt/CSpeechRecog.h
+    citis/VoiceRecognizer.h
 
 FORMS    += mainwindow.ui
-
-INCLUDEPATH += C:\QtProjects\CMUSphinx\sphinxbase-5prealpha\sphinxbase-5prealpha\include\
-INCLUDEPATH += C:\QtProjects\CMUSphinx\pocketsphinx-5prealpha\pocketsphinx-5prealpha\include\
-
-LIBS += C:\QtProjects\CMUSphinx\pocketsphinx-5prealpha\pocketsphinx-5prealpha\bin\Release\Win32\pocketsphinx.lib
-LIBS += C:\QtProjects\CMUSphinx\sphinxbase-5prealpha\sphinxbase-5prealpha\bin\Release\Win32\sphinxbase.lib